@@ -44,11 +44,12 @@
 e_mutex_t global_mutex = MUTEX_NULL;
 
 /**
- * Get pointer on begin of Shared memory structure.
+ * Get pointer on begin of Shared memory structure of core group.
+ * Offset of group region is written by host into core configuration.
  * @return pointer on origin of SRAM
  */
 static EpDRAMBuf volatile *get_sram_origin() {
-	return (EpDRAMBuf*)0x8f000000;
+	return (EpDRAMBuf*)((char *)0x8f000000 + ((EpCoreBank1 *)BANK1)->config.dram_offset);
 }
 
 /**
@@ -77,6 +78,22 @@ static unsigned int stop_timer() {
     //return 0;
 }
 
+/**
+ * Start free-running clock of task traces (@see EpTaskTrace).
+ */
+static void start_trace_clock(void) {
+    e_ctimer_stop(E_CTIMER_1);
+    e_ctimer_set(E_CTIMER_1, E_CTIMER_MAX);
+    e_ctimer_start(E_CTIMER_1, E_CTIMER_CLK);
+}
+
+/**
+ * @return cycles elapsed since start_trace_clock().
+ */
+static unsigned int get_trace_clock(void) {
+    return E_CTIMER_MAX - e_ctimer_get(E_CTIMER_1);
+}
+
 /**
  * Copy memory buffer using DMA.
  * @param dst : pointer to destination memory location.
@@ -118,6 +135,53 @@ static void dma_transfer (
     return;
 }
 
+/**
+ * Copy 2D memory block using single DMA descriptor.
+ * Doubleword transfers are used if addresses, width and steps are multiples of 8.
+ * @param dst     : pointer to destination memory location.
+ * @param src     : pointer to source memory location.
+ * @param width   : width of block in BYTES. Must be non-zero.
+ * @param height  : number of lines in block. Must be non-zero.
+ * @param dst_step: distance in bytes between lines of destination block.
+ * @param src_step: distance in bytes between lines of source block.
+ */
+static void dma_transfer_2d (
+    void       volatile *const dst,
+    void const volatile *const src,
+    unsigned int         const width,
+    unsigned int         const height,
+    unsigned int         const dst_step,
+    unsigned int         const src_step
+) {
+    unsigned int const misaligned = ((size_t)dst | (size_t)src | width | dst_step | src_step) & 7;
+    unsigned int const element    = misaligned ? 1 : 8;
+
+    /*
+     * DMA adds inner stride after each element except the last one of a line,
+     * outer stride is added instead, so it jumps from the last element to the next line.
+     */
+    e_dma_desc_t desc;
+    e_dma_set_desc(E_DMA_0, E_DMA_ENABLE | E_DMA_MASTER | (misaligned ? E_DMA_BYTE : E_DMA_DWORD), 0x0000,
+        element, element,
+        width / element, height,
+        src_step - width + element, dst_step - width + element,
+        (void *)src, (void *)dst, &desc);
+    e_dma_start(&desc, E_DMA_0);
+    e_dma_wait(E_DMA_0);
+}
+
+/**
+ * Pause inside busy-wait loop on shared variable. Core simply keeps polling.
+ */
+static void spin_pause(void) {
+}
+
+/**
+ * Count evaluation of classifier node. Used by emulator cost model only.
+ */
+static void count_node_evaluation(void) {
+}
+
 /**
  * Increment shared variable
  * @param val pointer on variable for increment
@@ -134,6 +198,23 @@ static int atomic_increment(int volatile *const val, int const max_val) {
     return cur_val;
 }
 
+/**
+ * Add value to shared variable
+ * @param val pointer on variable for increment
+ * @param add value to be added
+ * @param max_val max value of variable
+ * @return unmodified (*val) value
+ */
+static int atomic_add(int volatile *const val, int const add, int const max_val) {
+    e_mutex_lock(0, 0, &global_mutex);
+    int const cur_val = *val;
+    if(cur_val < max_val)
+        *val = cur_val + add < max_val ? cur_val + add : max_val;
+    e_mutex_unlock(0, 0, &global_mutex);
+
+    return cur_val;
+}
+
 /**
  * Decrement shared variable
  * @param val pointer on variable for decrement
@@ -29,15 +29,17 @@ void lineTest(int n)
  *
  * @param scan_lines: Pointer to pointers to scan lines of current detection window.
  * @param x: Horizontal coordinate of current detection window.
- * @param node Classifier node used to make decision.
+ * @param feature: Feature description (@see EpNodeDecision).
+ * @param subsets: Subsets of feature values which give score (@see EpNodeDecision).
  * @return Decision value: 0 or 1.
  */
 static int device_calc_lbp_decision (
     unsigned char const *const *scan_lines,
     int x,
-    EpNodeDecision const *const node
+    int const feature,
+    int const *const subsets
 ) {
-    int const feature = node->feature;
+    count_node_evaluation();
 
     //Shifting position according to LBP feature position
     scan_lines += feature >> 24;
@@ -157,7 +159,7 @@ static int device_calc_lbp_decision (
         ( ( ( (unsigned int)~(sum20 - sum11) ) & sign ) >> 30 ) |
         (   ( (unsigned int)~(sum10 - sum11) )          >> 31 ) ;
 
-    return (node->subsets[subset_index] >> bit_index) & 1;
+    return (subsets[subset_index] >> bit_index) & 1;
 }
 
 /**
@@ -167,41 +169,43 @@ static int device_calc_lbp_decision (
  * NODE_DECISION: calculate value of specified feature and modify object_score
  *   by specified value if feature value is in specified subset.
  * NODE_STAGE: compare object_score accumulated so far with specified threshold.
- *   if value is less than threshold then return 0 otherwise continue.
+ *   if value is less than threshold then return 0 (first stage) or -1 (later stages) otherwise continue.
  * NODE_FINAL: return 1.
  * For performance reasons it is supposed that first node is always
  * NODE_DECISION, and two NODE_STAGE nodes are never go in succession.
- * @param image_data Position in memory where to sample data from.
- * @return 1 for positive classification. Zero otherwise.
+ * @param scan_lines Pointers to scan lines of current detection window.
+ * @param x Horizontal coordinate of current detection window.
+ * @param node The first node to interpret (node after META node, or the first node of classifier page).
+ * @return 1 for positive classification. Zero if window is rejected by the first stage, -1 if by a later one.
  */
 static int classify (
     unsigned char const *const *const scan_lines,
-    int const x
+    int const x,
+    char const *node
 ) {
-    //Skipping initial META node
-	char const *node = (char *)((EpCoreBank3 *)BANK3)->buf_classifier + sizeof(EpNodeMeta);
-
-    //Node after META is always NODE_DECISION
+    //The first node is always NODE_DECISION
     int object_score = ((EpNodeDecision const *)node)->score &
-        -device_calc_lbp_decision(scan_lines, x, (EpNodeDecision const *)node);
+        -device_calc_lbp_decision(scan_lines, x, ((EpNodeDecision const *)node)->feature, ((EpNodeDecision const *)node)->subsets);
     node += sizeof(EpNodeDecision);
+    int rejected = 0;
 
     while(1) {
         if(!*node) { //NODE_DECISION
             object_score += ((EpNodeDecision const *)node)->score &
-                -device_calc_lbp_decision(scan_lines, x, (EpNodeDecision const *)node);
+                -device_calc_lbp_decision(scan_lines, x, ((EpNodeDecision const *)node)->feature, ((EpNodeDecision const *)node)->subsets);
             node += sizeof(EpNodeDecision);
         } else { //NODE_STAGE
             if(object_score < ((EpNodeStage *)node)->threshold)
-                return 0;
+                return rejected;
             node += sizeof(EpNodeStage);
+            rejected = -1;
 
             if(*node)
                 return 1; //NODE_FINAL
 
             //NODE_DECISION is after NODE_STAGE if no NODE_FINAL found
             object_score = ((EpNodeDecision const *)node)->score &
-                -device_calc_lbp_decision(scan_lines, x, (EpNodeDecision const *)node);
+                -device_calc_lbp_decision(scan_lines, x, ((EpNodeDecision const *)node)->feature, ((EpNodeDecision const *)node)->subsets);
             node += sizeof(EpNodeDecision);
         }
     }
@@ -209,13 +213,199 @@ static int classify (
     return 0; //This point is unreachable
 }
 
-void device_detect_single_scale(void) {
+/**
+ * Classify single image position with classifier in compact encoding (@see EpCompactHeader).
+ * @param scan_lines Pointers to scan lines of current detection window.
+ * @param x Horizontal coordinate of current detection window.
+ * @param classifier_data Classifier data starting with EpCompactHeader.
+ * @return 1 for positive classification. Zero if window is rejected by the first stage, -1 if by a later one.
+ */
+static int classify_compact (
+    unsigned char const *const *const scan_lines,
+    int const x,
+    char const *const classifier_data
+) {
+    EpCompactHeader const *const header = (EpCompactHeader const *)classifier_data;
+    EpCompactStage const *stage = (EpCompactStage const *)(classifier_data + sizeof(EpCompactHeader));
+    EpCompactStage const *const stages_end = stage + header->stages_count;
+    int const *const features = (int const *)(classifier_data + header->features_offset);
+    int const (*const subsets)[8] = (int const (*)[8])(classifier_data + header->subsets_offset);
+    EpCompactDecision const *decision = (EpCompactDecision const *)(classifier_data + header->decisions_offset);
+
+    for(; stage != stages_end; ++stage) {
+        EpCompactDecision const *const decisions_end = decision + stage->decisions_count;
+        int object_score = 0;
+        for(; decision != decisions_end; ++decision)
+            object_score += decision->score &
+                -device_calc_lbp_decision(scan_lines, x, features[decision->feature_index], subsets[decision->subset_index]);
+
+        if(object_score < stage->threshold)
+            return stage == (EpCompactStage const *)(classifier_data + sizeof(EpCompactHeader)) ? 0 : -1;
+    }
+
+    return 1;
+}
+
+/**
+ * Send collected overflow detections to shared results ring.
+ * If the ring is full then core waits for host to drain the slot
+ */
+static void flush_result_block(void) {
+    EpResultBlock *const block = &((EpCoreBank1 *)BANK1)->result_block;
+
+    int const slot = atomic_increment(&get_sram_origin()->control_info.results_written, 0x7FFFFFFF);
+    int volatile *const sequence = get_sram_origin()->results_sequence + slot % MAX_RESULT_BLOCKS;
+    ++((EpCoreBank1 *)BANK1)->timer.lock_count;
+
+    if(*sequence != slot) {
+        ++((EpCoreBank1 *)BANK1)->timer.stall_count;
+        while(*sequence != slot)
+            spin_pause();
+    }
+
+    dma_transfer(get_sram_origin()->results + slot % MAX_RESULT_BLOCKS, block, sizeof(EpResultBlock), 1);
+
+    //Block is published only after it is written completely; nobody else writes the slot state until host drains it
+    *sequence = slot + 1;
+
+    block->items_count = 0;
+}
+
+/**
+ * Add detection to result block of core. Block is sent to results ring when it is full.
+ * @param task_index: index of task the detection belongs to
+ * @param position  : detection position relative to the tile (x | y << 16)
+ */
+static void add_result(int const task_index, int const position) {
+    EpResultBlock *const result_block = &((EpCoreBank1 *)BANK1)->result_block;
+    result_block->items[result_block->items_count].task_index = task_index;
+    result_block->items[result_block->items_count].position   = position;
+    if(++result_block->items_count == MAX_RESULTS_PER_BLOCK)
+        flush_result_block();
+}
+
+/**
+ * Send collected survivors to shared survivors queue (@see DEVICE_STAGE_PIPELINE).
+ * If the queue is full then core waits for back cores to free the slot
+ */
+static void flush_survivor_block(void) {
+    EpSurvivorBlock *const block = &((EpCoreBank1 *)BANK1)->survivor_block;
+
+    int const slot = atomic_increment(&get_sram_origin()->control_info.survivors_written, 0x7FFFFFFF);
+    int volatile *const sequence = get_sram_origin()->survivors_sequence + slot % MAX_SURVIVOR_BLOCKS;
+    ++((EpCoreBank1 *)BANK1)->timer.lock_count;
+
+    if(*sequence != slot) {
+        ++((EpCoreBank1 *)BANK1)->timer.stall_count;
+        while(*sequence != slot)
+            spin_pause();
+    }
+
+    dma_transfer(get_sram_origin()->survivors + slot % MAX_SURVIVOR_BLOCKS, block, sizeof(EpSurvivorBlock), 1);
+
+    //Block is published only after it is written completely
+    atomic_add(sequence, 1, 0x7FFFFFFF);
+    ++((EpCoreBank1 *)BANK1)->timer.lock_count;
+
+    block->items_count = 0;
+}
+
+/**
+ * Store detection of current task: the first MAX_DETECTIONS_PER_TILE detections are stored in task item,
+ * the rest is added to result block of core (@see add_result()).
+ * @param task_index : index of current task
+ * @param position   : detection position relative to the tile (x | y << 16)
+ * @param num_objects: number of detections stored in task item so far
+ */
+static void add_detection(int const task_index, int const position, int *const num_objects) {
+    if(*num_objects < MAX_DETECTIONS_PER_TILE) {
+        ((EpCoreBank1 *)BANK1)->task_item.objects[*num_objects] = position;
+        ++*num_objects;
+    } else
+        add_result(task_index, position);
+}
+
+/**
+ * Set pointers to scan lines of detection window
+ * @param scan_lines   : receives window_height pointers
+ * @param first_line   : pointer to the first line of window
+ * @param step         : step of lines
+ * @param window_height: detection window height
+ */
+static void set_scan_lines (
+    unsigned char const **const scan_lines,
+    unsigned char const  *const first_line,
+    int                   const step,
+    int                   const window_height
+) {
+    scan_lines[0] = first_line;
+    for(int y = 1; y < window_height; ++y)
+        scan_lines[y] = scan_lines[y - 1] + step;
+}
+
+/**
+ * Run classifier pages on batch of windows passed resident classifier stages (classifier paging).
+ *   Pages are loaded one by one into the page slot of classifier bank, and every page is run only on
+ *   the windows passed the previous ones, so one page load is shared by the whole batch.
+ *   Windows passed all pages are stored as detections. Batch is emptied.
+ * @param window_height: detection window height
+ * @param loaded_page  : index of page held in page slot (-1 if none); updated
+ * @param num_objects  : number of detections stored in task item so far; updated
+ */
+static void classify_survivors_paged (
+    int  const window_height,
+    int *const loaded_page,
+    int *const num_objects
+) {
+    EpSurvivorBlock *const batch = &((EpCoreBank1 *)BANK1)->survivor_block;
+    char *const page_slot = ((EpCoreBank3 *)BANK3)->buf_classifier + MAX_CLASSIFIER_BYTES - CLASSIFIER_PAGE_BYTES;
+    int const step  = ((EpCoreBank1 *)BANK1)->task_item.step,
+              pages = get_sram_origin()->control_info.classifier_pages;
+
+    unsigned char const *scan_lines[window_height];
+
+    for(int page = 0; page < pages && batch->items_count; ++page) {
+        if(*loaded_page != page) {
+            dma_transfer(page_slot, get_sram_origin()->buf_classifier_pages[page], CLASSIFIER_PAGE_BYTES, 1);
+            *loaded_page = page;
+        }
+
+        int passed = 0;
+        for(int i = 0; i < batch->items_count; ++i) {
+            int const position = batch->objects[i];
+            set_scan_lines(scan_lines, ((EpCoreBank1 *)BANK1)->buf_tile + (position >> 16) * step, step, window_height);
+            if( classify(scan_lines, position & 65535, page_slot) > 0 )
+                batch->objects[passed++] = position;
+        }
+        batch->items_count = passed;
+    }
+
+    for(int i = 0; i < batch->items_count; ++i)
+        add_detection(batch->task_index, batch->objects[i], num_objects);
+    batch->items_count = 0;
+}
+
+/**
+ * Scan the tile. The first MAX_DETECTIONS_PER_TILE detections are stored in task item,
+ * the rest is added to result block of core, which is not flushed at the end of tile.
+ * If classifier is paged then windows passed its resident part are collected in batches
+ * (@see classify_survivors_paged()).
+ * @param task_index    : index of task (tile) held in task_item
+ * @param send_survivors: if non-zero then core holds only the first stages of classifier (stage pipeline front core),
+ *                        and windows passed them are sent to survivors queue instead of being stored as detections
+ * @param loaded_page   : index of classifier page held in core memory (-1 if none); updated
+ */
+void device_detect_single_scale(int const task_index, int const send_survivors, int *const loaded_page) {
 	char const *const classifier_data = (char const *)((EpCoreBank3 *)BANK3)->buf_classifier;
 
     //assert (((EpNodeMeta const *)classifier_data)->id == NODE_META);
 
     int const window_width  = ((EpNodeMeta const *)classifier_data)->window_width;
     int const window_height = ((EpNodeMeta const *)classifier_data)->window_height;
+    char const *const first_node = classifier_data + sizeof(EpNodeMeta);
+    int const paged = get_sram_origin()->control_info.classifier_pages > 0;
+    //Compact classifiers are never paged or split between pipeline cores
+    int const compact = ((EpNodeMeta const *)classifier_data)->id == NODE_COMPACT;
 
 	int const process_width = ((EpCoreBank1 *)BANK1)->task_item.width + 1 - window_width;
 	int const process_height = ((EpCoreBank1 *)BANK1)->task_item.height + 1 - window_height;
@@ -225,11 +415,12 @@ void device_detect_single_scale(void) {
 
     //To do without multiplications we use this small array of pointers
     unsigned char const *scan_lines[window_height];
-	scan_lines[0] = (unsigned char const *)((EpCoreBank1 *)BANK1)->buf_tile;
-    for(int y = 1; y < window_height; ++y)
-        scan_lines[y] = scan_lines[y - 1] + image_step;
+    set_scan_lines(scan_lines, ((EpCoreBank1 *)BANK1)->buf_tile, image_step, window_height);
 
-    int num_objects = 0;
+    int num_objects = 0, passed_windows = 0;
+    EpSurvivorBlock *const survivor_block = &((EpCoreBank1 *)BANK1)->survivor_block;
+    survivor_block->task_index = task_index;
+    survivor_block->items_count = 0;
 #if 1
     for(int y = 0; y < process_height; ++y) {
 	//e_wait(E_CTIMER_1, 5000);
@@ -238,17 +429,24 @@ void device_detect_single_scale(void) {
 
         for(int x = x_start; x < process_width; x += x_step) {
 	//e_wait(E_CTIMER_1, 5000);
-            if( !classify(scan_lines, x) ) continue;
-
-			((EpCoreBank1 *)BANK1)->task_item.objects[num_objects] = x | (y << 16);
-            ++num_objects;
-            if(num_objects == MAX_DETECTIONS_PER_TILE)
-                break;
+            int const decision = compact ? classify_compact(scan_lines, x, classifier_data) : classify(scan_lines, x, first_node);
+            if(decision)
+                ++passed_windows; //Passed the first stage (@see EpLevelStats)
+            if(decision <= 0)
+                continue;
+
+            if(send_survivors || paged) {
+                survivor_block->objects[survivor_block->items_count] = x | (y << 16);
+                if(++survivor_block->items_count < MAX_SURVIVORS_PER_BLOCK)
+                    continue;
+                if(send_survivors)
+                    flush_survivor_block();
+                else
+                    classify_survivors_paged(window_height, loaded_page, &num_objects);
+            } else
+                add_detection(task_index, x | (y << 16), &num_objects);
         }
 
-        if(num_objects == MAX_DETECTIONS_PER_TILE)
-            break;
-
         for(int yt = 0; yt < window_height; ++yt)
 	{
 	    //e_wait(E_CTIMER_1, 5000);
@@ -256,119 +454,463 @@ void device_detect_single_scale(void) {
 	}
     }
 #endif
+    if(survivor_block->items_count) {
+        if(send_survivors)
+            flush_survivor_block();
+        else
+            classify_survivors_paged(window_height, loaded_page, &num_objects);
+    }
+
 	((EpCoreBank1 *)BANK1)->task_item.items_count = num_objects;
+    ((EpCoreBank1 *)BANK1)->task_item.passed_windows = passed_windows;
 }
 
 /**
- * Clone image tile to core memory
- * @param src_buf pointer to the source image in shared memory
- * @param src_step step of source image
+ * Clone image tile (or its horizontal strip) to core memory
+ * @param src_buf pointer to the shared images buffer (tile offset is taken from task item)
+ * @param src_step step of tile source data (image step, or tile step for tile-major layout)
+ * @param first_line first tile line to clone
+ * @param lines_count number of lines to clone
  */
 static void subimage_clone_to_core (
     unsigned char volatile const *const src_buf,
-    int const src_step
+    int const src_step,
+    int const first_line,
+    int const lines_count
 ) {
 	//lineTest(17);
 	EpTaskItem const *const task_item = &((EpCoreBank1 *)BANK1)->task_item;
 
 	//lineTest(2);
-    int const result_step   = task_item->step,
-              result_height = task_item->height,
-              result_area   = task_item->area;
+    int const result_step = task_item->step;
 
 	//lineTest(3);
-    unsigned char volatile const *source_pixels = src_buf + task_item->offset;
+    unsigned char volatile const *source_pixels = src_buf + task_item->offset + first_line * src_step;
 	unsigned char *result_pixels = ((EpCoreBank1 *)BANK1)->buf_tile;
 
 	//lineTest(4);
 
     if(src_step == result_step) {
-        dma_transfer(result_pixels, source_pixels, result_area, 1);
+        dma_transfer(result_pixels, source_pixels, result_step * lines_count, 1);
 	lineTest(5);
     }
-#if 1
+#ifndef TILE_FETCH_PER_LINE
+    else {
+        //Whole tile is fetched with single strided descriptor
+        dma_transfer_2d(result_pixels, source_pixels, result_step, lines_count, result_step, src_step);
+    }
+#else //TILE_FETCH_PER_LINE
     else {
-        for(int line = 0; line < result_height; ++line) {
+        for(int line = 0; line < lines_count; ++line) {
             lineTest(line+2000);
-            dma_transfer(result_pixels, source_pixels, result_step, 1/*line == result_height - 1*/);
+            dma_transfer(result_pixels, source_pixels, result_step, 1/*line == lines_count - 1*/);
             result_pixels += result_step;
             source_pixels += src_step;
 	    //e_wait(E_CTIMER_1, 5000);
 	    lineTest(line+1000);
         }
     }
-#endif
+#endif//TILE_FETCH_PER_LINE
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Pyramid scaling (@see DEVICE_PYRAMID)
+
+/**
+ * Taps of 8x8 block reduction into 7x7, 6x6 and 5x5 blocks.
+ * For every output line (column) of block: first source line (column) and weights of up to three source lines (columns).
+ * Products of line and column weights are exactly the coefficients of scale8765() on host.
+ */
+static signed char const scale_block_taps[3][7][4] = {
+    { {0, 7, 1, 0}, {1, 6, 2, 0}, {2, 5, 3, 0}, {3, 4, 4, 0}, {4, 3, 5, 0}, {5, 2, 6, 0}, {6, 1, 7, 0} },
+    { {0, 3, 1, 0}, {1, 2, 2, 0}, {2, 1, 3, 0}, {4, 3, 1, 0}, {5, 2, 2, 0}, {6, 1, 3, 0} },
+    { {0, 5, 3, 0}, {1, 2, 5, 1}, {3, 4, 4, 0}, {4, 1, 5, 2}, {6, 3, 5, 0} }
+};
+
+/**
+ * Reduce line of 8x8 blocks into blocks of size x size pixels
+ * @param src        : pointer to 8 source lines
+ * @param src_step   : step of source lines
+ * @param dst        : pointer to size resulting lines
+ * @param dst_step   : step of resulting lines
+ * @param blocks_count: number of blocks in line
+ * @param size       : size of resulting block (7, 6 or 5)
+ */
+static void scale_blocks_line (
+    unsigned char const *const src,
+    int                  const src_step,
+    unsigned char       *const dst,
+    int                  const dst_step,
+    int                  const blocks_count,
+    int                  const size
+) {
+    signed char const (*const taps)[4] = scale_block_taps[7 - size];
+    int const shift = size == 6 ? 4 : 6; //Weights of 6x6 block sum to 16, others to 64
+
+    for(int y = 0; y < size; ++y) {
+        int const taps_y = taps[y][3] ? 3 : 2;
+        for(int x = 0; x < size; ++x) {
+            int const taps_x = taps[x][3] ? 3 : 2;
+            unsigned char const *src_pixel = src + taps[y][0] * src_step + taps[x][0];
+            unsigned char       *dst_pixel = dst + y * dst_step + x;
+
+            for(int block = 0; block < blocks_count; ++block, src_pixel += 8, dst_pixel += size) {
+                int sum = 1 << (shift - 1);
+                for(int i = 0; i < taps_y; ++i)
+                    for(int j = 0; j < taps_x; ++j)
+                        sum += taps[y][i + 1] * taps[x][j + 1] * src_pixel[i * src_step + j];
+                *dst_pixel = sum >> shift;
+            }
+        }
+    }
+}
+
+/**
+ * Process TASK_SCALE_BLOCKS task: compute region of pyramid level 1, 2 or 3 from level 0.
+ *   Task origin, width and height describe the region in resulting level;
+ *   task offset and src_step describe the source region in shared images buffer.
+ */
+static void device_scale_blocks(void) {
+    EpTaskItem const *const task_item = &((EpCoreBank1 *)BANK1)->task_item;
+    EpImageProp volatile const *const dst_prop = get_sram_origin()->imgs_prop + task_item->image_index;
+
+    int const size          = 8 - task_item->image_index % 4,
+              blocks_count  = task_item->width / size,
+              src_width     = blocks_count * 8,
+              dst_width     = blocks_count * size,
+              lines_count   = MAX_TILE_BYTES / (src_width * 8 + dst_width * size); //Block lines per strip
+
+    unsigned char *const src_pixels = ((EpCoreBank1 *)BANK1)->buf_tile;
+    unsigned char *const dst_pixels = src_pixels + src_width * 8 * lines_count;
+
+    unsigned char volatile const *src = get_sram_origin()->imgs_buf + task_item->offset;
+    unsigned char volatile       *dst = get_sram_origin()->imgs_buf + dst_prop->data_offset +
+                                        (task_item->origin & 65535) + (task_item->origin >> 16) * dst_prop->step;
+
+    for(int line = 0; line < task_item->height / size; line += lines_count) {
+        int const strip_lines = line + lines_count < task_item->height / size ? lines_count : task_item->height / size - line;
+
+        dma_transfer_2d(src_pixels, src, src_width, strip_lines * 8, src_width, task_item->src_step);
+        for(int i = 0; i < strip_lines; ++i)
+            scale_blocks_line(src_pixels + i * 8 * src_width, src_width, dst_pixels + i * size * dst_width, dst_width, blocks_count, size);
+        dma_transfer_2d(dst, dst_pixels, dst_width, strip_lines * size, dst_prop->step, dst_width);
+
+        src += strip_lines * 8    * task_item->src_step;
+        dst += strip_lines * size * dst_prop->step;
+    }
+}
+
+/**
+ * Process TASK_SCALE_HALF task: compute region of pyramid level as twice smaller level four positions before.
+ *   Task origin, width and height describe the region in resulting level;
+ *   task offset and src_step describe the source region in shared images buffer.
+ */
+static void device_scale_half(void) {
+    EpTaskItem const *const task_item = &((EpCoreBank1 *)BANK1)->task_item;
+    EpImageProp volatile const *const dst_prop = get_sram_origin()->imgs_prop + task_item->image_index;
+
+    int const dst_width   = task_item->width,
+              src_width   = dst_width * 2,
+              lines_count = MAX_TILE_BYTES / (src_width * 2 + dst_width); //Resulting lines per strip
+
+    unsigned char *const src_pixels = ((EpCoreBank1 *)BANK1)->buf_tile;
+    unsigned char *const dst_pixels = src_pixels + src_width * 2 * lines_count;
+
+    unsigned char volatile const *src = get_sram_origin()->imgs_buf + task_item->offset;
+    unsigned char volatile       *dst = get_sram_origin()->imgs_buf + dst_prop->data_offset +
+                                        (task_item->origin & 65535) + (task_item->origin >> 16) * dst_prop->step;
+
+    for(int line = 0; line < task_item->height; line += lines_count) {
+        int const strip_lines = line + lines_count < task_item->height ? lines_count : task_item->height - line;
+
+        dma_transfer_2d(src_pixels, src, src_width, strip_lines * 2, src_width, task_item->src_step);
+        for(int y = 0; y < strip_lines; ++y) {
+            unsigned char const *const sls1 = src_pixels + y * 2 * src_width;
+            unsigned char const *const sls2 = sls1 + src_width;
+            unsigned char       *const slo  = dst_pixels + y * dst_width;
+
+            for(int x = 0; x < dst_width; ++x) {
+                int const x2 = x << 1;
+                slo[x] = (sls1[x2] + sls1[x2 + 1] +
+                          sls2[x2] + sls2[x2 + 1] + 2) >> 2;
+            }
+        }
+        dma_transfer_2d(dst, dst_pixels, dst_width, strip_lines, dst_prop->step, dst_width);
+
+        src += strip_lines * 2 * task_item->src_step;
+        dst += strip_lines * dst_prop->step;
+    }
 }
 
 /**
- * @return pointer to next task to take
+ * Reserve chunk of tasks to take (guided scheduling).
+ * Chunk size decreases as the task queue drains, so the shared mutex is taken
+ * rarely while many tasks remain and load stays balanced near the end.
+ * @param first_task pointer to variable receiving index of the first reserved task
+ * @return number of reserved tasks; zero if there are no more tasks
  */
-static EpTaskItem volatile *get_next_task() {
+static int get_next_tasks(int *const first_task) {
+    EpControlInfo volatile *const control_info = &get_sram_origin()->control_info;
 
-    int const task_cur = atomic_increment(&get_sram_origin()->control_info.task_to_take, get_sram_origin()->control_info.task_count);
+    int const task_count = control_info->task_count;
 
-    if(task_cur < get_sram_origin()->control_info.task_count)
-        return get_sram_origin()->tasks + task_cur;
+    //Unprotected read is enough here: value is only a hint for the chunk size
+    int chunk = (task_count - control_info->task_to_take) / (TASK_CHUNK_DIVISOR * control_info->num_cores);
+    if(chunk > MAX_TASK_CHUNK) chunk = MAX_TASK_CHUNK;
+    if(chunk < 1) chunk = 1;
 
-    return 0;
+    int const task_cur = atomic_add(&control_info->task_to_take, chunk, task_count);
+    ++((EpCoreBank1 *)BANK1)->timer.lock_count;
+
+    if(task_cur >= task_count)
+        return 0;
+
+    *first_task = task_cur;
+    return task_cur + chunk < task_count ? chunk : task_count - task_cur;
 }
 
 /**
  * Load classifier in local cores bank from shared memory
+ * @param src classifier buffer in shared memory (whole classifier, its resident part, or part for stage pipeline)
+ * @param size size of classifier in bytes (multiple of 8)
  */
-static void load_classifier() {
-	dma_transfer(((EpCoreBank3 *)BANK3)->buf_classifier, get_sram_origin()->buf_classifier, MAX_CLASSIFIER_BYTES, 0);
+static void load_classifier(char volatile const *const src, int const size) {
+	dma_transfer(((EpCoreBank3 *)BANK3)->buf_classifier, src, size, 0);
 }
 
 /**
- * Process task list on core
+ * Report finished tasks to host and other cores.
+ *   Run of tasks is also recorded in finished_runs, so host may harvest results before all tasks are finished.
+ * @param first_task index of the first finished task
+ * @param count number of tasks finished since the previous report (they follow first_task)
  */
-void device_process_tasks(void) {
-	lineTest(1);
-    load_classifier();
-	lineTest(11);
-	((EpCoreBank1 *)BANK1)->timer.value = 0;
+static void report_finished_tasks(int const first_task, int const count) {
+    int const finished = atomic_add(&get_sram_origin()->control_info.task_finished, count, get_sram_origin()->control_info.task_count);
+    ++((EpCoreBank1 *)BANK1)->timer.lock_count;
+    get_sram_origin()->finished_runs[finished] = first_task | count << 16;
+}
+
+/**
+ * Add time elapsed since start_ticks to core timer
+ * @param start_ticks value returned by start_timer()
+ */
+static void accumulate_timer(unsigned int const start_ticks) {
+    if(TIMER_VALUE_SHIFT)
+        ((EpCoreBank1 *)BANK1)->timer.value += (start_ticks - stop_timer() + (1 << (TIMER_VALUE_SHIFT - 1))) >> TIMER_VALUE_SHIFT;
+    else
+        ((EpCoreBank1 *)BANK1)->timer.value += start_ticks - stop_timer();
+}
+
+/**
+ * Write timing of finished task to shared memory. Frame identifier is written last,
+ *   so host accepts record only when it is complete.
+ * @param task_index index of task
+ * @param start, ready, loaded, processed trace clock values (@see EpTaskTrace)
+ */
+static void write_task_trace (
+    int          const task_index,
+    unsigned int const start,
+    unsigned int const ready,
+    unsigned int const loaded,
+    unsigned int const processed
+) {
+    EpTaskTrace volatile *const trace = get_sram_origin()->traces + task_index;
+    trace->core_id   = ((EpCoreBank1 *)BANK1)->timer.core_id;
+    trace->start     = start;
+    trace->ready     = ready;
+    trace->loaded    = loaded;
+    trace->processed = processed;
+    trace->stop      = get_trace_clock();
+    trace->frame_id  = ((EpCoreBank1 *)BANK1)->config.frame_id;
+}
+
+/**
+ * Run later classifier stages on the windows survived front stages (stage pipeline back core).
+ *   Blocks are taken from survivors queue until front cores finish all tasks and the queue is drained.
+ *   Only tile lines covered by windows of the block are fetched. Detections are added to result block of core.
+ */
+static void device_process_survivors(void) {
+    EpControlInfo volatile *const control_info = &get_sram_origin()->control_info;
+    EpSurvivorBlock *const block = &((EpCoreBank1 *)BANK1)->survivor_block;
+    EpTaskItem *const task_item = &((EpCoreBank1 *)BANK1)->task_item;
+
+    int const window_height = ((EpNodeMeta const *)((EpCoreBank3 *)BANK3)->buf_classifier)->window_height;
+    char const *const first_node = ((EpCoreBank3 *)BANK3)->buf_classifier + sizeof(EpNodeMeta);
+    unsigned char const *scan_lines[window_height];
+
+    while(1) {
+        int const slot = atomic_increment(&control_info->survivors_taken, 0x7FFFFFFF);
+        int volatile *const sequence = get_sram_origin()->survivors_sequence + slot % MAX_SURVIVOR_BLOCKS;
+        ++((EpCoreBank1 *)BANK1)->timer.lock_count;
+
+        //Front core reserves slot before it reports its task finished, so no more blocks
+        //  may come if all tasks are finished and the slot is not reserved
+        int finished = 0;
+        if(*sequence != slot + 1) {
+            ++((EpCoreBank1 *)BANK1)->timer.stall_count;
+            while(*sequence != slot + 1) {
+                if(control_info->task_finished == control_info->task_count && control_info->survivors_written <= slot) {
+                    finished = 1;
+                    break;
+                }
+                spin_pause();
+            }
+        }
+        if(finished)
+            break;
+
+        dma_transfer(block, get_sram_origin()->survivors + slot % MAX_SURVIVOR_BLOCKS, sizeof(EpSurvivorBlock), 1);
+
+        //Slot is free for block number slot + MAX_SURVIVOR_BLOCKS
+        atomic_add(sequence, MAX_SURVIVOR_BLOCKS - 1, 0x7FFFFFFF);
+        ++((EpCoreBank1 *)BANK1)->timer.lock_count;
+
+        dma_transfer(task_item, get_sram_origin()->tasks + block->task_index, sizeof(EpTaskItem), 1);
+
+        //Survivors are in scan order, so they cover lines [first_line, last_line + window_height)
+        int const first_line = block->objects[0] >> 16,
+                  last_line  = block->objects[block->items_count - 1] >> 16;
+        subimage_clone_to_core(get_sram_origin()->imgs_buf, task_item->src_step, first_line, last_line - first_line + window_height);
+
+        unsigned int const start_ticks = start_timer();
+
+        for(int i = 0; i < block->items_count; ++i) {
+            int const position = block->objects[i];
+            set_scan_lines(scan_lines, ((EpCoreBank1 *)BANK1)->buf_tile + ((position >> 16) - first_line) * task_item->step,
+                task_item->step, window_height);
+
+            if( classify(scan_lines, position & 65535, first_node) <= 0 ) continue;
+
+            add_result(block->task_index, position);
+        }
+
+        accumulate_timer(start_ticks);
+        ++((EpCoreBank1 *)BANK1)->timer.task_count;
+    }
+
+    atomic_increment(&control_info->back_finished, control_info->back_cores);
+    ++((EpCoreBank1 *)BANK1)->timer.lock_count;
+}
+
+/**
+ * Take tasks from task list until it is empty
+ * @param send_survivors non-zero if core is front core of stage pipeline (@see device_detect_single_scale())
+ */
+static void device_process_task_list(int const send_survivors) {
+    int loaded_page = -1;
 
     while(1) {
 //e_wait(E_CTIMER_1, 5000);
 	lineTest(12);
-        EpTaskItem volatile *const cur_task = get_next_task();
-        if(cur_task == 0)
+        int first_task;
+        int const chunk_size = get_next_tasks(&first_task);
+        if(chunk_size == 0)
             break;
+
+        int tasks_done = 0, run_first = first_task;
+        for(int task_index = first_task; task_index < first_task + chunk_size; ++task_index) {
+            EpTaskItem volatile *const cur_task = get_sram_origin()->tasks + task_index;
+            unsigned int const trace_start = get_trace_clock();
 	lineTest(13);
-		dma_transfer(&((EpCoreBank1 *)BANK1)->task_item, cur_task, sizeof(EpTaskItem), 1);
+            dma_transfer(&((EpCoreBank1 *)BANK1)->task_item, cur_task, sizeof(EpTaskItem), 1);
 	lineTest(14);
-		EpImageProp  volatile const *const cur_img_prop = get_sram_origin()->imgs_prop + ((EpCoreBank1 *)BANK1)->task_item.image_index;
-	lineTest(15);
-        unsigned char volatile const *const cur_img_buf = get_sram_origin()->imgs_buf + cur_img_prop->data_offset;
-	lineTest(16);
-        subimage_clone_to_core(cur_img_buf, cur_img_prop->step);
+
+            //Waiting for tasks of previous waves (pyramid levels this task depends on)
+            int const dependency = ((EpCoreBank1 *)BANK1)->task_item.dependency;
+            if(get_sram_origin()->control_info.task_finished < dependency) {
+                //Own finished tasks must be reported first, otherwise cores may wait for each other forever
+                if(tasks_done) {
+                    report_finished_tasks(run_first, tasks_done);
+                    tasks_done = 0;
+                }
+                run_first = task_index;
+                ++((EpCoreBank1 *)BANK1)->timer.stall_count;
+                while(get_sram_origin()->control_info.task_finished < dependency)
+                    spin_pause();
+            }
+
+            unsigned int const trace_ready = get_trace_clock();
+
+            int const kind = ((EpCoreBank1 *)BANK1)->task_item.kind;
+            if(kind == TASK_DETECT)
+                subimage_clone_to_core(get_sram_origin()->imgs_buf, ((EpCoreBank1 *)BANK1)->task_item.src_step,
+                    0, ((EpCoreBank1 *)BANK1)->task_item.height);
+            unsigned int const trace_loaded = get_trace_clock();
 
 	lineTest(7);
 
-        unsigned int const start_ticks = start_timer();
+            unsigned int const start_ticks = start_timer();
 	
 	lineTest(8);
 
-        device_detect_single_scale();
+            if(kind == TASK_SCALE_BLOCKS)
+                device_scale_blocks();
+            else if(kind == TASK_SCALE_HALF)
+                device_scale_half();
+            else
+                device_detect_single_scale(task_index, send_survivors, &loaded_page);
 	
 	lineTest(9);
-#if 1
-        if(TIMER_VALUE_SHIFT)
-			((EpCoreBank1 *)BANK1)->timer.value += (start_ticks - stop_timer() + (1 << (TIMER_VALUE_SHIFT - 1))) >> TIMER_VALUE_SHIFT;
-        else
-			((EpCoreBank1 *)BANK1)->timer.value += start_ticks - stop_timer();
-#endif
-		if (((EpCoreBank1 *)BANK1)->task_item.items_count > 0) //Sending results back
-			dma_transfer(cur_task, &((EpCoreBank1 *)BANK1)->task_item, sizeof(EpTaskItem), 0);
+            accumulate_timer(start_ticks);
+            unsigned int const trace_processed = get_trace_clock();
+            if (kind == TASK_DETECT && ((EpCoreBank1 *)BANK1)->task_item.items_count > 0) //Sending results back
+                dma_transfer(cur_task, &((EpCoreBank1 *)BANK1)->task_item, sizeof(EpTaskItem), 0);
+            else if(kind == TASK_DETECT) //Only statistics of cost model
+                cur_task->passed_windows = ((EpCoreBank1 *)BANK1)->task_item.passed_windows;
+            write_task_trace(task_index, trace_start, trace_ready, trace_loaded, trace_processed);
+
+            ++((EpCoreBank1 *)BANK1)->timer.task_count;
+            ++tasks_done;
+        }
 
-        atomic_increment(&get_sram_origin()->control_info.task_finished, get_sram_origin()->control_info.task_count);
+        //Completion is reported once per chunk
+        if(tasks_done)
+            report_finished_tasks(run_first, tasks_done);
+    }
+}
+
+/**
+ * Process task list on core.
+ * For stage pipeline (@see DEVICE_STAGE_PIPELINE) the first control_info.back_cores cores started
+ *   run later classifier stages on survivors queue instead.
+ */
+void device_process_tasks(void) {
+	lineTest(1);
+	((EpCoreBank1 *)BANK1)->timer.value = 0;
+	((EpCoreBank1 *)BANK1)->timer.lock_count = 0;
+	((EpCoreBank1 *)BANK1)->timer.task_count = 0;
+	((EpCoreBank1 *)BANK1)->timer.stall_count = 0;
+	((EpCoreBank1 *)BANK1)->timer.back_core = 0;
+	((EpCoreBank1 *)BANK1)->timer.frame_id = 0;
+	((EpCoreBank1 *)BANK1)->result_block.items_count = 0;
+	start_trace_clock();
+	((EpCoreBank1 *)BANK1)->timer.start = get_trace_clock();
+
+    int const back_cores = get_sram_origin()->control_info.back_cores;
+    if(back_cores) {
+        ((EpCoreBank1 *)BANK1)->timer.back_core =
+            atomic_increment(&get_sram_origin()->control_info.back_started, back_cores) < back_cores;
+        ++((EpCoreBank1 *)BANK1)->timer.lock_count;
+    }
+
+    if(((EpCoreBank1 *)BANK1)->timer.back_core) {
+        load_classifier(get_sram_origin()->buf_classifier_back, get_sram_origin()->control_info.classifier_back_bytes);
+        device_process_survivors();
+    } else {
+        load_classifier(get_sram_origin()->buf_classifier, get_sram_origin()->control_info.classifier_bytes);
+        device_process_task_list(back_cores);
     }
 	lineTest(20);
-    //Sending timer to shared memory
-    //ToDo: it can happen that host will read these timers before they will be written completely
+    //Detections collected over all tasks of core are sent before timer, so host drains them before it stops waiting
+    if(((EpCoreBank1 *)BANK1)->result_block.items_count)
+        flush_result_block();
 
+    //Sending timer to shared memory: frame identifier is written after DMA is finished,
+    //so host waits for it instead of reading partly written timer
     int const timer_cur = atomic_increment(&get_sram_origin()->control_info.timer_index, 4096);
+    ++((EpCoreBank1 *)BANK1)->timer.lock_count;
+    ((EpCoreBank1 *)BANK1)->timer.stop = get_trace_clock();
 	dma_transfer(get_sram_origin()->timers + timer_cur, &((EpCoreBank1 *)BANK1)->timer, sizeof(EpTimerBuf), 1);
+    ((EpTimerBuf volatile *)get_sram_origin()->timers)[timer_cur].frame_id = ((EpCoreBank1 *)BANK1)->config.frame_id;
 	lineTest(21);
 }
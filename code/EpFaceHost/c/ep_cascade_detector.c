@@ -28,6 +28,7 @@
 #include <opencv/cv.h>
 
 #include <omp.h>
+#include <pthread.h>
 
 #ifndef DEVICE_EMULATION
   //  #include <e_host.h>
@@ -39,18 +40,22 @@
 #else//DEVICE_EMULATION
     #include "ep_emulator.h"
     #define DRAM_ADR ((unsigned char*)&(dram_memory.common_memory))
+    #define BUF_OFFSET 0
 #endif//DEVICE_EMULATION
 
 #define ROWS 4
 #define COLS 4
 
 #include "ep_cascade_detector.h"
+#include "ep_trace.h"
 
 typedef struct
 {
 	e_platform_t eplat;
 	e_epiphany_t edev;
 	e_mem_t emem;
+	/// Size of images buffer in shared memory region of core group
+	int imgs_buf_size;
 } ep_context_t;
 
 
@@ -515,25 +520,32 @@ EpTaskList ep_task_list_create_empty(void) {
 /**
  * Add item to tasks list.
  * @param task_list: pointer to valid rectangles list;
- * @param area       : tile area (must be  width * step)
+ * @param offset     : offset of tile source data in shared images buffer
+ * @param origin     : position of tile in image (x | y << 16)
  * @param width      : width of tile
  * @param height     : height of tile
  * @param step       : step in tile (must be round_up_to8(width))
+ * @param src_step   : step of tile source data in shared images buffer
  * @param scan_mode  : Scan mode of pixels (even pixels, odd pixels, or all pixels)
  * @param items_count: count of detected items (must be 0)
  * @param image_index: index of processing image
+ * @param cost       : estimated processing cost of the tile
+ * Added task is detection task without dependencies (@see EpTaskItem::kind, EpTaskItem::dependency).
  * @return ERR_SUCCESS on success;
  *         ERR_MEMORY on memory allocation failure.
  */
 EpErrorCode ep_task_list_add (
     EpTaskList *const task_list,
     int offset,
+    int origin,
     int width,
     int height,
     int step,
+    int src_step,
     int scan_mode,
     int items_count,
-    int image_index
+    int image_index,
+    int cost
 ) {
     if(task_list->count == task_list->capacity) {
         int const new_capacity = task_list->capacity + MAX_DETECTIONS_PER_TILE;
@@ -547,13 +559,19 @@ EpErrorCode ep_task_list_add (
     EpTaskItem *const new_task = task_list->data + task_list->count;
 
     new_task->offset      = offset;
+    new_task->origin      = origin;
     new_task->area        = step * height;
     new_task->width       = width;
     new_task->height      = height;
     new_task->step        = step;
+    new_task->src_step    = src_step;
     new_task->scan_mode   = scan_mode;
     new_task->items_count = items_count;
     new_task->image_index = image_index;
+    new_task->cost        = cost;
+    new_task->kind        = TASK_DETECT;
+    new_task->dependency  = 0;
+    new_task->passed_windows = 0;
 
     ++task_list->count;
     return ERR_SUCCESS;
@@ -593,6 +611,132 @@ void ep_task_list_release(EpTaskList *const task_list) {
     task_list->count = 0;
 }
 
+/**
+ * Create empty per-level statistics (no previous frame).
+ */
+EpLevelStats ep_level_stats_create_empty(void) {
+    EpLevelStats result;
+    memset(&result, 0, sizeof(result));
+    return result;
+}
+
+/**
+ * Create empty frame cache (no previous frame).
+ */
+EpFrameCache ep_frame_cache_create_empty(void) {
+    EpFrameCache result;
+    memset(&result, 0, sizeof(result));
+    return result;
+}
+
+/**
+ * Release data hold by frame cache.
+ * After calling this function cache is empty and will be filled by the next frame.
+ * @param frame_cache: pointer to valid frame cache.
+ */
+void ep_frame_cache_release(EpFrameCache *const frame_cache) {
+    ep_img_list_release(&frame_cache->imgs);
+    ep_task_list_release(&frame_cache->tasks);
+    *frame_cache = ep_frame_cache_create_empty();
+}
+
+/**
+ * Create empty working set of detection (buffers are allocated by the first detection).
+ */
+EpWorkspace ep_workspace_create_empty(void) {
+    EpWorkspace result;
+    for(int i = 0; i < 4; ++i)
+        result.levels[i] = ep_image_create_empty();
+    result.imgs = ep_img_list_create_empty(0);
+    return result;
+}
+
+/**
+ * Release buffers hold by working set of detection.
+ * @param workspace: pointer to valid working set.
+ */
+void ep_workspace_release(EpWorkspace *const workspace) {
+    for(int i = 0; i < 4; ++i)
+        ep_image_release(workspace->levels + i);
+    ep_img_list_release(&workspace->imgs);
+}
+
+/**
+ * Images list of device detection: list of working set (emptied, with its buffer kept) or new list.
+ * @param workspace: working set of detection (may be NULL)
+ */
+static EpImgList get_images_list(EpWorkspace const *const workspace) {
+    EpImgList result = ep_img_list_create_empty(0);
+    if(workspace) {
+        result.data     = workspace->imgs.data;
+        result.capacity = workspace->imgs.capacity;
+    }
+    return result;
+}
+
+/**
+ * Give back images list taken by get_images_list(): working set keeps its buffer, otherwise it is released.
+ * @param workspace: working set passed to get_images_list() (may be NULL)
+ * @param img_list : images list; it is moved or released
+ */
+static void put_images_list(EpWorkspace *const workspace, EpImgList *const img_list) {
+    if(workspace)
+        workspace->imgs = *img_list;
+    else
+        ep_img_list_release(img_list);
+}
+
+/**
+ * Get images of the first pyramid octave. Without workspace source image is taken over as level 0
+ *   and scaled levels are allocated; with workspace source image is borrowed as level 0 (it is only read,
+ *   with its own step) and scaled levels are put into workspace buffers, which are reallocated only if image size changed.
+ * @param workspace: working set of detection (may be NULL)
+ * @param image    : source image; consumed if there is no workspace
+ * @param scaled   : non-zero if levels scaled by 7/8, 6/8 and 5/8 are needed (otherwise they are empty)
+ * @param levels   : receives levels scaled by 8/8, 7/8, 6/8 and 5/8; must be released only if there is no workspace
+ * @return ERR_SUCCESS; ERR_MEMORY if workspace buffers cannot be allocated
+ */
+static EpErrorCode get_octave_levels (
+    EpWorkspace *const workspace,
+    EpImage     *const image,
+    int          const scaled,
+    EpImage     *const levels
+) {
+    int const blocks_x = image->width  / 8,
+              blocks_y = image->height / 8;
+
+    if(!workspace) {
+        levels[0] = *image;
+        *image = ep_image_create_empty();
+        for(int i = 1; i < 4; ++i)
+            levels[i] = scaled ? ep_image_create(blocks_x * (8 - i), blocks_y * (8 - i)) : ep_image_create_empty();
+        return ERR_SUCCESS;
+    }
+
+    levels[0] = *image;
+
+    for(int i = 0; i < 4; ++i) {
+        EpImage *const buffer = workspace->levels + i;
+        //Buffer of level 0 receives its first 2:1 reduction
+        int const width  = i ? blocks_x * (8 - i) : image->width  / 2,
+                  height = i ? blocks_y * (8 - i) : image->height / 2;
+        if(i && !scaled) {
+            levels[i] = ep_image_create_empty();
+            continue;
+        }
+        if(buffer->width != width || buffer->height != height) {
+            ep_image_release(buffer);
+            *buffer = ep_image_create(width, height);
+            if( ep_image_is_empty(buffer) )
+                return ERR_MEMORY;
+        }
+        if(i)
+            levels[i] = *buffer;
+    }
+
+    return ERR_SUCCESS;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //                          CLASSIFIER FUNCTIONS                              //
 ////////////////////////////////////////////////////////////////////////////////
@@ -615,9 +759,57 @@ int ep_classifier_is_empty(EpCascadeClassifier const *const classifier) {
     return !classifier->data;
 }
 
+/**
+ * Check classifier in compact encoding: all tables must be inside classifier data,
+ *   and all indices must point inside their tables.
+ * @param classifier: pointer to non-empty classifier starting with EpCompactHeader.
+ * @return zero value for good classifier data; non-zero value for bad data.
+ */
+static int classifier_check_compact(EpCascadeClassifier const *const classifier) {
+    int const size = classifier->size;
+    if( size < (int)( sizeof(EpCompactHeader) + sizeof(EpCompactStage) ) )
+        return 2; //Classifier is too small
+
+    EpCompactHeader const *const header = (EpCompactHeader const *)classifier->data;
+
+    if(header->window_height < 3 || header->window_width < 3)
+        return 4; //Window size is too small
+
+    if( header->stages_count < 1 ||
+        header->features_offset < (int)( sizeof(EpCompactHeader) + header->stages_count * sizeof(EpCompactStage) ) ||
+        header->decisions_offset < header->features_offset ||
+        header->subsets_offset < header->decisions_offset ||
+        header->subsets_offset > size ||
+        ( (header->features_offset | header->decisions_offset | header->subsets_offset) & 7 ) )
+        return 8; //Wrong tables layout
+
+    int const features_count = (header->decisions_offset - header->features_offset) / sizeof(int),
+              subsets_count  = (size - header->subsets_offset) / sizeof(int[8]);
+
+    EpCompactStage const *const stages = (EpCompactStage const *)(classifier->data + sizeof(EpCompactHeader));
+    int decisions_count = 0;
+    for(int i = 0; i < header->stages_count; ++i) {
+        if(stages[i].decisions_count < 1)
+            return 5; //Every stage must have decisions
+        decisions_count += stages[i].decisions_count;
+    }
+
+    if( header->decisions_offset + decisions_count * (int)sizeof(EpCompactDecision) > header->subsets_offset )
+        return 8; //Decisions table overlaps subsets table
+
+    EpCompactDecision const *const decisions = (EpCompactDecision const *)(classifier->data + header->decisions_offset);
+    for(int i = 0; i < decisions_count; ++i)
+        if( decisions[i].feature_index < 0 || decisions[i].feature_index >= features_count ||
+            decisions[i].subset_index  < 0 || decisions[i].subset_index  >= subsets_count )
+            return 9; //Index is out of table
+
+    return 0;
+}
+
 /**
  * Check classifier data for validity. Empty classifier is considered invalid!
  * Use ep_classifier_is_empty() function to check whether classifier is empty.
+ * Classifiers in compact encoding (@see ep_classifier_compact()) are accepted.
  * @param classifier: pointer to tested classifier. classifier->data must be safely dereferencable!
  * @return zero value for good classifier data; non-zero value for bad data.
  */
@@ -625,6 +817,9 @@ int ep_classifier_check(EpCascadeClassifier const *const classifier) {
     if( ep_classifier_is_empty(classifier) )
         return 1; //Empty classifier
 
+    if( classifier->size >= (int)sizeof(int) && *(int const *)classifier->data == NODE_COMPACT )
+        return classifier_check_compact(classifier);
+
     //ToDo: implement full checking here
 
     int const size = classifier->size;
@@ -668,14 +863,129 @@ EpCascadeClassifier ep_classifier_clone(EpCascadeClassifier const *const classif
 
     int const classifier_size = classifier->size;
 
-    EpCascadeClassifier const result =
-        { (char *)malloc(classifier_size), classifier_size };
+    EpCascadeClassifier result = ep_classifier_create_empty();
+    result.data = (char *)malloc(classifier_size);
+    result.size = classifier_size;
 
     if(!result.data)
         return ep_classifier_create_empty();
 
     memcpy(result.data, classifier->data, classifier_size);
+    ep_classifier_bind(&result);
+
+    return result;
+}
+
+/**
+ * Find index of value in table; append value to table if it is not found.
+ * @param table     : table of values, each of value_size bytes.
+ * @param count     : pointer to number of values in table; updated.
+ * @param value     : value to find.
+ * @param value_size: size of value in bytes.
+ * @return index of value in table.
+ */
+static int find_or_add(void *const table, int *const count, void const *const value, int const value_size) {
+    for(int i = 0; i < *count; ++i)
+        if( !memcmp((char const *)table + i * value_size, value, value_size) )
+            return i;
+    memcpy((char *)table + *count * value_size, value, value_size);
+    return (*count)++;
+}
+
+/**
+ * Convert classifier into compact encoding (@see EpCompactHeader).
+ *   Features and subsets are stored in deduplicated tables referenced by 16-bit indices,
+ *   stage boundaries are stored as decision counts. Scores and thresholds are kept exact,
+ *   so compact classifier gives the same results as the original one (@see EpCompactDecision).
+ * @param classifier: pointer to valid classifier structure which is not compact yet.
+ * @param error_code: pointer to integer value which will receive the error code.
+ *                  If this pointer is NULL then no error code is stored.
+ *     Error codes: ERR_SUCCESS -- success;
+ *                  ERR_ARGUMENT -- invalid or already compact classifier, or classifier is too large for 16-bit indices;
+ *                  ERR_MEMORY -- cannot allocate memory buffer.
+ * @return compact classifier. Empty classifier is returned in case of any error.
+ */
+EpCascadeClassifier ep_classifier_compact(EpCascadeClassifier const *const classifier, EpErrorCode *const error_code) {
+    EpCascadeClassifier result = ep_classifier_create_empty();
+
+    if( ep_classifier_check(classifier) || *(int const *)classifier->data != NODE_META ) {
+        if(error_code) *error_code = ERR_ARGUMENT;
+        return result; //Wrong or compact classifier
+    }
+
+    //Counting nodes
+    int decisions_count = 0, stages_count = 0;
+    char const *node = classifier->data + sizeof(EpNodeMeta);
+    while(*(int const *)node != NODE_FINAL) {
+        if(*(int const *)node == NODE_DECISION) {
+            ++decisions_count;
+            node += sizeof(EpNodeDecision);
+        } else { //NODE_STAGE
+            ++stages_count;
+            node += sizeof(EpNodeStage);
+        }
+    }
+
+    if(decisions_count > 32767) {
+        if(error_code) *error_code = ERR_ARGUMENT;
+        return result; //Indices do not fit 16 bits
+    }
+
+    int *const features = (int *)malloc(decisions_count * sizeof(int));
+    int (*const subsets)[8] = (int (*)[8])malloc(decisions_count * sizeof(int[8]));
+    EpCompactDecision *const decisions = (EpCompactDecision *)malloc(decisions_count * sizeof(EpCompactDecision));
+    EpCompactStage *const stages = (EpCompactStage *)malloc(stages_count * sizeof(EpCompactStage));
 
+    if(!features || !subsets || !decisions || !stages) {
+        free(features); free(subsets); free(decisions); free(stages);
+        if(error_code) *error_code = ERR_MEMORY;
+        return result;
+    }
+
+    int features_count = 0, subsets_count = 0, decision_index = 0, stage_index = 0, stage_start = 0;
+    node = classifier->data + sizeof(EpNodeMeta);
+    while(*(int const *)node != NODE_FINAL) {
+        if(*(int const *)node == NODE_DECISION) {
+            EpNodeDecision const *const decision = (EpNodeDecision const *)node;
+            decisions[decision_index].feature_index = find_or_add(features, &features_count, &decision->feature, sizeof(int));
+            decisions[decision_index].subset_index  = find_or_add(subsets, &subsets_count, decision->subsets, sizeof(int[8]));
+            decisions[decision_index].score = decision->score;
+            ++decision_index;
+            node += sizeof(EpNodeDecision);
+        } else { //NODE_STAGE
+            stages[stage_index].threshold = ((EpNodeStage const *)node)->threshold;
+            stages[stage_index].decisions_count = decision_index - stage_start;
+            stages[stage_index].unused = 0;
+            stage_start = decision_index;
+            ++stage_index;
+            node += sizeof(EpNodeStage);
+        }
+    }
+
+    EpCompactHeader header = {NODE_COMPACT,
+        ((EpNodeMeta const *)classifier->data)->window_width,
+        ((EpNodeMeta const *)classifier->data)->window_height,
+        stages_count, 0, 0, 0, 0};
+    header.features_offset  = sizeof(EpCompactHeader) + stages_count * sizeof(EpCompactStage);
+    header.decisions_offset = header.features_offset  + round_up_to_8n(features_count * sizeof(int));
+    header.subsets_offset   = header.decisions_offset + round_up_to_8n(decisions_count * sizeof(EpCompactDecision));
+
+    result.size = header.subsets_offset + subsets_count * sizeof(int[8]);
+    result.data = (char *)calloc(result.size, 1);
+
+    if(result.data) {
+        memcpy(result.data, &header, sizeof(EpCompactHeader));
+        memcpy(result.data + sizeof(EpCompactHeader), stages, stages_count * sizeof(EpCompactStage));
+        memcpy(result.data + header.features_offset, features, features_count * sizeof(int));
+        memcpy(result.data + header.decisions_offset, decisions, decisions_count * sizeof(EpCompactDecision));
+        memcpy(result.data + header.subsets_offset, subsets, subsets_count * sizeof(int[8]));
+        ep_classifier_bind(&result);
+    } else
+        result.size = 0;
+
+    free(features); free(subsets); free(decisions); free(stages);
+
+    if(error_code) *error_code = result.data ? ERR_SUCCESS : ERR_MEMORY;
     return result;
 }
 
@@ -794,7 +1104,8 @@ EpCascadeClassifier ep_classifier_load(char const *const file_name, EpErrorCode
 
     fclose(file);
 
-    if( ep_classifier_check(&result) ) { //Wrong data read
+    ep_classifier_bind(&result);
+    if( result.binding.check ) { //Wrong data read
         if(error_code) *error_code = ERR_FILE_CONTENTS;
         ep_classifier_release(&result);
         return result;
@@ -811,8 +1122,7 @@ EpCascadeClassifier ep_classifier_load(char const *const file_name, EpErrorCode
  */
 void ep_classifier_release(EpCascadeClassifier *const classifier) {
     free(classifier->data);
-    classifier->data = NULL;
-    classifier->size = 0;
+    *classifier = ep_classifier_create_empty();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -1024,7 +1334,7 @@ static void scale8765 (
 
 /**
  * Reduce image twice.
- * Resulting image can occupy the same memory as source image. In this case they must have the same step.
+ * Resulting image can occupy the same memory as source image. In this case its step must not exceed step of source image.
  * @param src: pointer to source image;
  * @param out: pointer to resulting image. Memory for resulting image must be preallocated.
  */
@@ -1051,14 +1361,16 @@ static void scale21(EpImage const *const src, EpImage *const out) {
 }
 
 /**
- * Scale image inplace with realloc in memory;
- * @param src: pointer to source image;
+ * Reduce pyramid level twice. Resulting image gets step of its own width, so it stays contiguous.
+ *   Level borrowed from caller (@see EpWorkspace) is reduced into buffer, otherwise it is reduced in place
+ *   (scanlines are processed top-down, so output never overwrites source pixels which are not read yet).
+ * @param image : pointer to level; its memory is kept unless it is borrowed;
+ * @param buffer: memory for reduced borrowed level (NULL if level is owned by detection).
  */
-static void scale21_realloc(EpImage *const src){
-    EpImage temp = ep_image_create(src->width / 2, src->height / 2);
-    scale21(src, &temp);
-    ep_image_release(src);
-    *src = temp;
+static void scale21_level(EpImage *const image, unsigned char *const buffer) {
+    EpImage out = { buffer ? buffer : image->data, 0, 0, round_up_to_8n(image->width / 2) };
+    scale21(image, &out);
+    *image = out;
 }
 
 /**
@@ -1066,16 +1378,16 @@ static void scale21_realloc(EpImage *const src){
  *
  * @param image_data: Position in memory where to sample feature from.
  * @param image_step: Step in bytes from one image line to the next image line.
- * @param node: Classifier node used to make decision.
+ * @param feature: Feature description (@see EpNodeDecision).
+ * @param subsets: Subsets of feature values which give score (@see EpNodeDecision).
  * @return decision value: 0 or 1.
  */
 static int calc_lbp_decision (
     unsigned char const *image_data,
     int const image_step,
-    EpNodeDecision const *const node
+    int const feature,
+    int const *const subsets
 ) {
-    int const feature = node->feature;
-
     //Shifting position according to LBP feature position
     image_data += ( (feature >> 16) & 255 ) + (feature >> 24) * image_step;
 
@@ -1196,7 +1508,7 @@ static int calc_lbp_decision (
         ( ( ( (unsigned int)~(sum20 - sum11) ) & sign ) >> 30 ) |
         (   ( (unsigned int)~(sum10 - sum11) )          >> 31 ) ;
 
-    return (node->subsets[subset_index] >> bit_index) & 1;
+    return (subsets[subset_index] >> bit_index) & 1;
 }
 
 /**
@@ -1222,13 +1534,13 @@ static int classify (
 ) {
     //First node is always NODE_DECISION
     int object_score = ((EpNodeDecision const *)node)->score &
-        -calc_lbp_decision(image_data, image_step, (EpNodeDecision const *)node);
+        -calc_lbp_decision(image_data, image_step, ((EpNodeDecision const *)node)->feature, ((EpNodeDecision const *)node)->subsets);
     node += sizeof(EpNodeDecision);
 
     while(1) {
         if(!*node) { //NODE_DECISION
             object_score += ((EpNodeDecision const *)node)->score &
-                -calc_lbp_decision(image_data, image_step, (EpNodeDecision const *)node);
+                -calc_lbp_decision(image_data, image_step, ((EpNodeDecision const *)node)->feature, ((EpNodeDecision const *)node)->subsets);
             node += sizeof(EpNodeDecision);
         } else { //NODE_STAGE
             if(object_score < ((EpNodeStage *)node)->threshold)
@@ -1240,7 +1552,7 @@ static int classify (
 
             //NODE_DECISION
             object_score = ((EpNodeDecision const *)node)->score &
-                -calc_lbp_decision(image_data, image_step, (EpNodeDecision const *)node);
+                -calc_lbp_decision(image_data, image_step, ((EpNodeDecision const *)node)->feature, ((EpNodeDecision const *)node)->subsets);
             node += sizeof(EpNodeDecision);
         }
     }
@@ -1249,7 +1561,40 @@ static int classify (
 }
 
 /**
- * Perform single-scale object detection
+ * Classify single image position with classifier in compact encoding (@see EpCompactHeader).
+ * @param classifier_data: classifier data starting with EpCompactHeader;
+ * @param image_data: position in memory where to sample image data
+ * @param image_step: step from current image line to the next image line
+ * @return Non-zero for positive classification, zero otherwise.
+ */
+static int classify_compact (
+    char const *const classifier_data,
+    unsigned char const *const image_data,
+    int const image_step
+) {
+    EpCompactHeader const *const header = (EpCompactHeader const *)classifier_data;
+    EpCompactStage const *stage = (EpCompactStage const *)(classifier_data + sizeof(EpCompactHeader));
+    EpCompactStage const *const stages_end = stage + header->stages_count;
+    int const *const features = (int const *)(classifier_data + header->features_offset);
+    int const (*const subsets)[8] = (int const (*)[8])(classifier_data + header->subsets_offset);
+    EpCompactDecision const *decision = (EpCompactDecision const *)(classifier_data + header->decisions_offset);
+
+    for(; stage != stages_end; ++stage) {
+        EpCompactDecision const *const decisions_end = decision + stage->decisions_count;
+        int object_score = 0;
+        for(; decision != decisions_end; ++decision)
+            object_score += decision->score &
+                -calc_lbp_decision(image_data, image_step, features[decision->feature_index], subsets[decision->subset_index]);
+
+        if(object_score < stage->threshold)
+            return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * Perform object detection in band of rows of single scale
  * @param image: Image to scan.
  * @param classifier: Classifier to use.
  * @param objects: Detections will be added to this list.
@@ -1257,22 +1602,20 @@ static int classify (
  * @param offset_x: X coordinate of resulting rectangles will be offset by this values.
  * @param offset_y: Y coordinate of resulting rectangles will be offset by this values.
  * @param scan_mode: which pixels should be tested. @see EpScanMode
+ * @param y_begin: first row of window positions to test.
+ * @param y_end: row after the last row of window positions to test (limited by image height).
  */
-static void detect_single_scale_host (
+static void detect_band_host (
     EpImage             const *const image,
     EpCascadeClassifier const *      classifier,
     EpRectList                *const objects,
     float                      const scale,
     int                        const offset_x,
     int                        const offset_y,
-    EpScanMode                 const scan_mode
+    EpScanMode                 const scan_mode,
+    int                        const y_begin,
+    int                        const y_end
 ) {
-    /*{
-        cv::Mat const cv_image(image->height, image->width, CV_8UC1, image->data, image->step);
-        cv::imshow("Debug", cv_image);
-        cv::waitKey(0);
-    }*/
-
     char const *node = classifier->data;
 
     int const window_width  = ((EpNodeMeta const *)node)->window_width,
@@ -1287,21 +1630,22 @@ static void detect_single_scale_host (
     node += sizeof(EpNodeMeta); //Skipping initial META node
 
     int const image_step = image->step;
+    int const compact = *(int const *)classifier->data == NODE_COMPACT;
 
     //OpenCV has this hack:
     //int step = scale > 2.0f ? 1 : 2;
     //We do not like it. Instead we use checkerboard scanning pattern.
     //Required calculations are almost doubled, but detection of small objects is better, and all pyramid levels are equal
 
-    #pragma omp parallel for schedule(dynamic)
-    for(int y = 0; y < process_height; ++y) {
+    for(int y = y_begin; y < y_end && y < process_height; ++y) {
         unsigned char const *const scan_line = image->data + y * image_step;
 
         int const x_start = scan_mode == SCAN_FULL ? 0 : (y + scan_mode) & 1;
         int const x_step = scan_mode == SCAN_FULL ? 1 : 2;
 
         for(int x = x_start; x < process_width; x += x_step) {
-			if (classify(node, scan_line + x, image_step)) {
+            if( compact ? classify_compact(classifier->data, scan_line + x, image_step)
+                        : classify(node, scan_line + x, image_step) ) {
                 #pragma omp critical(add_face)
                 ep_rect_list_add (
                     objects,
@@ -1315,6 +1659,39 @@ static void detect_single_scale_host (
     }
 }
 
+/**
+ * Perform single-scale object detection
+ * @param image: Image to scan.
+ * @param classifier: Classifier to use.
+ * @param objects: Detections will be added to this list.
+ * @param scale: Size and coordinates of resulting rectangles will be multiplied by this factor.
+ * @param offset_x: X coordinate of resulting rectangles will be offset by this values.
+ * @param offset_y: Y coordinate of resulting rectangles will be offset by this values.
+ * @param scan_mode: which pixels should be tested. @see EpScanMode
+ */
+static void detect_single_scale_host (
+    EpImage             const *const image,
+    EpCascadeClassifier const *      classifier,
+    EpRectList                *const objects,
+    float                      const scale,
+    int                        const offset_x,
+    int                        const offset_y,
+    EpScanMode                 const scan_mode
+) {
+    /*{
+        cv::Mat const cv_image(image->height, image->width, CV_8UC1, image->data, image->step);
+        cv::imshow("Debug", cv_image);
+        cv::waitKey(0);
+    }*/
+
+    int const window_height = ((EpNodeMeta const *)classifier->data)->window_height;
+    int const process_height = image->height + 1 - window_height;
+
+    #pragma omp parallel for schedule(dynamic)
+    for(int y = 0; y < process_height; ++y)
+        detect_band_host(image, classifier, objects, scale, offset_x, offset_y, scan_mode, y, y + 1);
+}
+
 /**
  * Returns sequence
  * 8.0/8, 8.0/7, 8.0/6, 8.0/5, 16.0/8, 16.0/7, 16.0/6, 16.0/5, 32.0/8, 32.0/7, 32.0/6, 32.0/5, ...
@@ -1327,244 +1704,1467 @@ static float convert_image_index_to_scale(int const image_index)
 }
 
 /**
- * Process detection results.
+ * Find pyramid levels with scale in given range (scale grows with level index, @see convert_image_index_to_scale).
+ * @param scale_range: range of scales; NULL for all levels;
+ * @param first      : receives index of the first level in range;
+ * @param end        : receives index of the level after the last one in range.
+ * @return non-zero if range is invalid.
+ */
+static int get_levels_in_range(EpScaleRange const *const scale_range, int *const first, int *const end) {
+    int const max_levels = 4 * 24; //Pyramid of image smaller than 2^24 pixels has fewer levels
+
+    *first = 0;
+    *end   = max_levels;
+    if(!scale_range)
+        return 0;
+    if( !(scale_range->min_scale <= scale_range->max_scale) )
+        return 1; //Empty range or NaN
+
+    while(*first < max_levels && convert_image_index_to_scale(*first) < scale_range->min_scale)
+        ++*first;
+    *end = *first;
+    while(*end < max_levels && convert_image_index_to_scale(*end) <= scale_range->max_scale)
+        ++*end;
+    return 0;
+}
+
+/**
+ * Convert detections of single tile into source image coordinates.
  * @param objects          : Processed detections will be added here;
- * @param tasks            : Pointer to list of tasks (tiles) to process
- * @param images_properties: Pointer to list of images (pyramid scales) properties
+ * @param task             : Task (tile) the detections belong to;
+ * @param packed_objects   : Detections packed as x | (y << 16) relative to the tile;
+ * @param objects_count    : Number of detections;
+ * @param window_width     : Width of classifier window;
+ * @param window_height    : Height of classifier window;
+ * @param source           : Source of pyramid level the task belongs to.
+ */
+static void add_tile_objects (
+    EpRectList          *const objects,
+    EpTaskItem    const *const task,
+    int           const *const packed_objects,
+    int                  const objects_count,
+    int                  const window_width,
+    int                  const window_height,
+    EpLevelSource const *const source
+) {
+    int const tile_x = task->origin & 65535;
+    int const tile_y = task->origin >> 16;
+    int const offset_x = source->offset_x;
+    int const offset_y = source->offset_y;
+
+    float const scale = convert_image_index_to_scale(source->level);
+    float const object_width  = window_width  * scale;
+    float const object_height = window_height * scale;
+
+    for(int j = 0; j < objects_count; ++j) {
+        int const object_pos_packed = packed_objects[j];
+        int const object_rel_x = object_pos_packed & 65535;
+        int const object_rel_y = object_pos_packed >> 16;
+
+        float const object_abs_x = (tile_x + object_rel_x) * scale + offset_x;
+        float const object_abs_y = (tile_y + object_rel_y) * scale + offset_y;
+        ep_rect_list_add(objects, object_abs_x, object_abs_y, object_width, object_height);
+    }
+}
+
+/**
+ * Process detection results.
+ * @param objects          : Processed detections will be added here (list per image of batch);
+ * @param tasks            : Pointer to list of tasks (tiles)
+ * @param first_task       : Index of the first task to process;
+ * @param tasks_end        : Index of the task after the last one to process;
+ * @param result_blocks    : Detections which did not fit into task items (drained from results ring);
+ * @param result_blocks_count: Number of result blocks;
  * @param window_width     : Width of classifier window (it is supposed that classifier used by core is known);
  * @param window_height    : Height of classifier window (it is supposed that classifier used by core is known);
- * @param offset_x         : Offset of x after scaling
- * @param offset_y         : Offset of y after scaling
+ * @param sources          : Sources of pyramid levels (@see EpLevelSource).
  * @return total number of detections processed.
  */
 static int process_results (
-    EpRectList       *const objects,
-    EpTaskList const *const tasks,
-    EpImgList  const *const images_properties,
-    int               const window_width,
-    int               const window_height,
-    int               const offset_x,
-    int               const offset_y
+    EpRectList          *const objects,
+    EpTaskList    const *const tasks,
+    int                  const first_task,
+    int                  const tasks_end,
+    EpResultBlock const *const result_blocks,
+    int                  const result_blocks_count,
+    int                  const window_width,
+    int                  const window_height,
+    EpLevelSource const *const sources
 ) {
     int total_objects_count = 0;
 
-    for(int i = 0; i < tasks->count; ++i) {
+    for(int i = first_task; i < tasks_end; ++i) {
         EpTaskItem const *const task = tasks->data + i;
 
-        int const image_index   = task->image_index;
-        int const objects_count = task->items_count;
-        int const tile_offset   = task->offset;
+        assert(task->items_count <= MAX_DETECTIONS_PER_TILE);
+
+        EpLevelSource const *const source = sources + task->image_index;
+        add_tile_objects (
+            objects + source->image, task, task->objects, task->items_count,
+            window_width, window_height, source
+        );
+
+        total_objects_count += task->items_count;
+    }
 
-        int const image_step = images_properties->data[image_index].step;
-        int const tile_x = tile_offset % image_step;
-        int const tile_y = tile_offset / image_step;
+    for(int i = 0; i < result_blocks_count; ++i) {
+        EpResultBlock const *const block = result_blocks + i;
 
-        float const scale = convert_image_index_to_scale(image_index);
-        float const object_width  = window_width  * scale;
-        float const object_height = window_height * scale;
+        assert(block->items_count <= MAX_RESULTS_PER_BLOCK);
 
-        assert(objects_count <= MAX_DETECTIONS_PER_TILE);
+        //Block holds detections of any tasks of the core, not only of harvested ones
+        for(int j = 0; j < block->items_count; ++j) {
+            EpResultItem const *const item = block->items + j;
 
-        for(int j = 0; j < objects_count; ++j) {
-            int const object_pos_packed = task->objects[j];
-            int const object_rel_x = object_pos_packed & 65535;
-            int const object_rel_y = object_pos_packed >> 16;
+            assert(item->task_index < tasks->count);
 
-            float const object_abs_x = (tile_x + object_rel_x) * scale + offset_x;
-            float const object_abs_y = (tile_y + object_rel_y) * scale + offset_y;
-            ep_rect_list_add(objects, object_abs_x, object_abs_y, object_width, object_height);
+            EpTaskItem const *const task = tasks->data + item->task_index;
+            EpLevelSource const *const source = sources + task->image_index;
+            add_tile_objects (
+                objects + source->image, task, &item->position, 1,
+                window_width, window_height, source
+            );
         }
 
-        total_objects_count += objects_count;
+        total_objects_count += block->items_count;
     }
 
     return total_objects_count;
 }
 
-
 /**
- * Parse task on core times and output times in log_file
- * @param log_file  : name of result file
- * @param scale_time: time of images scaling
- * @param wait_time : time of host wait of detection
- * @param num_cores : count of working cores
- * @param timers    : array of cores timers
+ * Count windows tested by classifier in the tile
+ * @param width        : tile width;
+ * @param height       : tile height;
+ * @param window_width : detection window width;
+ * @param window_height: detection window height;
+ * @param scan_mode    : which pixels are tested (@see EpScanMode).
  */
-static void time_log(
-        char       const * const log_file,
-        double     const         scale_time,
-        double     const         wait_time,
-        int        const         num_cores,
-        EpTimerBuf const * const timers
+static int count_scanned_windows (
+    int const width,
+    int const height,
+    int const window_width,
+    int const window_height,
+    int const scan_mode
 ) {
-    FILE *f = fopen(log_file, "wt");
-    fprintf(f, "------- Timers result in seconds ------\r\n\r\n");
-    fprintf(f, "Scale time:               %lf\r\n", scale_time / 1000000);
-    fprintf(f, "Host detection wait time: %lf\r\n", wait_time / 1000000);
-    fprintf(f, "\r\nWork times per cores\r\n");
-    fprintf(f, "=============================================\r\n");
+    int const windows = (width + 1 - window_width) * (height + 1 - window_height);
+    return scan_mode == SCAN_FULL ? windows : (windows + 1) / 2;
+}
 
-    const double core_timer_freq = 1000000.0 * CORE_FREQUENCY;
-    double total_cores_time = 0;
-    for (int i = 0; i < num_cores; ++i) {
-        double cur_time = timers[i].value / core_timer_freq * (1 << TIMER_VALUE_SHIFT);
-        fprintf(f, "\t Core #%d:\t%lf\r\n", timers[i].core_id, cur_time);
-        total_cores_time += cur_time;
+/**
+ * Estimate how much more expensive window passing the whole cascade is
+ *   compared to window rejected at the first stage.
+ * @param classifier: pointer to valid classifier structure.
+ * @return ratio between total number of decision nodes and number of decision nodes in the first stage.
+ */
+static float classifier_depth_ratio(EpCascadeClassifier const *const classifier) {
+    if(*(int const *)classifier->data == NODE_COMPACT) {
+        EpCompactHeader const *const header = (EpCompactHeader const *)classifier->data;
+        EpCompactStage const *const stages = (EpCompactStage const *)(classifier->data + sizeof(EpCompactHeader));
+        int total_decisions = 0;
+        for(int i = 0; i < header->stages_count; ++i)
+            total_decisions += stages[i].decisions_count;
+        return (float)total_decisions / stages[0].decisions_count;
     }
 
-    fprintf(f, "=============================================\r\n");
-    fprintf(f, "Average cores time: %lf\r\n", total_cores_time / num_cores);
-    fprintf(f, "Total cores time: %lf\r\n", total_cores_time);
+    char const *node = classifier->data + sizeof(EpNodeMeta);
+    int first_stage_nodes = 0, total_nodes = 0;
 
-    fclose(f);
+    while(*(int const *)node != NODE_FINAL) {
+        if(*(int const *)node == NODE_DECISION) {
+            ++total_nodes;
+            node += sizeof(EpNodeDecision);
+        } else { //NODE_STAGE
+            if(!first_stage_nodes)
+                first_stage_nodes = total_nodes;
+            node += sizeof(EpNodeStage);
+        }
+    }
+
+    return first_stage_nodes ? (float)total_nodes / first_stage_nodes : 1.0f;
 }
 
 /**
- * Add in task list tasks from image.
- *
- * @param scan_mode    : which pixels to test (@see EpScanMode);
- * @param img_list     : list of images properties;
- * @param img_index    : index of current image;
- * @param window_width : detection window width;
- * @param window_height: detection window height;
- * @param task_buf     : task list;
+ * Find where classifier is split between front and back cores of stage pipeline (@see DEVICE_STAGE_PIPELINE).
+ *   Front part gets PIPELINE_FRONT_STAGES stages, or more if the rest does not fit core memory;
+ *   back part gets at least one stage. Every part is stored as valid classifier:
+ *   front part is terminated with NODE_FINAL, back part starts with copy of NODE_META.
+ * @param classifier: pointer to valid classifier structure.
+ * @return offset of the first node of back part; -1 if classifier cannot be split into parts fitting core memory.
  */
+static int find_pipeline_split(EpCascadeClassifier const *const classifier) {
+    char const *node = classifier->data + sizeof(EpNodeMeta);
+    int stages = 0;
 
-static void add_tasks_for_image(
-        EpScanMode   const scan_mode,
-        EpImgList  * const img_list,
-        int          const img_index,
-        int          const window_width,
-        int          const window_height,
-        EpTaskList * const task_buf
-) {
-    int tiles_ver;
-    int tiles_hor;
-    EpImageProp* img_prop = img_list->data + img_index;
-
-    int const overlap_width = window_width  - 1,
-             overlap_height = window_height - 1;
+    while(*(int const *)node != NODE_FINAL) {
+        if(*(int const *)node == NODE_DECISION) {
+            node += sizeof(EpNodeDecision);
+            continue;
+        }
+        node += sizeof(EpNodeStage);
+        ++stages;
 
-    //Corrected image width and height convenient for calculations
-    int image_width  = img_prop->width  - overlap_width ,
-        image_height = img_prop->height - overlap_height;
+        int const split = node - classifier->data;
+        if(*(int const *)node == NODE_FINAL || split + (int)sizeof(EpNodeFinal) > MAX_CLASSIFIER_BYTES)
+            break; //Back part would be empty, or front part does not fit
 
-    //Ideally we have following equalities:
-    // tile_width  * tiles_hor + overlap_width  * (tiles_hor - 1) == image_width
-    // tile_height * tiles_ver + overlap_height * (tiles_ver - 1) == image_height
-    //But it may happen that image will not be dividible by the tile size.
-    //In this case we need to produce tiles slightly different in sizes to
-    //  cover the whole image
+        if(stages >= PIPELINE_FRONT_STAGES && (int)sizeof(EpNodeMeta) + classifier->size - split <= MAX_CLASSIFIER_BYTES)
+            return split;
+    }
 
-    if(image_height < image_width) {
-        tiles_ver = divide_round(image_height, RECOMMENDED_TILE_SIZE - overlap_height);
-        if(!tiles_ver) tiles_ver = 1;
+    return -1;
+}
 
-        //Tiles will have heights max_tile_height and, sometimes, max_tile_height - 1
-        int const max_tile_height = divide_up(image_height + overlap_height * tiles_ver, tiles_ver);
+/**
+ * Split classifier which does not fit core memory into resident part and pages loaded on demand
+ *   (@see CLASSIFIER_PAGE_BYTES). Resident part gets as many stages as fit the rest of core memory,
+ *   every page -- as many stages as fit the page slot. Every part is terminated with NODE_FINAL.
+ * @param classifier: pointer to valid classifier structure.
+ * @param splits    : receives offsets of the first node of every page;
+ *                    splits[pages] is offset of the final node of classifier.
+ * @return number of pages; -1 if some stage does not fit page, or classifier needs more than MAX_CLASSIFIER_PAGES pages.
+ */
+static int find_classifier_pages(EpCascadeClassifier const *const classifier, int *const splits) {
+    int const final_offset = classifier->size - sizeof(EpNodeFinal);
+    int part_start = 0, part_limit = MAX_CLASSIFIER_BYTES - CLASSIFIER_PAGE_BYTES;
+    int pages = -1, stage_end = 0; //Resident part is page -1
 
-        //Maximal allowed tile step to not exceed max_tile_area
-        int const max_tile_step = round_down_to_8n( round_down_to_8n(MAX_TILE_BYTES / max_tile_height) - overlap_width) + overlap_width;
+    char const *node = classifier->data + sizeof(EpNodeMeta);
+    while(1) {
+        if(*(int const *)node == NODE_DECISION) {
+            node += sizeof(EpNodeDecision);
+            continue;
+        }
 
-        tiles_hor = divide_up(image_width, max_tile_step - overlap_width);
-    } else {
-        tiles_hor = divide_round(image_width, RECOMMENDED_TILE_SIZE - overlap_width);
-        if(!tiles_hor) tiles_hor = 1;
+        //End of stage: stage goes to current part, or starts the next page
+        int const end = node + sizeof(EpNodeStage) - classifier->data;
+        if(end - part_start + (int)sizeof(EpNodeFinal) > part_limit) {
+            if(stage_end == part_start || pages + 1 == MAX_CLASSIFIER_PAGES)
+                return -1; //Single stage does not fit, or too many pages
+            splits[++pages] = part_start = stage_end;
+            part_limit = CLASSIFIER_PAGE_BYTES;
+            continue; //Same stage is checked against the new page
+        }
+        stage_end = end;
 
-        //Tiles will have widths max_tile_step and, sometimes, max_tile_step - 8
-        int const max_tile_step = round_up_to_8n(round_up_to_8n(divide_up(image_width + overlap_width * tiles_hor, tiles_hor) - overlap_width) + overlap_width);
+        if(end == final_offset)
+            break;
+        node += sizeof(EpNodeStage);
+    }
 
-        //Maximal allowed tile height to not exceed max_tile_area
-        int const tile_height = MAX_TILE_BYTES / max_tile_step;
+    splits[pages + 1] = final_offset;
+    return pages + 1;
+}
 
-        tiles_ver = divide_up(image_height, tile_height - overlap_height);
+/**
+ * Compute data derived from classifier (@see EpClassifierBinding).
+ * @param classifier: pointer to classifier structure; its binding is updated.
+ */
+void ep_classifier_bind(EpCascadeClassifier *const classifier) {
+    EpClassifierBinding *const binding = &classifier->binding;
+    memset(binding, 0, sizeof(EpClassifierBinding));
+
+    binding->check = ep_classifier_check(classifier);
+    if(!binding->check) {
+        binding->compact = *(int const *)classifier->data == NODE_COMPACT;
+        binding->depth_ratio = classifier_depth_ratio(classifier);
+        //Compact classifiers are neither split nor paged
+        binding->pipeline_split = binding->compact ? -1 : find_pipeline_split(classifier);
+        if(classifier->size > MAX_CLASSIFIER_BYTES)
+            binding->pages = binding->compact ? -1 : find_classifier_pages(classifier, binding->page_splits);
     }
-    const int num_tiles = tiles_hor * tiles_ver;
 
-    for(int tile_index = 0; tile_index < num_tiles; ++tile_index) {
-            int const tile_y = tile_index / tiles_hor,
-                      tile_y1 = divide_round(image_height *  tile_y     , tiles_ver),
-                      tile_y2 = divide_round(image_height * (tile_y + 1), tiles_ver) + overlap_height;
+    binding->data = classifier->data;
+    binding->size = classifier->size;
+}
+
+/**
+ * Get classifier with data derived from it: classifier itself if its binding is computed for current data,
+ *   otherwise its copy bound now (for classifier filled without ep_classifier_bind()).
+ * @param classifier: pointer to classifier structure.
+ * @param local     : receives bound copy sharing data with classifier if classifier has no valid binding.
+ * @return pointer to bound classifier.
+ */
+static EpCascadeClassifier const *get_bound_classifier (
+    EpCascadeClassifier const *const classifier,
+    EpCascadeClassifier       *const local
+) {
+    if(classifier->data && classifier->binding.data == classifier->data && classifier->binding.size == classifier->size)
+        return classifier;
+
+    local->data = classifier->data;
+    local->size = classifier->size;
+    ep_classifier_bind(local);
+    return local;
+}
+
+/**
+ * Comparison function for qsort: tasks with larger cost go first.
+ *   Tasks of earlier waves (held in dependency field until resolve_task_waves() is called) precede the others.
+ *   Ties are resolved by pyramid order to keep task list deterministic.
+ */
+static int compare_tasks_by_cost(void const *const a, void const *const b) {
+    EpTaskItem const *const task_a = (EpTaskItem const *)a,
+                     *const task_b = (EpTaskItem const *)b;
+
+    if(task_a->dependency != task_b->dependency)
+        return task_a->dependency < task_b->dependency ? -1 : 1;
+
+    if(task_a->cost != task_b->cost)
+        return task_a->cost < task_b->cost ? 1 : -1;
+    if(task_a->image_index != task_b->image_index)
+        return task_a->image_index < task_b->image_index ? -1 : 1;
+    if(task_a->kind != task_b->kind)
+        return task_a->kind < task_b->kind ? -1 : 1;
+    return task_a->origin < task_b->origin ? -1 : task_a->origin > task_b->origin;
+}
+
+/**
+ * Replace wave indices held in dependency field of tasks sorted by compare_tasks_by_cost()
+ *   with number of tasks which must be finished before task may start: all tasks of previous waves.
+ * @param tasks: list of tasks sorted by waves.
+ */
+static void resolve_task_waves(EpTaskList *const tasks) {
+    int wave = 0, wave_start = 0;
+    for(int i = 0; i < tasks->count; ++i) {
+        EpTaskItem *const task = tasks->data + i;
+        if(task->dependency != wave) {
+            wave = task->dependency;
+            wave_start = i;
+        }
+        task->dependency = wave_start;
+    }
+}
+
+/**
+ * Simulate guided task distribution among cores (@see get_next_tasks() in device_routines.h)
+ *   using estimated task costs.
+ * @param tasks    : list of tasks in upload order;
+ * @param num_cores: count of working cores.
+ * @return gap between the earliest and the latest finishing core as a fraction of total run time.
+ */
+static double estimate_finish_gap(EpTaskList const *const tasks, int const num_cores) {
+    double finish[MAX_CORES_NUM] = {0.0};
+
+    int task_index = 0;
+    while(task_index < tasks->count) {
+        int core = 0; //The core which becomes free first takes the next chunk
+        for(int i = 1; i < num_cores; ++i)
+            if(finish[i] < finish[core])
+                core = i;
+
+        int chunk = (tasks->count - task_index) / (TASK_CHUNK_DIVISOR * num_cores);
+        if(chunk > MAX_TASK_CHUNK) chunk = MAX_TASK_CHUNK;
+        if(chunk < 1) chunk = 1;
+
+        for(; chunk > 0 && task_index < tasks->count; --chunk)
+            finish[core] += tasks->data[task_index++].cost;
+    }
+
+    double min_finish = finish[0], max_finish = finish[0];
+    for(int i = 1; i < num_cores; ++i) {
+        if(finish[i] < min_finish) min_finish = finish[i];
+        if(finish[i] > max_finish) max_finish = finish[i];
+    }
+
+    return max_finish > 0.0 ? (max_finish - min_finish) / max_finish : 0.0;
+}
+
+/**
+ * Collect per-level statistics for cost model of the next frame.
+ * @param level_stats  : statistics to update;
+ * @param tasks        : processed tasks (with counts of windows passed the first stage);
+ * @param levels_count : number of pyramid levels;
+ * @param window_width : detection window width;
+ * @param window_height: detection window height.
+ */
+static void update_level_stats (
+    EpLevelStats        *const level_stats,
+    EpTaskList    const *const tasks,
+    int                  const levels_count,
+    int                  const window_width,
+    int                  const window_height
+) {
+    double windows[MAX_IMGS_COUNT] = {0.0}, passed[MAX_IMGS_COUNT] = {0.0};
+
+    for(int i = 0; i < tasks->count; ++i) {
+        EpTaskItem const *const task = tasks->data + i;
+        if(task->kind != TASK_DETECT || task->image_index >= MAX_IMGS_COUNT)
+            continue;
+        windows[task->image_index] += count_scanned_windows(task->width, task->height, window_width, window_height, task->scan_mode);
+        passed[task->image_index] += task->passed_windows;
+    }
+
+    level_stats->count = levels_count < MAX_IMGS_COUNT ? levels_count : MAX_IMGS_COUNT;
+    for(int i = 0; i < level_stats->count; ++i)
+        level_stats->survival[i] = windows[i] > 0.0 ? (float)(passed[i] / windows[i]) : 0.0f;
+}
+
+/**
+ * @return short name of task kind (@see EpTaskKind)
+ */
+static char const *get_task_kind_name(int const kind) {
+    static char const *const names[] = {"detect", "scale", "half"};
+    return kind >= TASK_DETECT && kind <= TASK_SCALE_HALF ? names[kind] : "?";
+}
+
+/**
+ * Add spans of tasks processed by cores to trace timeline (@see ep_trace_span). Back cores of stage pipeline
+ *   process survivor blocks instead of tasks, so they get one span from their timers.
+ * @param tasks      : task list
+ * @param traces     : traces of tasks downloaded after detection
+ * @param timers     : timers of cores
+ * @param num_cores  : number of cores
+ * @param frame_id   : identifier of current frame; records with another identifier are skipped
+ * @param cores_start: trace time when cores were started; trace clocks of cores are counted from it
+ */
+static void trace_device_tasks(
+        EpTaskList  const *const tasks,
+        EpTaskTrace const *const traces,
+        EpTimerBuf  const *const timers,
+        int                const num_cores,
+        int                const frame_id,
+        double             const cores_start
+) {
+    unsigned int named_cores[MAX_CORES_NUM];
+    int named_count = 0;
+    for(int i = 0; i < num_cores; ++i) {
+        EpTimerBuf const *const timer = timers + i;
+        if(!timer->back_core || timer->frame_id != frame_id)
+            continue;
+
+        char name[32];
+        sprintf(name, "back core 0x%03x", timer->core_id);
+        ep_trace_thread_name(TRACE_DEVICE, (int)timer->core_id, name);
+        named_cores[named_count++] = timer->core_id;
+
+        char args[64];
+        sprintf(args, "{\"blocks\":%u,\"stalls\":%u}", timer->task_count, timer->stall_count);
+        ep_trace_span("back stages", TRACE_DEVICE, (int)timer->core_id, cores_start + (double)timer->start / CORE_FREQUENCY,
+            (double)(timer->stop - timer->start) / CORE_FREQUENCY, args);
+    }
+    for(int j = 0; j < tasks->count; ++j) {
+        EpTaskTrace const *const trace = traces + j;
+        if(trace->frame_id != frame_id)
+            continue;
+
+        int const core = (int)trace->core_id;
+        int named = 0;
+        for(int i = 0; i < named_count && !named; ++i)
+            named = named_cores[i] == trace->core_id;
+        if(!named && named_count < MAX_CORES_NUM) {
+            char name[32];
+            sprintf(name, "core 0x%03x", core);
+            ep_trace_thread_name(TRACE_DEVICE, core, name);
+            named_cores[named_count++] = trace->core_id;
+        }
+
+        //Trace clock counts cycles, CORE_FREQUENCY is cycles per microsecond
+        char args[64];
+        sprintf(args, "{\"task\":%d,\"level\":%d}", j, tasks->data[j].image_index);
+        double const start = cores_start + (double)trace->start / CORE_FREQUENCY;
+        ep_trace_span(get_task_kind_name(tasks->data[j].kind), TRACE_DEVICE, core, start,
+            (double)(trace->stop - trace->start) / CORE_FREQUENCY, args);
+
+        unsigned int const marks[] = {trace->start, trace->ready, trace->loaded, trace->processed, trace->stop};
+        static char const *const phases[] = {"fetch", "DMA-in", "process", "write-back"};
+        for(int i = 0; i < 4; ++i)
+            if(marks[i + 1] > marks[i])
+                ep_trace_span(phases[i], TRACE_DEVICE, core, cores_start + (double)marks[i] / CORE_FREQUENCY,
+                    (double)(marks[i + 1] - marks[i]) / CORE_FREQUENCY, NULL);
+    }
+}
+
+/**
+ * Output per-level and per-tile phases of tasks processing measured by cores (@see EpTaskTrace)
+ * @param f       : opened log file
+ * @param imgs    : list of images properties
+ * @param tasks   : task list
+ * @param traces  : traces of tasks downloaded after detection
+ * @param frame_id: identifier of current frame; records with another identifier are not written by current frame
+ */
+static void task_traces_log(
+        FILE              *const f,
+        EpImgList   const *const imgs,
+        EpTaskList  const *const tasks,
+        EpTaskTrace const *const traces,
+        int                const frame_id
+) {
+    const double ms_cycles = 1000.0 * CORE_FREQUENCY;
+    int missing = 0;
+    fprintf(f, "\r\nDetection phases per level in ms (@see EpTaskTrace)\r\n");
+    fprintf(f, "=============================================\r\n");
+    for(int i = 0; i < imgs->count; ++i) {
+        int tiles_count = 0;
+        double fetch = 0, dma_in = 0, classify = 0, write_back = 0, max_tile = 0;
+        for(int j = 0; j < tasks->count; ++j) {
+            EpTaskTrace const *const trace = traces + j;
+            if(tasks->data[j].kind != TASK_DETECT || tasks->data[j].image_index != i || trace->frame_id != frame_id)
+                continue;
+            ++tiles_count;
+            fetch      += (trace->ready     - trace->start)     / ms_cycles;
+            dma_in     += (trace->loaded    - trace->ready)     / ms_cycles;
+            classify   += (trace->processed - trace->loaded)    / ms_cycles;
+            write_back += (trace->stop      - trace->processed) / ms_cycles;
+            double const tile = (trace->stop - trace->start) / ms_cycles;
+            if(tile > max_tile)
+                max_tile = tile;
+        }
+        if(!tiles_count)
+            continue;
+        fprintf(f, "\t Level #%d:\t%dx%d\t tiles: %d\t fetch: %.3lf\t DMA-in: %.3lf\t classify: %.3lf\t write-back: %.3lf\t max tile: %.3lf\r\n",
+            i, imgs->data[i].width, imgs->data[i].height, tiles_count, fetch, dma_in, classify, write_back, max_tile);
+    }
+
+    fprintf(f, "\r\nTasks timeline in ms\r\n");
+    fprintf(f, "=============================================\r\n");
+    fprintf(f, "\t task\t level\t kind\t origin\t\t size\t\t core\t start\t fetch\t DMA-in\t process\t write-back\r\n");
+    for(int j = 0; j < tasks->count; ++j) {
+        EpTaskItem  const *const task  = tasks->data + j;
+        EpTaskTrace const *const trace = traces + j;
+        if(trace->frame_id != frame_id) {
+            ++missing;
+            continue;
+        }
+        fprintf(f, "\t %d\t %d\t %s\t %dx%d\t\t %dx%d\t\t %u\t %.3lf\t %.3lf\t %.3lf\t %.3lf\t %.3lf\r\n",
+            j, task->image_index, get_task_kind_name(task->kind),
+            task->origin & 0xFFFF, task->origin >> 16, task->width, task->height, trace->core_id,
+            trace->start / ms_cycles,
+            (trace->ready     - trace->start)     / ms_cycles,
+            (trace->loaded    - trace->ready)     / ms_cycles,
+            (trace->processed - trace->loaded)    / ms_cycles,
+            (trace->stop      - trace->processed) / ms_cycles);
+    }
+    if(missing)
+        fprintf(f, "Tasks without trace of current frame: %d\r\n", missing);
+}
+
+/**
+ * Parse task on core times and output times in log_file
+ * @param log_file  : name of result file
+ * @param scale_time: time of images scaling
+ * @param wait_time : time of host wait of detection
+ * @param num_cores : count of working cores
+ * @param timers    : array of cores timers
+ * @param gap_pyramid_order: estimated finishing gap between cores for tasks in pyramid order
+ * @param gap_cost_order   : estimated finishing gap between cores for tasks sorted by cost
+ * @param pyramid_bytes    : size of image pyramid
+ * @param images_bytes     : size of images data uploaded to shared buffer
+ * @param control_info     : control information downloaded after detection
+ * @param imgs             : list of images properties
+ * @param tasks            : task list
+ * @param traces           : timing of tasks downloaded after detection (may be NULL)
+ * @param frame_id         : identifier of frame marking valid traces
+ */
+static void time_log(
+        char       const * const log_file,
+        double     const         scale_time,
+        double     const         wait_time,
+        int        const         num_cores,
+        EpTimerBuf const * const timers,
+        double     const         gap_pyramid_order,
+        double     const         gap_cost_order,
+        int        const         pyramid_bytes,
+        int        const         images_bytes,
+        EpControlInfo const *const control_info,
+        EpImgList     const *const imgs,
+        EpTaskList    const *const tasks,
+        EpTaskTrace   const *const traces,
+        int                  const frame_id
+) {
+    FILE *f = fopen(log_file, "wt");
+    fprintf(f, "------- Timers result in seconds ------\r\n\r\n");
+    fprintf(f, "Scale time:               %lf\r\n", scale_time / 1000000);
+    fprintf(f, "Host detection wait time: %lf\r\n", wait_time / 1000000);
+    fprintf(f, "\r\nWork times per cores\r\n");
+    fprintf(f, "=============================================\r\n");
+
+    const double core_timer_freq = 1000000.0 * CORE_FREQUENCY;
+    double total_cores_time = 0;
+    double min_core_time = 0, max_core_time = 0;
+    double front_time = 0, back_time = 0;
+    unsigned int total_locks = 0, total_tasks = 0, total_stalls = 0;
+    for (int i = 0; i < num_cores; ++i) {
+        double cur_time = timers[i].value / core_timer_freq * (1 << TIMER_VALUE_SHIFT);
+        fprintf(f, "\t Core #%d:\t%lf\t %s: %u\t locks: %u\t stalls: %u\r\n",
+            timers[i].core_id, cur_time, timers[i].back_core ? "blocks" : "tasks ",
+            timers[i].task_count, timers[i].lock_count, timers[i].stall_count);
+        if (i == 0 || cur_time < min_core_time) min_core_time = cur_time;
+        if (i == 0 || cur_time > max_core_time) max_core_time = cur_time;
+        total_cores_time += cur_time;
+        total_locks += timers[i].lock_count;
+        total_stalls += timers[i].stall_count;
+        if(timers[i].back_core) {
+            back_time += cur_time;
+        } else {
+            front_time += cur_time;
+            total_tasks += timers[i].task_count;
+        }
+    }
+
+    fprintf(f, "=============================================\r\n");
+    fprintf(f, "Average cores time: %lf\r\n", total_cores_time / num_cores);
+    fprintf(f, "Total cores time: %lf\r\n", total_cores_time);
+    fprintf(f, "Tasks processed: %u\r\n", total_tasks);
+    fprintf(f, "Mutex acquisitions per frame: %u (%lf per task)\r\n",
+        total_locks, total_tasks ? (double)total_locks / total_tasks : 0.0);
+    fprintf(f, "Waits for other cores: %u\r\n", total_stalls);
+    if(control_info->back_cores) {
+        fprintf(f, "\r\nStage pipeline\r\n");
+        fprintf(f, "=============================================\r\n");
+        fprintf(f, "Front cores: %d, time: %lf\r\n", num_cores - control_info->back_cores, front_time);
+        fprintf(f, "Back cores:  %d, time: %lf\r\n", control_info->back_cores, back_time);
+        fprintf(f, "Survivor blocks passed: %d\r\n", control_info->survivors_written);
+    }
+    fprintf(f, "\r\nLoad balance\r\n");
+    fprintf(f, "=============================================\r\n");
+    fprintf(f, "Estimated finishing gap, pyramid order: %5.1lf%%\r\n", gap_pyramid_order * 100);
+    fprintf(f, "Estimated finishing gap, cost order:    %5.1lf%%\r\n", gap_cost_order * 100);
+    fprintf(f, "Measured gap between cores times:       %5.1lf%% (%lf)\r\n",
+        max_core_time > 0 ? (max_core_time - min_core_time) / max_core_time * 100 : 0.0,
+        max_core_time - min_core_time);
+    fprintf(f, "\r\nShared images buffer\r\n");
+    fprintf(f, "=============================================\r\n");
+    fprintf(f, "Pyramid bytes:  %d\r\n", pyramid_bytes);
+    fprintf(f, "Uploaded bytes: %d (%+.1lf%%)\r\n", images_bytes,
+        pyramid_bytes ? (double)(images_bytes - pyramid_bytes) / pyramid_bytes * 100 : 0.0);
+    fprintf(f, "\r\nTiles overlap per level (@see plan_tiles)\r\n");
+    fprintf(f, "=============================================\r\n");
+    long long total_level_bytes = 0, total_tile_bytes = 0;
+    for(int i = 0; i < imgs->count; ++i) {
+        int tiles_count = 0, tile_bytes = 0;
+        for(int j = 0; j < tasks->count; ++j)
+            if(tasks->data[j].kind == TASK_DETECT && tasks->data[j].image_index == i) {
+                ++tiles_count;
+                tile_bytes += tasks->data[j].area;
+            }
+        if(!tiles_count)
+            continue;
+        int const level_bytes = imgs->data[i].width * imgs->data[i].height;
+        fprintf(f, "\t Level #%d:\t%dx%d\t tiles: %d\t bytes: %d\t overlap: %+.1lf%%\r\n",
+            i, imgs->data[i].width, imgs->data[i].height, tiles_count, tile_bytes,
+            (double)(tile_bytes - level_bytes) / level_bytes * 100);
+        total_level_bytes += level_bytes;
+        total_tile_bytes  += tile_bytes;
+    }
+    fprintf(f, "Transferred tile bytes: %lld (%+.1lf%%)\r\n", total_tile_bytes,
+        total_level_bytes ? (double)(total_tile_bytes - total_level_bytes) / total_level_bytes * 100 : 0.0);
+#ifdef DEVICE_EMULATION
+    fprintf(f, "\r\nEmulated DMA\r\n");
+    fprintf(f, "=============================================\r\n");
+    fprintf(f, "Descriptors issued: %llu (%lf per task)\r\n",
+        emulator_stats.dma_descriptors, total_tasks ? (double)emulator_stats.dma_descriptors / total_tasks : 0.0);
+    fprintf(f, "Strided descriptors: %llu\r\n", emulator_stats.dma_strided);
+    fprintf(f, "Bytes transferred:  %llu\r\n", emulator_stats.dma_bytes);
+    fprintf(f, "Busy-wait polls:    %llu\r\n", emulator_stats.spin_waits);
+    fprintf(f, "Mutex operations:   %llu\r\n", emulator_stats.mutex_ops);
+    fprintf(f, "Classifier nodes:   %llu\r\n", emulator_stats.node_evaluations);
+    if(emulator_stats.model_cycles) {
+        fprintf(f, "\r\nEmulator cost model (cores times above are estimated)\r\n");
+        fprintf(f, "=============================================\r\n");
+        fprintf(f, "Total cores cycles:   %llu\r\n", emulator_stats.model_cycles);
+        fprintf(f, "Busiest core cycles:  %llu (%lf s)\r\n", emulator_stats.model_max_core_cycles,
+            emulator_stats.model_max_core_cycles / (1000000.0 * CORE_FREQUENCY));
+    }
+#endif//DEVICE_EMULATION
+
+    if(traces)
+        task_traces_log(f, imgs, tasks, traces, frame_id);
+
+    fclose(f);
+}
+
+/**
+ * Get horizontal span of tile (@see plan_tiles()).
+ * @param image_width  : level width minus horizontal overlap;
+ * @param overlap_width: horizontal overlap of tiles (window width - 1);
+ * @param tiles_hor    : number of tiles in row;
+ * @param tile_x       : column of tile;
+ * @param tile_x1      : receives left tile edge (dividible by 8);
+ * @return tile width.
+ */
+static int get_tile_column(int const image_width, int const overlap_width, int const tiles_hor, int const tile_x, int *const tile_x1) {
+    *tile_x1 = round_to_8n( divide_round(image_width * tile_x, tiles_hor) );
+    int const tile_x2 = tile_x + 1 == tiles_hor ?
+                        image_width + overlap_width :
+                        round_to_8n( divide_round(image_width * (tile_x + 1), tiles_hor) ) + overlap_width;
+    return tile_x2 - *tile_x1;
+}
+
+/**
+ * Get vertical span of tile (@see plan_tiles()).
+ * @param image_height  : level height minus vertical overlap;
+ * @param overlap_height: vertical overlap of tiles (window height - 1);
+ * @param tiles_ver     : number of tiles in column;
+ * @param tile_y        : row of tile;
+ * @param tile_y1       : receives top tile edge;
+ * @return tile height.
+ */
+static int get_tile_row(int const image_height, int const overlap_height, int const tiles_ver, int const tile_y, int *const tile_y1) {
+    *tile_y1 = divide_round(image_height * tile_y, tiles_ver);
+    return divide_round(image_height * (tile_y + 1), tiles_ver) + overlap_height - *tile_y1;
+}
+
+/**
+ * Choose tiles grid for pyramid level. Tiles are overlapped by window size - 1, so overlapped pixels
+ *   are transferred to cores more than once. All grids fitting MAX_TILE_BYTES are tried and the one with
+ *   minimal sum of transferred bytes and TASK_OVERHEAD_BYTES per tile is taken.
+ * @param image_width   : level width minus horizontal overlap;
+ * @param image_height  : level height minus vertical overlap;
+ * @param overlap_width : horizontal overlap of tiles (window width - 1);
+ * @param overlap_height: vertical overlap of tiles (window height - 1);
+ * @param tiles_hor     : receives number of tiles in row;
+ * @param tiles_ver     : receives number of tiles in column.
+ */
+static void plan_tiles (
+        int   const image_width,
+        int   const image_height,
+        int   const overlap_width,
+        int   const overlap_height,
+        int * const tiles_hor,
+        int * const tiles_ver
+) {
+    double best_cost = -1.0;
+    *tiles_hor = *tiles_ver = 1;
+
+    //Tile edges are dividible by 8, so narrower tiles are not possible
+    int const max_tiles_hor = image_width / 8 > 1 ? image_width / 8 : 1;
+
+    for(int hor = 1; hor <= max_tiles_hor; ++hor) {
+        //Bytes of tiles row: tile step does not depend on tile row
+        int row_bytes = 0, max_step = 0;
+        for(int tile_x = 0; tile_x < hor; ++tile_x) {
+            int tile_x1;
+            int const tile_step = round_up_to_8n( get_tile_column(image_width, overlap_width, hor, tile_x, &tile_x1) );
+            row_bytes += tile_step;
+            if(tile_step > max_step) max_step = tile_step;
+        }
+
+        int const max_tile_height = MAX_TILE_BYTES / max_step;
+        if(max_tile_height <= overlap_height)
+            continue; //Tiles are too wide
+
+        //Fewest tile rows are the cheapest; rounding of tile edges may require one more row
+        for(int ver = divide_up(image_height, max_tile_height - overlap_height); ver <= image_height; ++ver) {
+            int column_height = 0, max_height = 0;
+            for(int tile_y = 0; tile_y < ver; ++tile_y) {
+                int tile_y1;
+                int const tile_height = get_tile_row(image_height, overlap_height, ver, tile_y, &tile_y1);
+                column_height += tile_height;
+                if(tile_height > max_height) max_height = tile_height;
+            }
+            if(max_height > max_tile_height)
+                continue;
+
+            double const cost = (double)row_bytes * column_height + (double)TASK_OVERHEAD_BYTES * hor * ver;
+            if(best_cost < 0 || cost < best_cost) {
+                best_cost = cost;
+                *tiles_hor = hor;
+                *tiles_ver = ver;
+            }
+            break;
+        }
+    }
+}
+
+/**
+ * Add in task list tasks from image.
+ *
+ * @param scan_mode    : which pixels to test (@see EpScanMode);
+ * @param img_list     : list of images properties;
+ * @param img_index    : index of current image;
+ * @param window_width : detection window width;
+ * @param window_height: detection window height;
+ * @param cost_weight  : relative cost of one window on this level (@see EpLevelStats);
+ * @param wave         : wave of tasks (@see resolve_task_waves());
+ * @param task_buf     : task list;
+ */
+
+static void add_tasks_for_image(
+        EpScanMode   const scan_mode,
+        EpImgList  * const img_list,
+        int          const img_index,
+        int          const window_width,
+        int          const window_height,
+        float        const cost_weight,
+        int          const wave,
+        EpTaskList * const task_buf
+) {
+    int tiles_ver;
+    int tiles_hor;
+    EpImageProp* img_prop = img_list->data + img_index;
+
+    int const overlap_width = window_width  - 1,
+             overlap_height = window_height - 1;
+
+    //Corrected image width and height convenient for calculations
+    int image_width  = img_prop->width  - overlap_width ,
+        image_height = img_prop->height - overlap_height;
+
+    //Ideally we have following equalities:
+    // tile_width  * tiles_hor + overlap_width  * (tiles_hor - 1) == image_width
+    // tile_height * tiles_ver + overlap_height * (tiles_ver - 1) == image_height
+    //But it may happen that image will not be dividible by the tile size.
+    //In this case we need to produce tiles slightly different in sizes to
+    //  cover the whole image
+    plan_tiles(image_width, image_height, overlap_width, overlap_height, &tiles_hor, &tiles_ver);
 
-            int const tile_height = tile_y2 - tile_y1;
+    const int num_tiles = tiles_hor * tiles_ver;
 
-            int const tile_x = tile_index % tiles_hor,
-                      tile_x1 = round_to_8n( divide_round(image_width *  tile_x     , tiles_hor) ),
-                      tile_x2 = tile_x + 1 == tiles_hor ?
-                                image_width + overlap_width :
-                                round_to_8n( divide_round(image_width * (tile_x + 1), tiles_hor) ) + overlap_width;
+    for(int tile_index = 0; tile_index < num_tiles; ++tile_index) {
+            int tile_y1, tile_x1;
+            int const tile_height = get_tile_row(image_height, overlap_height, tiles_ver, tile_index / tiles_hor, &tile_y1);
 
-            int const tile_width = tile_x2 - tile_x1,
+            int const tile_width = get_tile_column(image_width, overlap_width, tiles_hor, tile_index % tiles_hor, &tile_x1),
                       tile_step  = round_up_to_8n(tile_width);
 
             assert(tile_step * tile_height <= MAX_TILE_BYTES);
 
+            int const tile_scan_mode = scan_mode == SCAN_FULL ? SCAN_FULL : (tile_x1 + tile_y1 + scan_mode) & 1;
+            int const tile_windows = count_scanned_windows(tile_width, tile_height, window_width, window_height, tile_scan_mode);
+
             ep_task_list_add (
                 task_buf,
-                tile_x1 + tile_y1 * img_prop->step,
+                img_prop->data_offset + tile_x1 + tile_y1 * img_prop->step,
+                tile_x1 | tile_y1 << 16,
                 tile_width,
                 tile_height,
                 tile_step,
-                scan_mode == SCAN_FULL ? SCAN_FULL : (tile_x1 + tile_y1 + scan_mode) & 1,
+                img_prop->step,
+                tile_scan_mode,
                 0,
-                img_index
+                img_index,
+                cvRound(tile_windows * cost_weight)
             );
+            task_buf->data[task_buf->count - 1].dependency = wave;
     }
 }
 
 /**
- * Multiscale object detection
- *
- * Image is iteratively scaled down until it became less than native object size.
- * On each scale detection is performed.
- *
- * @param image     : Image to process (pointer to valid image structure).
- * @param classifier: Classifier to use (pointer to valid classifier structure).
- * @param objects   : Detections will be added to this list (pointer to valid rectangles list structure).
- * @param scan_mode : Which image pixels to test; @see EpScanMode.
- * @param num_cores : Number of cores in cores list.
- * @param log_file  : Name of log file. Pass NULL to disable log file and debug output.
+ * Add properties of pyramid levels computed by cores (@see DEVICE_PYRAMID).
+ *   Sizes, steps and order of levels are the same as for pyramid built on host.
+ * @param img_list     : empty list of images properties;
+ * @param image        : level 0 of pyramid;
+ * @param window_width : detection window width;
+ * @param window_height: detection window height.
+ */
+static void add_device_pyramid_levels (
+    EpImgList       *const img_list,
+    EpImage   const *const image,
+    int              const window_width,
+    int              const window_height
+) {
+    int widths[4]  = {image->width , image->width  / 8 * 7, image->width  / 8 * 6, image->width  / 8 * 5},
+        heights[4] = {image->height, image->height / 8 * 7, image->height / 8 * 6, image->height / 8 * 5};
+
+    while(img_list->count < MAX_IMGS_COUNT) {
+        int const i = img_list->count % 4;
+        if(widths[i] < window_width || heights[i] < window_height) break;
+        ep_img_list_add(img_list, round_up_to_8n(widths[i]), widths[i], heights[i]);
+        widths[i]  /= 2;
+        heights[i] /= 2;
+    }
+}
+
+/**
+ * Wave of tasks computing pyramid level on cores (@see DEVICE_PYRAMID).
+ *   Levels 1-4 are computed from level 0 in the first wave,
+ *   every next level -- one wave after the level four positions before.
+ * @param img_index: index of level;
+ * @return wave index; -1 for level 0 uploaded by host.
+ */
+static int get_level_wave(int const img_index) {
+    if(img_index == 0)
+        return -1;
+    if(img_index <= 4)
+        return 0;
+    return get_level_wave(img_index - 4) + 1;
+}
+
+/**
+ * Add in task list tasks computing pyramid level on cores (@see DEVICE_PYRAMID).
+ *   Levels 1-3 are reduced from 8x8 blocks of level 0, the others -- twice from the level four positions before.
  *
- * @return ERR_SUCCESS: successful detection;
- *         ERR_ARGUMENT: empty image, or invalid classifier, or unknown detection_mode, or unknown scan_mode.
- *         ERR_MEMORY: cannot allocate required memory (memory checks are not implemented yet).
- *         ERR_OTHER: classifier is too large and cannot be uploaded to core.
+ * @param img_list : list of images properties;
+ * @param img_index: index of computed level (must be positive);
+ * @param offset_x : number of pixels of level 0 thrown away from left side by blocks reduction;
+ * @param offset_y : number of pixels of level 0 thrown away from top side by blocks reduction;
+ * @param wave     : wave of tasks (@see resolve_task_waves());
+ * @param task_buf : task list;
  */
-EpErrorCode ep_detect_multi_scale_device (
-    EpImage                   *const image,
+static void add_scale_tasks (
+        EpImgList  const * const img_list,
+        int                const img_index,
+        int                const offset_x,
+        int                const offset_y,
+        int                const wave,
+        EpTaskList       * const task_buf
+) {
+    int const blocks = img_index < 4;
+    int const block_size = 8 - img_index; //Size of block in resulting level for blocks reduction
+
+    EpImageProp const *const dst = img_list->data + img_index;
+    EpImageProp const *const src = img_list->data + (blocks ? 0 : img_index - 4);
+
+    //Region sizes in resulting level; blocks are never split between tasks
+    int const tile_size = blocks ? SCALE_TILE_SIZE / 8 * block_size : SCALE_TILE_SIZE / 2;
+
+    for(int y = 0; y < dst->height; y += tile_size)
+        for(int x = 0; x < dst->width; x += tile_size) {
+            int const width  = dst->width  - x < tile_size ? dst->width  - x : tile_size,
+                      height = dst->height - y < tile_size ? dst->height - y : tile_size;
+
+            int const src_x = blocks ? x / block_size * 8 + offset_x : x * 2,
+                      src_y = blocks ? y / block_size * 8 + offset_y : y * 2;
+
+            ep_task_list_add (
+                task_buf,
+                src->data_offset + src_x + src_y * src->step,
+                x | y << 16,
+                width,
+                height,
+                round_up_to_8n(width),
+                src->step,
+                SCAN_FULL,
+                0,
+                img_index,
+                divide_up(width * height, SCALE_PIXELS_PER_COST)
+            );
+
+            EpTaskItem *const task = task_buf->data + task_buf->count - 1;
+            task->kind       = blocks ? TASK_SCALE_BLOCKS : TASK_SCALE_HALF;
+            task->dependency = wave;
+        }
+}
+
+/**
+ * Upload part of classifier terminated with final node.
+ * @param e      : device context;
+ * @param to_addr: destination offset in shared memory buffer;
+ * @param nodes  : classifier nodes;
+ * @param size   : size of nodes in bytes.
+ * @return size of uploaded part rounded up to 8 bytes.
+ */
+static int send_classifier_part (
+    ep_context_t       *const e,
+    off_t               const to_addr,
+    char         const *const nodes,
+    int                 const size
+) {
+    EpNodeFinal const final_node = {NODE_FINAL};
+    e_write(&e->emem, 0, 0, to_addr, nodes, size);
+    e_write(&e->emem, 0, 0, to_addr + size, &final_node, sizeof(EpNodeFinal));
+    return round_up_to_8n(size + sizeof(EpNodeFinal));
+}
+
+/**
+ * Upload image into shared memory with step of its properties. Image borrowed from caller
+ *   may have any step (e.g. region of larger image), then it is uploaded line by line.
+ * @param e    : device context;
+ * @param prop : properties of image in shared memory;
+ * @param image: image to upload.
+ * @return number of uploaded bytes.
+ */
+static int send_image_data (
+    ep_context_t        *const e,
+    EpImageProp   const *const prop,
+    EpImage       const *const image
+) {
+    off_t const to_addr = offsetof(EpDRAMBuf, imgs_buf) + prop->data_offset;
+    if(image->step == prop->step)
+        return e_write(&e->emem, 0, 0, to_addr, image->data, image->step * image->height);
+
+    int data_amount = 0;
+    for(int y = 0; y < image->height; ++y)
+        data_amount += e_write(&e->emem, 0, 0, to_addr + prop->step * y, image->data + image->step * y, image->width);
+    return data_amount;
+}
+
+/**
+ * Upload pyramid level to shared images buffer, or keep its copy on host for tile-major upload.
+ * @param e          : device context;
+ * @param img_list   : list of images properties (image is the last one);
+ * @param image      : pyramid level;
+ * @param host_levels: array receiving host copies of levels; NULL to upload level directly.
+ * @return number of bytes uploaded.
+ */
+static int send_image_level (
+    ep_context_t        *const e,
+    EpImgList     const *const img_list,
+    EpImage       const *const image,
+    EpImage             *const host_levels
+) {
+    if(host_levels) {
+        if(img_list->count <= MAX_IMGS_COUNT)
+            host_levels[img_list->count - 1] = ep_image_clone(image);
+        return 0;
+    }
+    if(img_list->cur_offset > e->imgs_buf_size)
+        return 0; //Does not fit shared memory of core group; caller checks pyramid size
+    return send_image_data(e, img_list->data + img_list->count - 1, image);
+}
+
+/**
+ * Build tile-major images buffer: every tile (with its overlap) is stored contiguously in task order,
+ *   so core fetches it with single linear DMA. Offsets and source steps of tasks are updated on success.
+ * @param tasks : list of tasks (tiles);
+ * @param levels: pyramid levels kept on host;
+ * @param capacity: size of images buffer in shared memory.
+ * @param buf   : receives allocated buffer; must be released with free().
+ * @return buffer size in bytes; -1 if buffer exceeds capacity or cannot be allocated.
+ */
+static int build_tile_major_buf (
+    EpTaskList          *const tasks,
+    EpImage       const *const levels,
+    int                  const capacity,
+    unsigned char      **const buf
+) {
+    int size = 0;
+    for(int i = 0; i < tasks->count; ++i)
+        size += tasks->data[i].area;
+
+    *buf = size <= capacity ? (unsigned char *)malloc(size) : NULL;
+    if( !*buf )
+        return -1;
+
+    int offset = 0;
+    for(int i = 0; i < tasks->count; ++i) {
+        EpTaskItem    *const task  = tasks->data + i;
+        EpImage const *const level = levels + task->image_index;
+
+        unsigned char const *src = level->data + (task->origin & 65535) + (task->origin >> 16) * level->step;
+        unsigned char       *dst = *buf + offset;
+        for(int line = 0; line < task->height; ++line, src += level->step, dst += task->step)
+            memcpy(dst, src, task->step);
+
+        task->offset   = offset;
+        task->src_step = task->step;
+        offset += task->area;
+    }
+
+    return size;
+}
+
+/**
+ * Download timers of cores (@see EpTimerBuf). Core marks its timer with frame identifier after the rest
+ *   of it is written, so timers still being written are not taken as complete.
+ * @param e        : context of opened cores
+ * @param timers   : receives timers of num_cores cores
+ * @param num_cores: number of started cores
+ * @param frame_id : identifier of current frame
+ * @return non-zero if every core has written its timer during this frame
+ */
+static int download_timers(ep_context_t *const e, EpTimerBuf *const timers, int const num_cores, int const frame_id) {
+    e_read(&e->emem, 0, 0, offsetof(EpDRAMBuf, timers), timers, sizeof(EpTimerBuf) * num_cores);
+    for(int i = 0; i < num_cores; ++i)
+        if(timers[i].frame_id != frame_id)
+            return 0;
+    return 1;
+}
+
+/**
+ * Download task items of tasks finished by cores (@see EpDRAMBuf::finished_runs).
+ *   Tasks are harvested in task list order, so detections are listed in the same order
+ *   as if all task items were downloaded after cores finished.
+ * @param e             : device context;
+ * @param tasks         : task list; task items of harvested tasks are downloaded into it;
+ * @param finished_tasks: flags of tasks known to be finished;
+ * @param runs_read     : number of finished tasks which runs are already read from finished_runs;
+ * @param harvested     : number of tasks from the beginning of list which task items are downloaded;
+ * @param task_finished : value of control_info.task_finished read from shared memory.
+ * @return number of downloaded bytes.
+ */
+static int harvest_finished_tasks (
+    ep_context_t       *const e,
+    EpTaskList         *const tasks,
+    char               *const finished_tasks,
+    int                *const runs_read,
+    int                *const harvested,
+    int                 const task_finished
+) {
+    if(task_finished > *runs_read) {
+        int runs[task_finished - *runs_read];
+        e_read(&e->emem, 0, 0, offsetof(EpDRAMBuf, finished_runs) + *runs_read * sizeof(int), runs, sizeof(runs));
+
+        //Run is zero until core records it
+        int position = *runs_read;
+        while(position < task_finished && runs[position - *runs_read]) {
+            int const run = runs[position - *runs_read];
+            memset(finished_tasks + (run & 65535), 1, run >> 16);
+            position += run >> 16;
+        }
+        *runs_read = position;
+    }
+
+    int harvest_end = *harvested;
+    while(harvest_end < tasks->count && finished_tasks[harvest_end])
+        ++harvest_end;
+    if(harvest_end == *harvested)
+        return 0;
+
+    int const data_amount = e_read(&e->emem, 0, 0, offsetof(EpDRAMBuf, tasks) + *harvested * sizeof(EpTaskItem),
+        tasks->data + *harvested, (harvest_end - *harvested) * sizeof(EpTaskItem));
+    *harvested = harvest_end;
+    return data_amount;
+}
+
+/**
+ * Copy slots of results ring (blocks, or their states) to host buffer or back; slots may wrap around the end of ring
+ * @param e        : device context;
+ * @param offset   : offset of EpDRAMBuf::results or EpDRAMBuf::results_sequence;
+ * @param slot_size: size of ring slot in bytes;
+ * @param first    : number of the first slot (taken modulo MAX_RESULT_BLOCKS);
+ * @param count    : number of slots (at most MAX_RESULT_BLOCKS);
+ * @param data     : host buffer of count slots;
+ * @param write    : non-zero to copy host buffer to shared memory.
+ * @return number of transferred bytes.
+ */
+static int transfer_results_ring (
+    ep_context_t *const e,
+    int           const offset,
+    int           const slot_size,
+    int           const first,
+    int           const count,
+    void         *const data,
+    int           const write
+) {
+    int const start = first % MAX_RESULT_BLOCKS;
+    int const head  = count < MAX_RESULT_BLOCKS - start ? count : MAX_RESULT_BLOCKS - start;
+    int data_amount = 0;
+    if(write) {
+        data_amount += e_write(&e->emem, 0, 0, offset + start * slot_size, data, head * slot_size);
+        if(count > head)
+            data_amount += e_write(&e->emem, 0, 0, offset, (char *)data + head * slot_size, (count - head) * slot_size);
+    } else {
+        data_amount += e_read(&e->emem, 0, 0, offset + start * slot_size, data, head * slot_size);
+        if(count > head)
+            data_amount += e_read(&e->emem, 0, 0, offset, (char *)data + head * slot_size, (count - head) * slot_size);
+    }
+    return data_amount;
+}
+
+/**
+ * Drain blocks published in results ring (@see EpDRAMBuf::results_sequence) and free their slots for cores.
+ *   Blocks are drained in order, so draining stops at the first block which is not written completely yet.
+ * @param e              : device context;
+ * @param blocks         : receives drained blocks (buffer of MAX_RESULT_BLOCKS blocks);
+ * @param results_read   : read cursor of results ring (number of blocks ever drained); updated;
+ * @param results_written: value of control_info.results_written read from shared memory;
+ * @param data_amount    : downloaded bytes are added here.
+ * @return number of drained blocks.
+ */
+static int drain_result_blocks (
+    ep_context_t  *const e,
+    EpResultBlock *const blocks,
+    int           *const results_read,
+    int            const results_written,
+    int           *const data_amount
+) {
+    //Cores waiting for a free slot have already reserved blocks beyond the ring
+    int const pending = results_written - *results_read;
+    int const count_max = pending < MAX_RESULT_BLOCKS ? pending : MAX_RESULT_BLOCKS;
+    if(count_max <= 0)
+        return 0;
+
+    int sequence[MAX_RESULT_BLOCKS];
+    transfer_results_ring(e, offsetof(EpDRAMBuf, results_sequence), sizeof(int), *results_read, count_max, sequence, 0);
+    int count = 0;
+    while(count < count_max && sequence[count] == *results_read + count + 1)
+        ++count;
+    if(count == 0)
+        return 0;
+
+    *data_amount += transfer_results_ring(e, offsetof(EpDRAMBuf, results), sizeof(EpResultBlock), *results_read, count, blocks, 0);
+
+    //Slots are free for blocks number slot + MAX_RESULT_BLOCKS
+    for(int i = 0; i < count; ++i)
+        sequence[i] = *results_read + i + MAX_RESULT_BLOCKS;
+    transfer_results_ring(e, offsetof(EpDRAMBuf, results_sequence), sizeof(int), *results_read, count, sequence, 1);
+
+    *results_read += count;
+    return count;
+}
+
+/**
+ * Pass detections added to objects list since first_new to results stream
+ * @param results_stream: receiver of detections (may be NULL)
+ * @param objects       : list of detections
+ * @param first_new     : count of objects before the new ones were added
+ */
+static void stream_results(EpResultsStream const *const results_stream, EpRectList const *const objects, int const first_new) {
+    if(results_stream && objects->count > first_new)
+        results_stream->function(objects, first_new, results_stream->user_data);
+}
+
+/**
+ * @return new identifier, unique for the device (used for frame cache data @see EpFrameCache, and frames traces @see EpTaskTrace).
+ */
+static int next_unique_id(EpDevice *const device) {
+    pthread_mutex_lock(&device->mutex);
+    int const id = ++device->last_id;
+    pthread_mutex_unlock(&device->mutex);
+    return id;
+}
+
+/// Chip and eHAL (or emulated chip) are process-wide, so only one EpDevice may be open at a time
+static pthread_mutex_t device_open_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int device_opened = 0;
+
+EpErrorCode ep_device_open(EpDevice *const device) {
+    pthread_mutex_lock(&device_open_mutex);
+    if(device_opened || e_init(NULL) != E_OK) {
+        pthread_mutex_unlock(&device_open_mutex);
+        return ERR_OTHER;
+    }
+    device_opened = 1;
+    pthread_mutex_unlock(&device_open_mutex);
+
+    memset(device, 0, sizeof(EpDevice));
+    pthread_mutex_init(&device->mutex, NULL);
+    pthread_cond_init(&device->released, NULL);
+    return ERR_SUCCESS;
+}
+
+void ep_device_close(EpDevice *const device) {
+    //Cores must not be finalized under running detection
+    pthread_mutex_lock(&device->mutex);
+    while(device->busy_cores)
+        pthread_cond_wait(&device->released, &device->mutex);
+    pthread_mutex_unlock(&device->mutex);
+
+    pthread_cond_destroy(&device->released);
+    pthread_mutex_destroy(&device->mutex);
+
+    pthread_mutex_lock(&device_open_mutex);
+    e_finalize();
+    device_opened = 0;
+    pthread_mutex_unlock(&device_open_mutex);
+}
+
+/**
+ * @return mask of cores of group (bit row * COLS + col is set for every core of group)
+ */
+static unsigned int group_cores_mask(EpDeviceGroup const *const group) {
+    unsigned int mask = 0;
+    for(int row = group->row; row < group->row + group->rows; ++row)
+        for(int col = group->col; col < group->col + group->cols; ++col)
+            mask |= 1u << (row * COLS + col);
+    return mask;
+}
+
+/**
+ * Take cores of group for detection, waiting while any of them runs detection started by another thread.
+ *   So detections on the same cores (e.g. on the whole chip) are run one after another,
+ *   and detections on disjoint groups run at the same time.
+ * @param device: opened chip;
+ * @param group : group of cores (must be valid).
+ * @return zero on success; non-zero if shared memory region of group overlaps region of group running on other cores.
+ */
+static int acquire_cores(EpDevice *const device, EpDeviceGroup const *const group) {
+    unsigned int const mask = group_cores_mask(group);
+    pthread_mutex_lock(&device->mutex);
+    while(device->busy_cores & mask)
+        pthread_cond_wait(&device->released, &device->mutex);
+
+    //Every running group has other cores now, so sharing memory region with it would corrupt both detections
+    for(int i = 0; i < device->running_count; ++i) {
+        EpDeviceGroup const *const running = device->running + i;
+        if( group->dram_offset < running->dram_offset + running->dram_size &&
+            running->dram_offset < group->dram_offset + group->dram_size ) {
+            pthread_mutex_unlock(&device->mutex);
+            return 1;
+        }
+    }
+
+    device->busy_cores |= mask;
+    device->running[device->running_count++] = *group;
+    pthread_mutex_unlock(&device->mutex);
+    return 0;
+}
+
+/**
+ * Give back cores taken by acquire_cores()
+ * @param device: opened chip;
+ * @param group : group of cores passed to acquire_cores().
+ */
+static void release_cores(EpDevice *const device, EpDeviceGroup const *const group) {
+    pthread_mutex_lock(&device->mutex);
+    device->busy_cores &= ~group_cores_mask(group);
+    for(int i = 0; i < device->running_count; ++i)
+        if(device->running[i].row == group->row && device->running[i].col == group->col) {
+            device->running[i] = device->running[--device->running_count];
+            break;
+        }
+    pthread_cond_broadcast(&device->released);
+    pthread_mutex_unlock(&device->mutex);
+}
+
+/**
+ * Check group of cores: it must be inside the chip, and its shared memory region must be inside
+ *   shared memory and hold at least everything except images buffer.
+ * @param group: pointer to group structure.
+ * @return zero value for good group; non-zero value for bad group.
+ */
+static int device_group_check(EpDeviceGroup const *const group) {
+    if( group->row < 0 || group->col < 0 || group->rows < 1 || group->cols < 1 ||
+        group->row + group->rows > ROWS || group->col + group->cols > COLS )
+        return 1; //Group is out of chip
+
+    if( group->dram_offset < 0 || (group->dram_offset & 7) ||
+        group->dram_size <= (int)offsetof(EpDRAMBuf, imgs_buf) || group->dram_size > (int)sizeof(EpDRAMBuf) ||
+        group->dram_offset + group->dram_size > SHARED_DRAM_SIZE )
+        return 2; //Wrong shared memory region
+
+    return 0;
+}
+
+/**
+ * Split chip into equal groups of cores, e.g. 4 groups of 2x2 cores to serve 4 video streams.
+ *   Every group gets equal part of shared memory, so images buffer of group is smaller than MAX_IMGS_BUF.
+ *   Different groups may run ep_detect_multi_scale_device() concurrently from different host threads.
+ * @param group_rows: number of core rows in every group; must divide number of chip rows.
+ * @param group_cols: number of core columns in every group; must divide number of chip columns.
+ * @param groups    : receives groups; must have space for MAX_CORES_NUM groups.
+ * @return number of groups; zero if chip cannot be split into such groups.
+ */
+int ep_device_groups_create(int const group_rows, int const group_cols, EpDeviceGroup *const groups) {
+    if(group_rows < 1 || group_cols < 1 || ROWS % group_rows || COLS % group_cols)
+        return 0;
+
+    int const count = (ROWS / group_rows) * (COLS / group_cols);
+    int dram_size = round_down_to_8n(SHARED_DRAM_SIZE / count);
+    if(dram_size > (int)sizeof(EpDRAMBuf))
+        dram_size = sizeof(EpDRAMBuf);
+
+    for(int i = 0; i < count; ++i) {
+        EpDeviceGroup *const group = groups + i;
+        group->row  = i / (COLS / group_cols) * group_rows;
+        group->col  = i % (COLS / group_cols) * group_cols;
+        group->rows = group_rows;
+        group->cols = group_cols;
+        group->dram_offset = i * dram_size;
+        group->dram_size   = dram_size;
+        if( device_group_check(group) )
+            return 0; //Shared memory region is too small
+    }
+
+    return count;
+}
+
+/**
+ * Multiscale object detection of several images in one run of cores (@see ep_detect_multi_scale_device).
+ *   Pyramids of all images are uploaded together, and their tiles share one task list.
+ * @param images      : Images to process; pyramid levels of all of them must fit images buffer and MAX_IMGS_COUNT.
+ * @param images_count: Number of images (only one image with DEVICE_PYRAMID, level_stats, frame_cache or results_stream).
+ * @param objects     : Detections of every image are added to its list (array of images_count lists).
+ * @param scale_range : Scales to detect; only levels in range are uploaded (NULL for all; not with DEVICE_PYRAMID).
+ * @param workspace   : Working set shared by images; images are borrowed if it is given (may be NULL).
+ */
+static EpErrorCode detect_device_images (
+    EpImage                   *const images,
+    int                        const images_count,
     EpCascadeClassifier const *const classifier,
     EpRectList                *const objects,
     EpScanMode                 const scan_mode,
     int                        const num_cores,
-    char                const *const log_file
+    int                        const device_flags,
+    char                const *const log_file,
+    EpLevelStats              *const level_stats,
+    EpFrameCache              *const frame_cache,
+    EpDevice                  *const device,
+    EpDeviceGroup       const *const group,
+    EpResultsStream     const *const results_stream,
+    EpScaleRange        const *const scale_range,
+    EpWorkspace               *const workspace
 ) {
-    if( ep_classifier_check(classifier) )
+    EpCascadeClassifier local_classifier;
+    EpClassifierBinding const *const binding = &get_bound_classifier(classifier, &local_classifier)->binding;
+    if( binding->check )
         return ERR_ARGUMENT; //Wrong classifier
 
-    if( ep_image_is_empty(image) )
-        return ERR_ARGUMENT; //Wrong image
+    for(int i = 0; i < images_count; ++i)
+        if( ep_image_is_empty(images + i) )
+            return ERR_ARGUMENT; //Wrong image
 
-    int const window_width = ((EpNodeMeta const *)classifier->data)->window_width ,
-             window_height = ((EpNodeMeta const *)classifier->data)->window_height;
+    if(!device)
+        return ERR_ARGUMENT; //Chip is not opened
 
-    if(image->width < window_width || image->height < window_height)
-        return ERR_SUCCESS; //Image is too small; no detections
+    EpDeviceGroup const whole_chip = {0, 0, ROWS, COLS, 0, sizeof(EpDRAMBuf)};
+    EpDeviceGroup const *const cores_group = group ? group : &whole_chip;
+    if( device_group_check(cores_group) )
+        return ERR_ARGUMENT; //Wrong group
 
-    int const blocks_x = image->width  / 8,
-              blocks_y = image->height / 8;
+    if(num_cores < 1 || num_cores > MAX_CORES_NUM || num_cores > cores_group->rows * cores_group->cols)
+        return ERR_ARGUMENT; //Wrong cores count
 
-    EpImage img8 = *image;
-    EpImage img7 = ep_image_create(blocks_x * 7, blocks_y * 7);
-    EpImage img6 = ep_image_create(blocks_x * 6, blocks_y * 6);
-    EpImage img5 = ep_image_create(blocks_x * 5, blocks_y * 5);
+    if(device_flags & ~(DEVICE_TILE_MAJOR | DEVICE_PYRAMID | DEVICE_STAGE_PIPELINE))
+        return ERR_ARGUMENT; //Unknown flags
 
-    *image = ep_image_create_empty();
+    if((device_flags & DEVICE_TILE_MAJOR) && (device_flags & DEVICE_PYRAMID))
+        return ERR_ARGUMENT; //Tiles cannot be copied from levels which are not computed yet
+
+    int const device_pyramid = device_flags & DEVICE_PYRAMID;
+    if(device_pyramid && images_count > 1)
+        return ERR_ARGUMENT; //Scale tasks are built for pyramid of single image
+
+    int levels_first, levels_end;
+    if( get_levels_in_range(scale_range, &levels_first, &levels_end) || (device_pyramid && scale_range) )
+        return ERR_ARGUMENT; //Wrong scale range; scale tasks compute all levels
+
+    int const compact = binding->compact;
+    if( compact && classifier->size > MAX_CLASSIFIER_BYTES )
+        return ERR_OTHER; //Compact classifiers are not paged
+
+    //Stage pipeline: classifier is split between front and back cores
+    int back_cores = 0, pipeline_split = 0;
+    if(device_flags & DEVICE_STAGE_PIPELINE) {
+        if(num_cores < 2 || compact)
+            return ERR_ARGUMENT; //Both front and back cores are needed; compact classifiers are not split
+
+        pipeline_split = binding->pipeline_split;
+        if(pipeline_split < 0)
+            return ERR_OTHER; //Classifier cannot be split into parts fitting core memory
+
+        back_cores = num_cores / PIPELINE_CORES_PER_BACK_CORE;
+        if(back_cores < 1) back_cores = 1;
+    }
+
+    //Classifier which does not fit core memory is paged
+    int classifier_pages = 0;
+    int const *const page_splits = binding->page_splits;
+    if( !back_cores && classifier->size > MAX_CLASSIFIER_BYTES ) {
+        classifier_pages = binding->pages;
+        if(classifier_pages < 0)
+            return ERR_OTHER; //Classifier cannot be split into pages
+    }
+
+    int const front_cores = num_cores - back_cores;
+
+    int const window_width = ((EpNodeMeta const *)classifier->data)->window_width ,
+             window_height = ((EpNodeMeta const *)classifier->data)->window_height;
+
+    int detected_images = 0;
+    for(int i = 0; i < images_count; ++i)
+        if(images[i].width >= window_width && images[i].height >= window_height)
+            ++detected_images;
+    if(!detected_images)
+        return ERR_SUCCESS; //Images are too small; no detections
+
+    //Task list and images properties depend only on these parameters (@see EpFrameCache)
+    EpImage const *const image = images;
+    EpFrameKey frame_key;
+    memset(&frame_key, 0, sizeof(EpFrameKey));
+    frame_key.width         = image->width;
+    frame_key.height        = image->height;
+    frame_key.step          = round_up_to_8n(image->width); //Step of level 0 in shared memory, not of source image
+    frame_key.window_width  = window_width;
+    frame_key.window_height = window_height;
+    frame_key.scan_mode     = scan_mode;
+    frame_key.device_flags  = device_flags;
+    frame_key.num_cores     = num_cores;
+    frame_key.dram_offset   = cores_group->dram_offset;
+    frame_key.with_stats    = level_stats && level_stats->count > 0;
 
-    double time_scale = 0.0;
-    int64 time_start_scale = cvGetTickCount();
-    int offset_x, offset_y;
-    scale8765(&img8, &img7, &img6, &img5, &offset_x, &offset_y);
-    time_scale += (cvGetTickCount() - time_start_scale) / cvGetTickFrequency();
 
 
 
@@ -1573,25 +3173,43 @@ EpErrorCode ep_detect_multi_scale_device (
 	/*
 	\D4\F6\BC\D3\C6\F4\B6\AF\B6\E0\BA\CB
 	*/
-	static ep_context_t ee;
+	//Context is not static: groups of cores may be used from different threads at the same time
+	ep_context_t ee;
 	ep_context_t *e = NULL;
 	e = &ee;
-	e_init(NULL);
-	e_reset_system();
+	if( acquire_cores(device, cores_group) )
+		return ERR_ARGUMENT; //Shared memory region is used by group running on other cores
+	if(!group)
+		e_reset_system(); //Other groups may be running; only own group is reset after it is opened
 	e_get_platform_info(&e->eplat);
-	e_alloc(&e->emem, BUF_OFFSET, sizeof(EpDRAMBuf));
-	
-	e_open(&e->edev, 0, 0, ROWS, COLS);
+	e_alloc(&e->emem, BUF_OFFSET + cores_group->dram_offset, cores_group->dram_size);
+	e->imgs_buf_size = cores_group->dram_size - offsetof(EpDRAMBuf, imgs_buf);
 
-	printf("load srec! ROWS=%d, COLS=%d\n", ROWS, COLS);
+	e_open(&e->edev, cores_group->row, cores_group->col, cores_group->rows, cores_group->cols);
+	if(group)
+		e_reset_group(&e->edev);
 
-	if (e_load_group("epiphany.elf", &e->edev, 0, 0, ROWS, COLS, E_FALSE) == E_ERR)
+	if(log_file)
+		printf("load srec! ROWS=%d, COLS=%d\n", cores_group->rows, cores_group->cols);
+
+	if (e_load_group("epiphany.elf", &e->edev, 0, 0, cores_group->rows, cores_group->cols, E_FALSE) == E_ERR)
 	//if (e_load("epiphany.elf", &e->edev, 0, 0, E_FALSE) == E_ERR)
 	{
 		perror("e_load failed");
-		return -1;
+		e_close(&e->edev);
+		e_free(&e->emem);
+		release_cores(device, cores_group);
+		return ERR_OTHER;
 	}
 
+    //Cores find shared memory region of their group in core configuration,
+    //frame identifier marks task traces written during this frame
+    int const frame_id = next_unique_id(device);
+    EpCoreConfig const core_config = {cores_group->dram_offset, frame_id};
+    for(int row = 0; row < cores_group->rows; ++row)
+        for(int col = 0; col < cores_group->cols; ++col)
+            e_write(&e->edev, row, col, CORE_BANK1_ADDRESS + offsetof(EpCoreBank1, config), &core_config, sizeof(EpCoreConfig));
+
 
     	// wake-up eCore
 /*
@@ -1610,80 +3228,293 @@ EpErrorCode ep_detect_multi_scale_device (
 
     // 1 - build shared memory buffer
     //    1.1 - copy images, build images properties
-    EpImgList imgs = ep_img_list_create_empty(0);
+    EpImgList imgs = get_images_list(workspace);
+
+    //In tile-major mode levels are kept on host until task list is built
+    EpImage host_levels[MAX_IMGS_COUNT];
+    EpImage *const tile_major_levels = device_flags & DEVICE_TILE_MAJOR ? host_levels : NULL;
 
     if(log_file) printf("WRITING DATA TO SHARED MEMORY\n");
+    double const trace_upload = ep_trace_begin();
 
+    //Levels of all images are listed together; sources give image and scale of every level
+    EpLevelSource sources[MAX_IMGS_COUNT];
+    double time_scale = 0.0, trace_begin;
     int data_amount;
-    while(1) {
-        if(img8.width < window_width || img8.height < window_height) break;
-        ep_img_list_add(&imgs, img8.step, img8.width, img8.height);
-        if(log_file) { printf("Sending image %dx%d...", img8.width, img8.height); fflush(stdout); }
-printf("write!\n");
-		data_amount = e_write(&e->emem, 0, 0, offsetof(EpDRAMBuf, imgs_buf) + imgs.prev_offset, img8.data, img8.step * img8.height);
-printf("write1\n");
-        if(log_file) printf(" Image sent: %d bytes.\n", data_amount);
+    EpErrorCode result = ERR_SUCCESS;
 
-        if(img7.width < window_width || img7.height < window_height) break;
-        ep_img_list_add(&imgs, img7.step, img7.width, img7.height);
-        if(log_file) { printf("Sending image %dx%d...", img7.width, img7.height); fflush(stdout); }
-printf("write!\n");
-		data_amount = e_write(&e->emem, 0, 0,  offsetof(EpDRAMBuf, imgs_buf) + imgs.prev_offset, img7.data, img7.step * img7.height);
-printf("write2\n");
-        if(log_file) printf(" Image sent: %d bytes.\n", data_amount);
+    for(int image_number = 0; image_number < images_count; ++image_number) {
+        EpImage *const image = images + image_number;
+        if(image->width < window_width || image->height < window_height)
+            continue; //Image is too small; no detections
 
-        if(img6.width < window_width || img6.height < window_height) break;
-        ep_img_list_add(&imgs, img6.step, img6.width, img6.height);
-        if(log_file) { printf("Sending image %dx%d...", img6.width, img6.height); fflush(stdout); }
-printf("write!\n");
-		data_amount = e_write(&e->emem, 0, 0, offsetof(EpDRAMBuf, imgs_buf) + imgs.prev_offset, img6.data, img6.step * img6.height);
-printf("write3\n");
-        if(log_file) printf(" Image sent: %d bytes.\n", data_amount);
+        int const first_level = imgs.count;
 
-        if(img5.width < window_width || img5.height < window_height) break;
-        ep_img_list_add(&imgs, img5.step, img5.width, img5.height);
-        if(log_file) { printf("Sending image %dx%d...", img5.width, img5.height); fflush(stdout); }
-printf("write!\n");
-		data_amount = e_write(&e->emem, 0, 0,offsetof(EpDRAMBuf, imgs_buf) + imgs.prev_offset, img5.data, img5.step * img5.height);
-printf("write4\n");
-        if(log_file) printf(" Image sent: %d bytes.\n", data_amount);
-
-        time_start_scale = cvGetTickCount();
-        scale21_realloc(&img8);
-        scale21_realloc(&img7);
-        scale21_realloc(&img6);
-        scale21_realloc(&img5);
+        //Levels computed by cores are not allocated on host
+        EpImage octave[4];
+        if( get_octave_levels(workspace, image, !device_pyramid, octave) ) {
+            result = ERR_MEMORY;
+            break;
+        }
+        EpImage img8 = octave[0], img7 = octave[1], img6 = octave[2], img5 = octave[3];
+        //Level 0 borrowed from caller is not overwritten: its first reduction goes into workspace
+        unsigned char *const level0_buffer = workspace ? workspace->levels[0].data : NULL;
+
+        trace_begin = ep_trace_begin();
+        int64 time_start_scale = cvGetTickCount();
+        int offset_x, offset_y;
+        if(device_pyramid) {
+            offset_x = (img8.width  % 8) / 2;
+            offset_y = (img8.height % 8) / 2;
+        } else
+            scale8765(&img8, &img7, &img6, &img5, &offset_x, &offset_y);
         time_scale += (cvGetTickCount() - time_start_scale) / cvGetTickFrequency();
+        ep_trace_end("scale pyramid", trace_begin);
+
+        if(device_pyramid) {
+            add_device_pyramid_levels(&imgs, &img8, window_width, window_height);
+            if(log_file) { printf("Sending image %dx%d (level 0 only)...", img8.width, img8.height); fflush(stdout); }
+            data_amount = imgs.cur_offset > e->imgs_buf_size ? 0 :
+                send_image_data(e, imgs.data, &img8);
+            if(log_file) printf(" Image sent: %d bytes.\n", data_amount);
+        }
+
+        //Levels below scale range are only scaled further; pyramid is not built beyond it
+        int level = 0;
+        while( !device_pyramid ) {
+            if(img8.width < window_width || img8.height < window_height || level >= levels_end) break;
+            if(level++ >= levels_first) {
+                ep_img_list_add(&imgs, round_up_to_8n(img8.width), img8.width, img8.height);
+                if(log_file) { printf("Sending image %dx%d...", img8.width, img8.height); fflush(stdout); }
+                if(log_file) printf("write!\n");
+                data_amount = send_image_level(e, &imgs, &img8, tile_major_levels);
+                if(log_file) printf("write1\n");
+                if(log_file) printf(" Image sent: %d bytes.\n", data_amount);
+            }
+
+            if(img7.width < window_width || img7.height < window_height || level >= levels_end) break;
+            if(level++ >= levels_first) {
+                ep_img_list_add(&imgs, round_up_to_8n(img7.width), img7.width, img7.height);
+                if(log_file) { printf("Sending image %dx%d...", img7.width, img7.height); fflush(stdout); }
+                if(log_file) printf("write!\n");
+                data_amount = send_image_level(e, &imgs, &img7, tile_major_levels);
+                if(log_file) printf("write2\n");
+                if(log_file) printf(" Image sent: %d bytes.\n", data_amount);
+            }
+
+            if(img6.width < window_width || img6.height < window_height || level >= levels_end) break;
+            if(level++ >= levels_first) {
+                ep_img_list_add(&imgs, round_up_to_8n(img6.width), img6.width, img6.height);
+                if(log_file) { printf("Sending image %dx%d...", img6.width, img6.height); fflush(stdout); }
+                if(log_file) printf("write!\n");
+                data_amount = send_image_level(e, &imgs, &img6, tile_major_levels);
+                if(log_file) printf("write3\n");
+                if(log_file) printf(" Image sent: %d bytes.\n", data_amount);
+            }
+
+            if(img5.width < window_width || img5.height < window_height || level >= levels_end) break;
+            if(level++ >= levels_first) {
+                ep_img_list_add(&imgs, round_up_to_8n(img5.width), img5.width, img5.height);
+                if(log_file) { printf("Sending image %dx%d...", img5.width, img5.height); fflush(stdout); }
+                if(log_file) printf("write!\n");
+                data_amount = send_image_level(e, &imgs, &img5, tile_major_levels);
+                if(log_file) printf("write4\n");
+                if(log_file) printf(" Image sent: %d bytes.\n", data_amount);
+            }
+
+            trace_begin = ep_trace_begin();
+            time_start_scale = cvGetTickCount();
+            scale21_level(&img8, level0_buffer);
+            scale21_level(&img7, NULL);
+            scale21_level(&img6, NULL);
+            scale21_level(&img5, NULL);
+            time_scale += (cvGetTickCount() - time_start_scale) / cvGetTickFrequency();
+            ep_trace_end("scale pyramid", trace_begin);
+        }
+
+        for(int i = first_level; i < imgs.count && i < MAX_IMGS_COUNT; ++i) {
+            EpLevelSource const source = {image_number, levels_first + i - first_level, offset_x, offset_y};
+            sources[i] = source;
+        }
+
+        if(!workspace) {
+            ep_image_release(&img5);
+            ep_image_release(&img6);
+            ep_image_release(&img7);
+            ep_image_release(&img8);
+        }
+    }
+    ep_trace_end("upload images", trace_upload);
+
+    if(result || imgs.cur_offset > e->imgs_buf_size || imgs.count > MAX_IMGS_COUNT) {
+        //Pyramid does not fit shared memory of core group
+        if(log_file && !result)
+            printf("Pyramid (%d bytes, %d levels) does not fit images buffer (%d bytes).\n", imgs.cur_offset, imgs.count, e->imgs_buf_size);
+        if(tile_major_levels)
+            for(int i = 0; i < imgs.count && i < MAX_IMGS_COUNT; ++i)
+                ep_image_release(tile_major_levels + i);
+        e_close(&e->edev);
+        e_free(&e->emem);
+        release_cores(device, cores_group);
+        put_images_list(workspace, &imgs);
+        return ERR_MEMORY;
     }
 
-    if(log_file) { printf("Sending image properties..."); fflush(stdout); }
-printf("write!\n");
-	data_amount = e_write(&e->emem, 0, 0,offsetof(EpDRAMBuf, imgs_prop), imgs.data, imgs.count * sizeof(EpImageProp));
-printf("write5\n");
-    if(log_file) printf(" Data sent: %d bytes.\n", data_amount);
+    //Task list and images properties of previous frame are reused if they are still in shared memory
+    int cached = 0;
+    if( frame_cache && frame_cache->id && !memcmp(&frame_cache->key, &frame_key, sizeof(EpFrameKey)) &&
+        frame_cache->imgs.count == imgs.count &&
+        !memcmp(frame_cache->imgs.data, imgs.data, imgs.count * sizeof(EpImageProp)) ) {
+        int uploaded_cache_id;
+        e_read(&e->emem, 0, 0, offsetof(EpDRAMBuf, control_info) + offsetof(EpControlInfo, cache_id),
+            &uploaded_cache_id, sizeof(int));
+        cached = uploaded_cache_id == frame_cache->id;
+    }
+    int const cache_id = !frame_cache ? 0 : cached ? frame_cache->id : next_unique_id(device);
+
+    if(cached) {
+        if(log_file) printf("Image properties are cached.\n");
+    } else {
+        if(log_file) { printf("Sending image properties..."); fflush(stdout); }
+        if(log_file) printf("write!\n");
+        data_amount = e_write(&e->emem, 0, 0,offsetof(EpDRAMBuf, imgs_prop), imgs.data, imgs.count * sizeof(EpImageProp));
+        if(log_file) printf("write5\n");
+        if(log_file) printf(" Data sent: %d bytes.\n", data_amount);
+    }
 
     //    1.2 - copy classifier
+    trace_begin = ep_trace_begin();
     if(log_file) { printf("Sending classifier..."); fflush(stdout); }
-printf("write!\n");
-	data_amount = e_write(&e->emem, 0, 0, offsetof(EpDRAMBuf, buf_classifier), classifier->data, round_up_to_8n(classifier->size));
-printf("write6\n");
+    int classifier_bytes, classifier_back_bytes = 0;
+    if(back_cores) {
+        //Front part: the first stages terminated with final node
+        classifier_bytes = send_classifier_part(e, offsetof(EpDRAMBuf, buf_classifier), classifier->data, pipeline_split);
+
+        //Back part: meta node followed by the rest of stages
+        e_write(&e->emem, 0, 0, offsetof(EpDRAMBuf, buf_classifier_back), classifier->data, sizeof(EpNodeMeta));
+        e_write(&e->emem, 0, 0, offsetof(EpDRAMBuf, buf_classifier_back) + sizeof(EpNodeMeta),
+            classifier->data + pipeline_split, classifier->size - pipeline_split);
+        classifier_back_bytes = round_up_to_8n(sizeof(EpNodeMeta) + classifier->size - pipeline_split);
+        data_amount = classifier_bytes + classifier_back_bytes;
+    } else if(classifier_pages) {
+        //Resident part: meta node and the first stages; pages: the rest of stages
+        classifier_bytes = send_classifier_part(e, offsetof(EpDRAMBuf, buf_classifier), classifier->data, page_splits[0]);
+        data_amount = classifier_bytes;
+        for(int i = 0; i < classifier_pages; ++i)
+            data_amount += send_classifier_part(e, offsetof(EpDRAMBuf, buf_classifier_pages) + i * CLASSIFIER_PAGE_BYTES,
+                classifier->data + page_splits[i], page_splits[i + 1] - page_splits[i]);
+    } else {
+        if(log_file) printf("write!\n");
+        data_amount = e_write(&e->emem, 0, 0, offsetof(EpDRAMBuf, buf_classifier), classifier->data, classifier->size);
+        if(log_file) printf("write6\n");
+        classifier_bytes = round_up_to_8n(classifier->size);
+    }
     if(log_file) printf(" Classifier sent: %d bytes.\n", data_amount);
+    if(log_file && classifier_pages)
+        printf("Classifier is paged: %d resident bytes, %d pages.\n", classifier_bytes, classifier_pages);
+    ep_trace_end("upload classifier", trace_begin);
 
-    //    1.3 - build task list
+    //    1.3 - build task list (or take it from frame cache)
     EpTaskList tasks = ep_task_list_create_empty();
+    double gap_pyramid_order = 0.0, gap_cost_order = 0.0;
+
+    if(cached) {
+        tasks = frame_cache->tasks;
+        gap_pyramid_order = frame_cache->gap_pyramid_order;
+        gap_cost_order    = frame_cache->gap_cost_order;
+    } else {
+        trace_begin = ep_trace_begin();
+        float const depth_ratio = binding->depth_ratio;
+
+        for(int i = 0; i < imgs.count; ++i) {
+            //Level is detected one wave after it is computed
+            int const wave = device_pyramid ? get_level_wave(i) : -1;
+            if(wave >= 0)
+                add_scale_tasks(&imgs, i, sources[0].offset_x, sources[0].offset_y, wave, &tasks);
+
+            //Window rejected by the first stage costs one unit; window passed it is charged the whole cascade
+            float const survival = level_stats && i < level_stats->count ? level_stats->survival[i] : 0.0f;
+            float const cost_weight = 1.0f + survival * (depth_ratio - 1.0f);
+            add_tasks_for_image(scan_mode, &imgs, i, window_width, window_height, cost_weight, wave + 1, &tasks);
+        }
+
+        //    1.4 - longest tasks go first, so no large tile is left for the end
+        if(log_file) gap_pyramid_order = estimate_finish_gap(&tasks, front_cores);
+        qsort(tasks.data, tasks.count, sizeof(EpTaskItem), compare_tasks_by_cost);
+        resolve_task_waves(&tasks);
+        if(log_file) gap_cost_order = estimate_finish_gap(&tasks, front_cores);
+        ep_trace_end("build tasks", trace_begin);
+    }
 
-    for(int i = 0; i < imgs.count; ++i)
-        add_tasks_for_image(scan_mode, &imgs, i, window_width, window_height, &tasks);
+    //    1.5 - tile-major layout: tiles are uploaded contiguously in task order
+    trace_begin = ep_trace_begin();
+    int const pyramid_bytes = imgs.cur_offset;
+    int images_bytes = device_pyramid ? imgs.data[0].step * imgs.data[0].height : pyramid_bytes;
+    if(tile_major_levels) {
+        unsigned char *tile_buf = NULL;
+        int const tile_bytes = build_tile_major_buf(&tasks, tile_major_levels, e->imgs_buf_size, &tile_buf);
+        if(tile_bytes >= 0) {
+            if(log_file) { printf("Sending tiles..."); fflush(stdout); }
+            data_amount = e_write(&e->emem, 0, 0, offsetof(EpDRAMBuf, imgs_buf), tile_buf, tile_bytes);
+            if(log_file) printf(" Tiles sent: %d bytes (pyramid is %d bytes).\n", data_amount, pyramid_bytes);
+            images_bytes = tile_bytes;
+        } else {
+            //Tiles do not fit shared buffer: tasks still refer to pyramid layout
+            if(log_file) printf("Tile-major layout does not fit shared buffer; sending pyramid.\n");
+            for(int i = 0; i < imgs.count; ++i)
+                e_write(&e->emem, 0, 0, offsetof(EpDRAMBuf, imgs_buf) + imgs.data[i].data_offset,
+                    tile_major_levels[i].data, tile_major_levels[i].step * tile_major_levels[i].height);
+        }
+        free(tile_buf);
+        for(int i = 0; i < imgs.count; ++i)
+            ep_image_release(tile_major_levels + i);
+    }
 
-    EpControlInfo control_info = {tasks.count, 0, 0, num_cores, 0};
+    //Task chunks are sized by number of cores taking tasks
+    EpControlInfo control_info = {tasks.count, 0, 0, num_cores, 0, front_cores, 0, back_cores, 0, 0, 0, 0,
+                                  classifier_bytes, classifier_back_bytes, classifier_pages, cache_id};
+
+    int results_sequence[MAX_RESULT_BLOCKS];
+    for(int i = 0; i < MAX_RESULT_BLOCKS; ++i)
+        results_sequence[i] = i;
+    e_write(&e->emem, 0, 0, offsetof(EpDRAMBuf, results_sequence), results_sequence, sizeof(results_sequence));
+
+    if(back_cores) {
+        int survivors_sequence[MAX_SURVIVOR_BLOCKS];
+        for(int i = 0; i < MAX_SURVIVOR_BLOCKS; ++i)
+            survivors_sequence[i] = i;
+        e_write(&e->emem, 0, 0, offsetof(EpDRAMBuf, survivors_sequence), survivors_sequence, sizeof(survivors_sequence));
+        if(log_file) printf("Stage pipeline: %d front cores, %d back cores; back cores start at byte %d of classifier.\n",
+            front_cores, back_cores, pipeline_split);
+    }
 
+    if(cached) {
+        //Cores write task back only if it has detections, so only these counters are stale
+        int const zero = 0;
+        int reset_count = 0;
+        for(int i = 0; i < tasks.count; ++i)
+            if(tasks.data[i].items_count) {
+                tasks.data[i].items_count = 0;
+                e_write(&e->emem, 0, 0, offsetof(EpDRAMBuf, tasks) + i * sizeof(EpTaskItem) + offsetof(EpTaskItem, items_count),
+                    &zero, sizeof(int));
+                ++reset_count;
+            }
+        if(log_file) printf("Task list is cached: %d detection counters reset.\n", reset_count);
+    } else {
     if(log_file) { printf("Sending task list..."); fflush(stdout); }
 	data_amount = e_write(&e->emem, 0, 0, offsetof(EpDRAMBuf, tasks), tasks.data, tasks.count * sizeof(EpTaskItem));
     if(log_file) printf(" Task list sent: %u bytes.\n", data_amount);
+    }
+
+    //Runs of finished tasks are recorded from zero state (@see harvest_finished_tasks())
+    int finished_runs[tasks.count];
+    memset(finished_runs, 0, sizeof(finished_runs));
+    e_write(&e->emem, 0, 0, offsetof(EpDRAMBuf, finished_runs), finished_runs, sizeof(finished_runs));
 
     if(log_file) { printf("Sending control flags..."); fflush(stdout); }
 	data_amount = e_write(&e->emem, 0, 0, offsetof(EpDRAMBuf, control_info), &control_info, sizeof(EpControlInfo));
     if(log_file) printf(" Data sent: %u bytes.\n", data_amount);
+    ep_trace_end("upload tasks", trace_begin);
 
     
 
@@ -1705,40 +3536,82 @@ if(log_file) { printf("WAITING FOR CORES TO FINISH..."); fflush(stdout); }
     // 2 - wait end of detection
     
         e_read(&e->emem, 0, 0, offsetof(EpDRAMBuf, control_info), &control_info, sizeof(EpControlInfo));
-        printf("unused: %d, start_cores: %d, task_finished: %d, tasks.count: %d\n",control_info.unused, control_info.start_cores, control_info.task_finished,tasks.count); 
+        if(log_file)
+            printf("num_cores: %d, start_cores: %d, task_finished: %d, tasks.count: %d\n",control_info.num_cores, control_info.start_cores, control_info.task_finished,tasks.count); 
+#ifdef DEVICE_EMULATION
+    emulator_stats_reset();
+#endif//DEVICE_EMULATION
 	//e_start(&e->edev, 0, 0);
+	double const trace_cores_start = ep_trace_begin();
 	e_start_group(&e->edev);
 	int64 const time_start_waiting = cvGetTickCount();
-#ifndef DEVICE_EMULATION
+
+    //Results of finished tasks and blocks of results ring are harvested and processed while other tasks are running
+    char finished_tasks[tasks.count];
+    memset(finished_tasks, 0, sizeof(finished_tasks));
+    int runs_read = 0, harvested = 0, harvested_bytes = 0, results_read = 0, drained_blocks = 0;
+    EpResultBlock result_blocks[MAX_RESULT_BLOCKS];
+    EpTimerBuf timers[MAX_CORES_NUM];
     while(1) {
         e_read(&e->emem, 0, 0, offsetof(EpDRAMBuf, control_info), &control_info, sizeof(EpControlInfo));
-        if(control_info.task_finished == tasks.count)
+        //Back cores of stage pipeline finish after survivors queue is drained; every core writes its timer last
+        int const cores_finished = control_info.task_finished == tasks.count && control_info.back_finished == back_cores &&
+                                   download_timers(e, timers, num_cores, frame_id);
+        //Cores send their last result blocks just before timers, so write cursor is read again
+        if(cores_finished)
+            e_read(&e->emem, 0, 0, offsetof(EpDRAMBuf, control_info), &control_info, sizeof(EpControlInfo));
+
+        int const harvest_start = harvested;
+        harvested_bytes += harvest_finished_tasks(e, &tasks, finished_tasks, &runs_read, &harvested, control_info.task_finished);
+        int const drained = drain_result_blocks(e, result_blocks, &results_read, control_info.results_written, &harvested_bytes);
+        drained_blocks += drained;
+        if(harvested > harvest_start || drained) {
+            trace_begin = ep_trace_begin();
+            int const first_new = objects->count;
+            process_results(objects, &tasks, harvest_start, harvested, result_blocks, drained, window_width, window_height, sources);
+            stream_results(results_stream, objects, first_new);
+            ep_trace_end("process results", trace_begin);
+        }
+
+        //The last runs may be recorded a bit later than they are counted in task_finished
+        if(cores_finished && harvested == tasks.count && results_read == control_info.results_written)
             break;
-        //printf("unused: %d, start_cores: %d, task_finished: %d, tasks.count: %d\n",control_info.unused, control_info.start_cores, control_info.task_finished,tasks.count); 
-        //sleep(1);
+#ifdef DEVICE_EMULATION
+        emulator_host_pause();
+#endif//DEVICE_EMULATION
     }
-#else //DEVICE_EMULATION
-    device_process_tasks();
+#ifdef DEVICE_EMULATION
+    emulator_wait_cores(&e->edev);
 #endif//DEVICE_EMULATION
 
     double const wait_time = (cvGetTickCount() - time_start_waiting) / cvGetTickFrequency();
+    ep_trace_end("wait cores", trace_cores_start);
 
     if(log_file) printf(" CORES FINISHED IN %lf SECONDS.\n", wait_time / 1000000);
-
-    if(log_file) { printf("Downloading results..."); fflush(stdout); }
-    // 3 - download result and analyze detections
-	data_amount = e_read(&e->emem, 0, 0, offsetof(EpDRAMBuf, tasks), tasks.data, sizeof(EpTaskItem)* tasks.count);
-    if(log_file) printf(" Results downloaded: %d bytes.\n", data_amount);
-    process_results(objects, &tasks, &imgs, window_width, window_height, offset_x, offset_y);
-
-    // 4 - download timers values
+    if(log_file) printf("Results harvested while cores were working: %d bytes (%d blocks of results ring).\n",
+        harvested_bytes, drained_blocks);
+
+    // 3 - collect statistics for cost model of the next frame
+    if(level_stats)
+        update_level_stats(level_stats, &tasks, imgs.count, window_width, window_height);
+
+    // 4 - download task traces and timers values
+    EpTaskTrace *traces = NULL;
+    if(log_file || ep_trace_enabled()) {
+        trace_begin = ep_trace_begin();
+        traces = (EpTaskTrace*)malloc(tasks.count * sizeof(EpTaskTrace));
+        if(traces) {
+            data_amount = e_read(&e->emem, 0, 0, offsetof(EpDRAMBuf, traces), traces, tasks.count * sizeof(EpTaskTrace));
+            if(log_file) printf("Task traces downloaded: %d bytes.\n", data_amount);
+            trace_device_tasks(&tasks, traces, timers, num_cores, frame_id, trace_cores_start);
+        }
+        ep_trace_end("download traces", trace_begin);
+    }
     if(log_file) {
-        printf("Downloading timers..."); fflush(stdout);
-        EpTimerBuf timers[num_cores];
-		data_amount = e_read(&e->emem, 0, 0, offsetof(EpDRAMBuf, timers), timers, sizeof(EpTimerBuf)* num_cores);
-        printf(" Timers downloaded: %d bytes.\n", data_amount);
-        time_log(log_file, time_scale, wait_time, num_cores, timers);
+        printf("Timers downloaded: %d bytes.\n", (int)sizeof(EpTimerBuf) * num_cores);
+        time_log(log_file, time_scale, wait_time, num_cores, timers, gap_pyramid_order, gap_cost_order, pyramid_bytes, images_bytes, &control_info, &imgs, &tasks, traces, frame_id);
     }
+    free(traces);
 
 
 
@@ -1757,17 +3630,175 @@ if(log_file) { printf("WAITING FOR CORES TO FINISH..."); fflush(stdout); }
 
 	e_close(&e->edev);
 	e_free(&e->emem);
-	e_finalize();
+	release_cores(device, cores_group);
+
+
+
+    if(frame_cache) {
+        //Cache keeps task list with detection counters of this frame (they are reset on the next one)
+        if(!cached) {
+            ep_frame_cache_release(frame_cache);
+            frame_cache->key  = frame_key;
+            frame_cache->id   = cache_id;
+            frame_cache->imgs = imgs;
+            frame_cache->gap_pyramid_order = gap_pyramid_order;
+            frame_cache->gap_cost_order    = gap_cost_order;
+            if(workspace)
+                workspace->imgs = ep_img_list_create_empty(0); //List is taken over by cache
+        } else
+            put_images_list(workspace, &imgs);
+        frame_cache->tasks = tasks;
+    } else {
+        ep_task_list_release(&tasks);
+        put_images_list(workspace, &imgs);
+    }
 
+    return ERR_SUCCESS;
+}
 
+/**
+ * Multiscale object detection
+ *
+ * Image is iteratively scaled down until it became less than native object size.
+ * On each scale detection is performed.
+ *
+ * @param image     : Image to process (pointer to valid image structure).
+ * @param classifier: Classifier to use (pointer to valid classifier structure).
+ * @param objects   : Detections will be added to this list (pointer to valid rectangles list structure).
+ * @param scan_mode : Which image pixels to test; @see EpScanMode.
+ * @param num_cores : Number of cores in cores list.
+ * @param device_flags: Combination of EpDeviceFlags.
+ * @param log_file  : Name of log file. Pass NULL to disable log file and debug output.
+ * @param level_stats: Per-level statistics of previous frame used to estimate task costs
+ *                    (may be NULL). Updated with statistics of this frame on success.
+ * @param frame_cache: Task list and images properties of previous frame of the same stream (may be NULL).
+ *                    They are reused if frame parameters are the same; otherwise cache is refilled.
+ * @param device    : Opened chip (@see ep_device_open()).
+ * @param group     : Group of cores to run detection on; NULL to use the whole chip.
+ * @param results_stream: Receiver of detections harvested while cores are working (may be NULL).
+ *
+ * @return ERR_SUCCESS: successful detection;
+ *         ERR_ARGUMENT: empty image, or invalid classifier, or unknown detection_mode, or unknown scan_mode,
+ *                       or num_cores is out of [1, MAX_CORES_NUM] range or exceeds number of group cores,
+ *                       or unknown or incompatible device_flags, or DEVICE_STAGE_PIPELINE with single core
+ *                       or compact classifier, or NULL device, or invalid group, or group sharing memory region
+ *                       with group running on other cores.
+ *         ERR_MEMORY: image pyramid does not fit shared memory of group,
+ *                     or workspace buffers (pyramid levels, images list) cannot be allocated.
+ *         ERR_OTHER: classifier cannot be paged (stage is larger than CLASSIFIER_PAGE_BYTES, or more than MAX_CLASSIFIER_PAGES
+ *                    pages are needed, or classifier is compact), or any of its parts for DEVICE_STAGE_PIPELINE
+ *                    does not fit core memory.
+ */
+EpErrorCode ep_detect_multi_scale_device (
+    EpImage                   *const image,
+    EpCascadeClassifier const *const classifier,
+    EpRectList                *const objects,
+    EpScanMode                 const scan_mode,
+    int                        const num_cores,
+    int                        const device_flags,
+    char                const *const log_file,
+    EpLevelStats              *const level_stats,
+    EpFrameCache              *const frame_cache,
+    EpDevice                  *const device,
+    EpDeviceGroup       const *const group,
+    EpResultsStream     const *const results_stream,
+    EpWorkspace               *const workspace
+) {
+    return detect_device_images (
+        image, 1, classifier, objects, scan_mode, num_cores, device_flags, log_file,
+        level_stats, frame_cache, device, group, results_stream, NULL, workspace
+    );
+}
 
-    ep_task_list_release(&tasks);
-    ep_img_list_release(&imgs);
+/**
+ * Count levels of image pyramid and their size in shared memory (levels are listed as by ep_detect_multi_scale_device).
+ * @param image        : source image;
+ * @param window_width : detection window width;
+ * @param window_height: detection window height;
+ * @param levels_first : index of the first level to count;
+ * @param levels_end   : index of the level after the last one to count;
+ * @param bytes        : receives size of counted levels in bytes.
+ * @return number of counted levels.
+ */
+static int get_pyramid_size (
+    EpImage const *const image,
+    int            const window_width,
+    int            const window_height,
+    int            const levels_first,
+    int            const levels_end,
+    int           *const bytes
+) {
+    EpImgList img_list = ep_img_list_create_empty(0);
+    if(image->width >= window_width && image->height >= window_height)
+        add_device_pyramid_levels(&img_list, image, window_width, window_height);
+
+    int count = 0;
+    *bytes = 0;
+    for(int i = levels_first; i < img_list.count && i < levels_end; ++i) {
+        *bytes += img_list.data[i].step * img_list.data[i].height;
+        ++count;
+    }
+    ep_img_list_release(&img_list);
+    return count;
+}
 
-    ep_image_release(&img5);
-    ep_image_release(&img6);
-    ep_image_release(&img7);
-    ep_image_release(&img8);
+EpErrorCode ep_detect_batch_device (
+    EpImage                   *const images,
+    int                        const images_count,
+    EpCascadeClassifier const *const classifier,
+    EpRectList                *const objects,
+    EpScanMode                 const scan_mode,
+    int                        const num_cores,
+    int                        const device_flags,
+    char                const *const log_file,
+    EpDevice                  *const device,
+    EpDeviceGroup       const *const group,
+    EpScaleRange        const *const scale_range,
+    EpWorkspace               *const workspace
+) {
+    //Classifier is bound once for all runs
+    EpCascadeClassifier local_classifier;
+    EpCascadeClassifier const *const bound_classifier = get_bound_classifier(classifier, &local_classifier);
+    if( bound_classifier->binding.check )
+        return ERR_ARGUMENT; //Wrong classifier
+
+    if(images_count < 0 || (device_flags & DEVICE_PYRAMID))
+        return ERR_ARGUMENT; //Scale tasks are built for pyramid of single image
+
+    int levels_first, levels_end;
+    if( get_levels_in_range(scale_range, &levels_first, &levels_end) )
+        return ERR_ARGUMENT; //Wrong scale range
+
+    int const window_width = ((EpNodeMeta const *)classifier->data)->window_width ,
+             window_height = ((EpNodeMeta const *)classifier->data)->window_height;
+
+    int const imgs_buf_size = (group ? group->dram_size : (int)sizeof(EpDRAMBuf)) - (int)offsetof(EpDRAMBuf, imgs_buf);
+
+    //Images are packed into runs while their pyramids fit images buffer and images properties
+    int first = 0;
+    while(first < images_count) {
+        int levels = 0, bytes = 0, end = first;
+        for(; end < images_count; ++end) {
+            int image_bytes;
+            int const image_levels = get_pyramid_size(images + end, window_width, window_height, levels_first, levels_end, &image_bytes);
+            if(end > first && (levels + image_levels > MAX_IMGS_COUNT || bytes + image_bytes > imgs_buf_size))
+                break;
+            levels += image_levels;
+            bytes  += image_bytes;
+        }
+
+        if(log_file) printf("Batch run: images %d-%d, %d levels, %d bytes.\n", first, end - 1, levels, bytes);
+
+        //Cores are not started for images without levels in scale range
+        EpErrorCode const result = !levels ? ERR_SUCCESS : detect_device_images (
+            images + first, end - first, bound_classifier, objects + first, scan_mode, num_cores, device_flags, log_file,
+            NULL, NULL, device, group, NULL, scale_range, workspace
+        );
+        if(result)
+            return result;
+
+        first = end;
+    }
 
     return ERR_SUCCESS;
 }
@@ -1776,9 +3807,12 @@ EpErrorCode ep_detect_multi_scale_host (
     EpImage                   *const image,
     EpCascadeClassifier const *const classifier,
     EpRectList                *const objects,
-    EpScanMode                 const scan_mode
+    EpScanMode                 const scan_mode,
+    EpResultsStream     const *const results_stream,
+    EpWorkspace               *const workspace
 ) {
-    if( ep_classifier_check(classifier) )
+    EpCascadeClassifier local_classifier;
+    if( get_bound_classifier(classifier, &local_classifier)->binding.check )
         return ERR_ARGUMENT; //Wrong classifier
 
     if( ep_image_is_empty(image) )
@@ -1790,51 +3824,224 @@ EpErrorCode ep_detect_multi_scale_host (
     if(image->width < window_width || image->height < window_height)
         return ERR_SUCCESS; //Image is too small; no detections
 
-    int const blocks_x = image->width  / 8,
-              blocks_y = image->height / 8;
-
-    EpImage img8 = *image;
-    EpImage img7 = ep_image_create(blocks_x * 7, blocks_y * 7);
-    EpImage img6 = ep_image_create(blocks_x * 6, blocks_y * 6);
-    EpImage img5 = ep_image_create(blocks_x * 5, blocks_y * 5);
-
-    *image = ep_image_create_empty();
+    EpImage octave[4];
+    if( get_octave_levels(workspace, image, 1, octave) )
+        return ERR_MEMORY;
+    EpImage img8 = octave[0], img7 = octave[1], img6 = octave[2], img5 = octave[3];
+    //Level 0 borrowed from caller is not overwritten: its first reduction goes into workspace
+    unsigned char *const level0_buffer = workspace ? workspace->levels[0].data : NULL;
 
+    double trace_begin = ep_trace_begin();
     int offset_x, offset_y;
     scale8765(&img8, &img7, &img6, &img5, &offset_x, &offset_y);
+    ep_trace_end("scale pyramid", trace_begin);
 
-    int image_index = 0;
+    int image_index = 0, first_new;
     float scale;
 
     while(1) {
         if(img8.width < window_width || img8.height < window_height) break;
         scale = convert_image_index_to_scale(image_index    );
+        trace_begin = ep_trace_begin();
+        first_new = objects->count;
         detect_single_scale_host(&img8, classifier, objects, scale, offset_x, offset_y, scan_mode);
+        ep_trace_end("detect level", trace_begin);
+        stream_results(results_stream, objects, first_new);
 
         if(img7.width < window_width || img7.height < window_height) break;
         scale = convert_image_index_to_scale(image_index + 1);
+        trace_begin = ep_trace_begin();
+        first_new = objects->count;
         detect_single_scale_host(&img7, classifier, objects, scale, offset_x, offset_y, scan_mode);
+        ep_trace_end("detect level", trace_begin);
+        stream_results(results_stream, objects, first_new);
 
         if(img6.width < window_width || img6.height < window_height) break;
         scale = convert_image_index_to_scale(image_index + 2);
+        trace_begin = ep_trace_begin();
+        first_new = objects->count;
         detect_single_scale_host(&img6, classifier, objects, scale, offset_x, offset_y, scan_mode);
+        ep_trace_end("detect level", trace_begin);
+        stream_results(results_stream, objects, first_new);
 
         if(img5.width < window_width || img5.height < window_height) break;
         scale = convert_image_index_to_scale(image_index + 3);
+        trace_begin = ep_trace_begin();
+        first_new = objects->count;
         detect_single_scale_host(&img5, classifier, objects, scale, offset_x, offset_y, scan_mode);
+        ep_trace_end("detect level", trace_begin);
+        stream_results(results_stream, objects, first_new);
 
-        scale21(&img8, &img8);
-        scale21(&img7, &img7);
-        scale21(&img6, &img6);
-        scale21(&img5, &img5);
+        trace_begin = ep_trace_begin();
+        scale21_level(&img8, level0_buffer);
+        scale21_level(&img7, NULL);
+        scale21_level(&img6, NULL);
+        scale21_level(&img5, NULL);
+        ep_trace_end("scale pyramid", trace_begin);
 
         image_index += 4;
     }
 
-    ep_image_release(&img5);
-    ep_image_release(&img6);
-    ep_image_release(&img7);
-    ep_image_release(&img8);
+    if(!workspace) {
+        ep_image_release(&img5);
+        ep_image_release(&img6);
+        ep_image_release(&img7);
+        ep_image_release(&img8);
+    }
+
+    return ERR_SUCCESS;
+}
+
+/**
+ * Batch detection on host of at most BATCH_CHUNK_IMAGES images (@see ep_detect_batch_host).
+ *   State of images is kept in fixed arrays, so batch of any size is detected without variable length arrays.
+ * @param images      : Images to process (valid and non-empty).
+ * @param images_count: Number of images, in [1, BATCH_CHUNK_IMAGES] range.
+ * @param levels_first: First pyramid level to scan.
+ * @param levels_end  : Pyramid level to stop at.
+ * @param workspaces  : Working sets, one per image (may be NULL).
+ */
+static EpErrorCode detect_batch_chunk_host (
+    EpImage                   *const images,
+    int                        const images_count,
+    EpCascadeClassifier const *const classifier,
+    EpRectList                *const objects,
+    EpScanMode                 const scan_mode,
+    int                        const levels_first,
+    int                        const levels_end,
+    EpWorkspace               *const workspaces
+) {
+    int const window_width = ( (EpNodeMeta const *)classifier->data )->window_width ,
+             window_height = ( (EpNodeMeta const *)classifier->data )->window_height;
+
+    //Current octave of every image; image stays active while its pyramid continues
+    EpImage octaves[BATCH_CHUNK_IMAGES][4];
+    unsigned char *level0_buffers[BATCH_CHUNK_IMAGES];
+    int offsets_x[BATCH_CHUNK_IMAGES], offsets_y[BATCH_CHUNK_IMAGES], levels_count[BATCH_CHUNK_IMAGES];
+    char created[BATCH_CHUNK_IMAGES], active[BATCH_CHUNK_IMAGES];
+    //Bands of octave level j of image i are numbered from bands_first[i * 4 + j] to bands_first[i * 4 + j + 1]
+    int bands_first[BATCH_CHUNK_IMAGES * 4 + 1];
+    int const levels_slots = images_count * 4;
+
+    EpErrorCode result = ERR_SUCCESS;
+    for(int i = 0; i < images_count; ++i) {
+        created[i] = active[i] = 0;
+        if(images[i].width < window_width || images[i].height < window_height)
+            continue; //Image is too small; no detections
+        if( get_octave_levels(workspaces ? workspaces + i : NULL, images + i, 1, octaves[i]) ) {
+            result = ERR_MEMORY;
+            break;
+        }
+        level0_buffers[i] = workspaces ? workspaces[i].levels[0].data : NULL;
+        created[i] = active[i] = 1;
+    }
+
+    double trace_begin = ep_trace_begin();
+    #pragma omp parallel for schedule(dynamic)
+    for(int i = 0; i < images_count; ++i)
+        if(active[i] && result == ERR_SUCCESS)
+            scale8765(octaves[i], octaves[i] + 1, octaves[i] + 2, octaves[i] + 3, offsets_x + i, offsets_y + i);
+    ep_trace_end("scale pyramid", trace_begin);
+
+    //Octaves of all images are scanned together: bands of rows of their levels are work items of one loop,
+    //so small images do not leave threads idle and no parallel region is started per level
+    int image_index = 0;
+    while(result == ERR_SUCCESS) {
+        int bands_count = 0, levels_total = 0;
+        for(int i = 0; i < images_count; ++i) {
+            levels_count[i] = 0;
+            for(int j = 0; j < 4; ++j) {
+                bands_first[i * 4 + j] = bands_count;
+                if(!active[i] || image_index + j >= levels_end) continue;
+                EpImage const *const level = octaves[i] + j;
+                if(level->width < window_width || level->height < window_height || levels_count[i] < j) continue;
+                //Levels below scale range are only scaled further
+                if(image_index + j >= levels_first)
+                    bands_count += divide_up(level->height + 1 - window_height, BATCH_BAND_ROWS);
+                levels_count[i] = j + 1;
+            }
+            levels_total += levels_count[i];
+        }
+        bands_first[levels_slots] = bands_count;
+        if(!levels_total) break;
+
+        trace_begin = ep_trace_begin();
+        #pragma omp parallel for schedule(dynamic)
+        for(int k = 0; k < bands_count; ++k) {
+            //Level of band is the last one whose bands start at or before it (levels without bands are skipped)
+            int first = 0, end = levels_slots;
+            while(end - first > 1) {
+                int const middle = (first + end) / 2;
+                if(bands_first[middle] <= k) first = middle;
+                else                         end   = middle;
+            }
+            int const i = first / 4, j = first % 4, y = (k - bands_first[first]) * BATCH_BAND_ROWS;
+            detect_band_host (
+                octaves[i] + j, classifier, objects + i, convert_image_index_to_scale(image_index + j),
+                offsets_x[i], offsets_y[i], scan_mode, y, y + BATCH_BAND_ROWS
+            );
+        }
+        ep_trace_end("detect octave", trace_begin);
+
+        //Pyramid of image is finished at its first level smaller than window or beyond scale range
+        trace_begin = ep_trace_begin();
+        #pragma omp parallel for schedule(dynamic)
+        for(int i = 0; i < images_count; ++i) {
+            active[i] = active[i] && levels_count[i] == 4;
+            if(active[i]) {
+                scale21_level(octaves[i]    , level0_buffers[i]);
+                scale21_level(octaves[i] + 1, NULL);
+                scale21_level(octaves[i] + 2, NULL);
+                scale21_level(octaves[i] + 3, NULL);
+            }
+        }
+        ep_trace_end("scale pyramid", trace_begin);
+
+        image_index += 4;
+    }
+
+    if(!workspaces)
+        for(int i = 0; i < images_count; ++i)
+            if(created[i])
+                for(int j = 0; j < 4; ++j)
+                    ep_image_release(octaves[i] + j);
+
+    return result;
+}
+
+EpErrorCode ep_detect_batch_host (
+    EpImage                   *const images,
+    int                        const images_count,
+    EpCascadeClassifier const *const classifier,
+    EpRectList                *const objects,
+    EpScanMode                 const scan_mode,
+    EpScaleRange        const *const scale_range,
+    EpWorkspace               *const workspaces
+) {
+    EpCascadeClassifier local_classifier;
+    if( get_bound_classifier(classifier, &local_classifier)->binding.check )
+        return ERR_ARGUMENT; //Wrong classifier
+
+    if(images_count < 0)
+        return ERR_ARGUMENT; //Wrong images count
+
+    int levels_first, levels_end;
+    if( get_levels_in_range(scale_range, &levels_first, &levels_end) )
+        return ERR_ARGUMENT; //Wrong scale range
+
+    for(int i = 0; i < images_count; ++i)
+        if( ep_image_is_empty(images + i) )
+            return ERR_ARGUMENT; //Wrong image
+
+    //Chunks reuse the same working sets
+    for(int first = 0; first < images_count; first += BATCH_CHUNK_IMAGES) {
+        int const count = images_count - first < BATCH_CHUNK_IMAGES ? images_count - first : BATCH_CHUNK_IMAGES;
+        EpErrorCode const result = detect_batch_chunk_host (
+            images + first, count, classifier, objects + first, scan_mode, levels_first, levels_end, workspaces
+        );
+        if(result != ERR_SUCCESS)
+            return result;
+    }
 
     return ERR_SUCCESS;
 }
@@ -22,7 +22,7 @@
 #ifndef EP_CASCADE_DETECTOR
 #define EP_CASCADE_DETECTOR
 
-
+#include <pthread.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -216,25 +216,31 @@ EpTaskList ep_task_list_create_empty(void);
 /**
  * Add item to tasks list.
  * @param task_list: pointer to valid rectangles list;
- * @param area       : tile area (must be  width * step)
+ * @param offset     : offset of tile source data in shared images buffer
+ * @param origin     : position of tile in image (x | y << 16)
  * @param width      : width of tile
  * @param height     : height of tile
  * @param step       : step in tile (must be round_up_to8(width))
+ * @param src_step   : step of tile source data in shared images buffer
  * @param scan_mode  : Scan mode of pixels (even pixels, odd pixels, or all pixels)
  * @param items_count: count of detected items (must be 0)
  * @param image_index: index of processing image
+ * @param cost       : estimated processing cost of the tile
  * @return ERR_SUCCESS on success;
  *         ERR_MEMORY on memory allocation failure.
  */
 EpErrorCode ep_task_list_add (
     EpTaskList *const task_list,
-    int area,
+    int offset,
+    int origin,
     int width,
     int height,
     int step,
+    int src_step,
     int scan_mode,
     int items_count,
-    int image_index
+    int image_index,
+    int cost
 );
 
 /**
@@ -252,6 +258,34 @@ EpErrorCode ep_task_list_reserve(EpTaskList *const task_list, int const count);
  * @param task_list: pointer to valid task list.
  */
 void ep_task_list_release(EpTaskList *const task_list);
+
+/**
+ * Create empty per-level statistics (no previous frame).
+ */
+EpLevelStats ep_level_stats_create_empty(void);
+
+/**
+ * Create empty frame cache (no previous frame).
+ */
+EpFrameCache ep_frame_cache_create_empty(void);
+
+/**
+ * Release data hold by frame cache.
+ * After calling this function cache is empty and will be filled by the next frame.
+ * @param frame_cache: pointer to valid frame cache.
+ */
+void ep_frame_cache_release(EpFrameCache *const frame_cache);
+
+/**
+ * Create empty working set of detection (buffers are allocated by the first detection).
+ */
+EpWorkspace ep_workspace_create_empty(void);
+
+/**
+ * Release buffers hold by working set of detection.
+ * @param workspace: pointer to valid working set.
+ */
+void ep_workspace_release(EpWorkspace *const workspace);
 ////////////////////////////////////////////////////////////////////////////////
 //                          CLASSIFIER FUNCTIONS                              //
 ////////////////////////////////////////////////////////////////////////////////
@@ -284,6 +318,13 @@ int ep_classifier_check(EpCascadeClassifier const *const classifier);
  */
 EpCascadeClassifier ep_classifier_clone(EpCascadeClassifier const *const classifier);
 
+/**
+ * Compute data derived from classifier (@see EpClassifierBinding). Functions creating classifiers
+ *   call it themselves; it is needed only after classifier data is filled or changed by other means.
+ * @param classifier: pointer to classifier structure; its binding is updated.
+ */
+void ep_classifier_bind(EpCascadeClassifier *const classifier);
+
 /**
  * Calculate classifier checksum for debug purpose.
  *   Classifiers with the same data will get the same checksums,
@@ -294,6 +335,23 @@ EpCascadeClassifier ep_classifier_clone(EpCascadeClassifier const *const classif
  */
 int ep_classifier_checksum(EpCascadeClassifier const *const classifier);
 
+/**
+ * Convert classifier into compact encoding (@see EpCompactHeader).
+ *   Features and subsets are stored in deduplicated tables referenced by 16-bit indices,
+ *   stage boundaries are stored as decision counts. Scores and thresholds are kept exact,
+ *   so compact classifier gives the same results as the original one (@see EpCompactDecision).
+ *   Compact classifiers are accepted by both detection functions, but are not paged or split
+ *   between cores (@see ep_detect_multi_scale_device()).
+ * @param classifier: pointer to valid classifier structure which is not compact yet.
+ * @param error_code: pointer to integer value which will receive the error code.
+ *                  If this pointer is NULL then no error code is stored.
+ *     Error codes: ERR_SUCCESS -- success;
+ *                  ERR_ARGUMENT -- invalid or already compact classifier, or classifier is too large for 16-bit indices;
+ *                  ERR_MEMORY -- cannot allocate memory buffer.
+ * @return compact classifier. Empty classifier is returned in case of any error.
+ */
+EpCascadeClassifier ep_classifier_compact(EpCascadeClassifier const *const classifier, EpErrorCode *const error_code);
+
 /**
  * Save classifier to binary file.
  * @param classifier: pointer to valid classifier structure.
@@ -331,23 +389,99 @@ void ep_classifier_release(EpCascadeClassifier *const classifier);
 //                          MAIN DETECTION FUNCTION                           //
 ////////////////////////////////////////////////////////////////////////////////
 
+/**
+ * Chip opened for device detection (@see ep_device_open()). Everything device detections share lives here:
+ *   cores and shared memory regions owned by running detections, and identifiers of frames and frame caches.
+ *   The chip (and the emulated chip) is one per process, so it may be opened only once, and the handle
+ *   is passed to every device detection. Detections on disjoint groups of cores run at the same time;
+ *   detections sharing any core are serialised: each waits until the previous one gives back the cores.
+ *   Fields are private to the library.
+ */
+typedef struct {
+    /// Protects fields below
+    pthread_mutex_t mutex;
+    /// Signalled when running detection gives back its cores
+    pthread_cond_t released;
+    /// Cores owned by running detections, one bit per core (row * COLS + col)
+    unsigned int busy_cores;
+    /// Groups of running detections; their cores are disjoint, and so must be their shared memory regions
+    EpDeviceGroup running[MAX_CORES_NUM];
+    int running_count;
+    /// Last identifier given to frame or frame cache (@see EpFrameCache, EpTaskTrace)
+    int last_id;
+} EpDevice;
+
+/**
+ * Open chip for device detection: eHAL is initialised here, once, instead of on every detection.
+ * @param device: receives handle of opened chip.
+ * @return ERR_SUCCESS on success; ERR_OTHER if chip is already opened (and not closed yet)
+ *         or eHAL cannot be initialised.
+ */
+EpErrorCode ep_device_open(EpDevice *const device);
+
+/**
+ * Close chip opened by ep_device_open() and finalize eHAL. Detections still running on the device are
+ *   waited for; no detection may be started during or after the call. Chip may be opened again then.
+ * @param device: handle of opened chip.
+ */
+void ep_device_close(EpDevice *const device);
+
+/**
+ * Split chip into equal groups of cores, e.g. 4 groups of 2x2 cores to serve 4 video streams.
+ *   Every group gets equal part of shared memory, so images buffer of group is smaller than MAX_IMGS_BUF.
+ *   Different groups may run ep_detect_multi_scale_device() concurrently from different host threads.
+ * @param group_rows: number of core rows in every group; must divide number of chip rows.
+ * @param group_cols: number of core columns in every group; must divide number of chip columns.
+ * @param groups    : receives groups; must have space for MAX_CORES_NUM groups.
+ * @return number of groups; zero if chip cannot be split into such groups.
+ */
+int ep_device_groups_create(int const group_rows, int const group_cols, EpDeviceGroup *const groups);
+
 /**
  * Multiscale object detection
  *
  * Image is iteratively scaled down until it became less than native object size.
  * On each scale detection is performed.
+ * Classifier larger than MAX_CLASSIFIER_BYTES is paged: cores keep its first stages resident and load
+ * the later stages on demand for batches of windows passed the first ones.
  *
- * @param image     : Image to process (pointer to valid image structure). Image contents is modified during detection!
+ * @param image     : Image to process (pointer to valid image structure). Without workspace image contents
+ *                    is modified during detection!
  * @param classifier: Classifier to use (pointer to valid classifier structure).
  * @param objects   : Detections will be added to this list (pointer to valid rectangles list structure).
  * @param scan_mode : Which image pixels to test; @see EpScanMode.
  * @param num_cores : Number of cores to use.
+ * @param device_flags: Combination of EpDeviceFlags.
  * @param log_file  : Name of time-log file (if 0  then time logging is off).
+ * @param level_stats: Per-level statistics of previous frame used to estimate task costs
+ *                    (may be NULL). Updated with statistics of this frame on success.
+ * @param frame_cache: Task list and images properties of previous frame of the same stream (may be NULL).
+ *                    They are reused if frame parameters are the same; otherwise cache is refilled.
+ * @param device    : Opened chip (@see ep_device_open()).
+ * @param group     : Group of cores to run detection on (@see ep_device_groups_create());
+ *                    NULL to use the whole chip. Only cores and shared memory of the group are used and reset,
+ *                    so other groups may run detection at the same time. Detections started by other threads
+ *                    on cores of the group (e.g. on the whole chip) are waited for; group whose shared memory
+ *                    region overlaps region of a group running on other cores is rejected.
+ * @param results_stream: Receiver of detections (may be NULL). Results of finished tasks are harvested while
+ *                    other tasks are still running and passed to it as soon as they are added to objects list;
+ *                    detections which did not fit into task items are added after cores finish.
+ *                    Order of objects is the same as without receiver.
+ * @param workspace : Working set kept between calls (may be NULL). If it is given then image is borrowed
+ *                    read-only and scanned in place (it may have any step, e.g. region of larger image),
+ *                    otherwise image is consumed by detection.
  *
  * @return ERR_SUCCESS : successful detection;
- *         ERR_ARGUMENT: empty image, or invalid classifier, or unknown detection_mode, or unknown scan_mode.
- *         ERR_MEMORY  : cannot allocate required memory (memory checks are not implemented yet).
- *         ERR_OTHER  : classifier is too large and cannot be uploaded to core.
+ *         ERR_ARGUMENT: empty image, or invalid classifier, or unknown detection_mode, or unknown scan_mode,
+ *                       or num_cores is out of [1, MAX_CORES_NUM] range or exceeds number of group cores,
+ *                       or unknown or incompatible device_flags, or DEVICE_STAGE_PIPELINE with single core
+ *                       or compact classifier, or NULL device, or invalid group, or group sharing memory region
+ *                       with group running on other cores.
+ *         ERR_MEMORY  : image pyramid does not fit shared memory of group,
+ *                       or workspace buffers (pyramid levels, images list) cannot be allocated.
+ *         ERR_OTHER  : classifier cannot be paged (stage is larger than CLASSIFIER_PAGE_BYTES, or more than MAX_CLASSIFIER_PAGES
+ *                      pages are needed, or classifier is compact), or any of its parts for DEVICE_STAGE_PIPELINE
+ *                      does not fit core memory.
  */
 EpErrorCode ep_detect_multi_scale_device (
     EpImage                   *const image,
@@ -355,14 +489,109 @@ EpErrorCode ep_detect_multi_scale_device (
     EpRectList                *const objects,
     EpScanMode                 const scan_mode,
     int                        const num_cores,
-    char                const *const log_file
+    int                        const device_flags,
+    char                const *const log_file,
+    EpLevelStats              *const level_stats,
+    EpFrameCache              *const frame_cache,
+    EpDevice                  *const device,
+    EpDeviceGroup       const *const group,
+    EpResultsStream     const *const results_stream,
+    EpWorkspace               *const workspace
 );
 
+/**
+ * Multiscale object detection on host (@see ep_detect_multi_scale_device).
+ *
+ * @param image     : Image to process (pointer to valid image structure). Without workspace image contents
+ *                    is modified during detection!
+ * @param classifier: Classifier to use (pointer to valid classifier structure).
+ * @param objects   : Detections will be added to this list (pointer to valid rectangles list structure).
+ * @param scan_mode : Which image pixels to test; @see EpScanMode.
+ * @param results_stream: Receiver of detections (may be NULL). Detections of every pyramid level are passed
+ *                    to it as soon as the level is scanned.
+ * @param workspace : Working set kept between calls (may be NULL). If it is given then image is borrowed
+ *                    read-only and scanned in place (it may have any step, e.g. region of larger image),
+ *                    otherwise image is consumed by detection.
+ *
+ * @return ERR_SUCCESS : successful detection;
+ *         ERR_ARGUMENT: empty image, or invalid classifier.
+ *         ERR_MEMORY  : cannot allocate workspace buffers.
+ */
 EpErrorCode ep_detect_multi_scale_host (
     EpImage                   *const image,
     EpCascadeClassifier const *const classifier,
     EpRectList                *const objects,
-    EpScanMode                 const scan_mode
+    EpScanMode                 const scan_mode,
+    EpResultsStream     const *const results_stream,
+    EpWorkspace               *const workspace
+);
+
+/**
+ * Multiscale object detection of many images on device (@see ep_detect_multi_scale_device).
+ *   Images are packed into runs of cores: pyramids of all images of a run are uploaded together
+ *   (while they fit images buffer and MAX_IMGS_COUNT levels), and their tiles share one task list.
+ *
+ * @param images      : Images to process (array of valid image structures).
+ * @param images_count: Number of images.
+ * @param classifier  : Classifier to use (pointer to valid classifier structure).
+ * @param objects     : Detections of every image will be added to its list (array of images_count lists).
+ * @param scan_mode   : Which image pixels to test; @see EpScanMode.
+ * @param num_cores   : Number of cores to use.
+ * @param device_flags: Combination of EpDeviceFlags except DEVICE_PYRAMID.
+ * @param log_file    : Name of time-log file (if 0  then time logging is off).
+ * @param device      : Opened chip (@see ep_device_open()).
+ * @param group       : Group of cores to run detection on; NULL to use the whole chip (@see ep_detect_multi_scale_device).
+ * @param scale_range : Scales to detect (may be NULL for all scales). Levels out of range are neither scanned
+ *                      nor uploaded, so more images fit one run.
+ * @param workspace   : Working set shared by all images (may be NULL). If it is given then images are borrowed
+ *                      read-only, otherwise they are consumed by detection.
+ *
+ * @return ERR_SUCCESS on successful detection of all images; otherwise error of the first failed run
+ *         (@see ep_detect_multi_scale_device), or ERR_ARGUMENT for negative images_count or DEVICE_PYRAMID.
+ */
+EpErrorCode ep_detect_batch_device (
+    EpImage                   *const images,
+    int                        const images_count,
+    EpCascadeClassifier const *const classifier,
+    EpRectList                *const objects,
+    EpScanMode                 const scan_mode,
+    int                        const num_cores,
+    int                        const device_flags,
+    char                const *const log_file,
+    EpDevice                  *const device,
+    EpDeviceGroup       const *const group,
+    EpScaleRange        const *const scale_range,
+    EpWorkspace               *const workspace
+);
+
+/**
+ * Multiscale object detection of many images on host (@see ep_detect_multi_scale_host).
+ *   Images are detected in chunks of BATCH_CHUNK_IMAGES. Pyramid octaves of all images of chunk are scanned
+ *   together: bands of BATCH_BAND_ROWS rows of all their levels are scheduled as work items of one thread pool loop.
+ *
+ * @param images      : Images to process (array of valid image structures).
+ * @param images_count: Number of images.
+ * @param classifier  : Classifier to use (pointer to valid classifier structure).
+ * @param objects     : Detections of every image will be added to its list (array of images_count lists).
+ * @param scan_mode   : Which image pixels to test; @see EpScanMode.
+ * @param scale_range : Scales to detect (may be NULL for all scales). Levels smaller than range are scaled
+ *                      but not scanned; pyramid is not built beyond the largest scale.
+ * @param workspaces  : Working sets, one per image of chunk: min(images_count, BATCH_CHUNK_IMAGES) of them
+ *                      (may be NULL). If they are given then images are borrowed read-only, otherwise they are
+ *                      consumed by detection.
+ *
+ * @return ERR_SUCCESS : successful detection;
+ *         ERR_ARGUMENT: empty image, or invalid classifier, or negative images_count.
+ *         ERR_MEMORY  : cannot allocate workspace buffers (images of previous chunks are already detected).
+ */
+EpErrorCode ep_detect_batch_host (
+    EpImage                   *const images,
+    int                        const images_count,
+    EpCascadeClassifier const *const classifier,
+    EpRectList                *const objects,
+    EpScanMode                 const scan_mode,
+    EpScaleRange        const *const scale_range,
+    EpWorkspace               *const workspaces
 );
 
 #ifdef __cplusplus
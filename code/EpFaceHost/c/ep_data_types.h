@@ -14,12 +14,18 @@
 typedef enum {
     /// Size of Epiphany memory bank in bytes.
     BANK_SIZE = 8192,
-    /// Recommended vertical and horizontal size of tile used to detect objects.
-    /// Tiles are overlapped in order to not miss detections at edges
-    RECOMMENDED_TILE_SIZE = 128,
-    /// Maximal allowed detections per tile. If more will be detected then some detections will be discarded
+    /// Address of EpCoreBank1 in core memory (EpCoreBank2 and EpCoreBank3 follow it)
+    CORE_BANK1_ADDRESS = 0x2000,
+    /// Estimated fixed cost of one detection task (taking task item, starting DMA, writing result back)
+    /// expressed in transferred bytes. Tile planner weighs it against overlap of tiles, which are
+    /// overlapped in order to not miss detections at edges
+    TASK_OVERHEAD_BYTES = 1024,
+    /// Maximal detections stored inside task item. If more will be detected then the rest is sent
+    /// to shared results ring (@see EpResultBlock).
     /// Must be even value because transmitted data size is rounded up to the nearest 64 bits boundary
     MAX_DETECTIONS_PER_TILE = 16,
+    /// Detections which did not fit into task items are sent to shared results ring in blocks of this size
+    MAX_RESULTS_PER_BLOCK = 16,
     /// Classifier should occupy less than one memory bank; some space is reserved for stack.
     /// This value must be dividible by 8
     MAX_CLASSIFIER_BYTES = BANK_SIZE - 512,
@@ -30,7 +36,32 @@ typedef enum {
     /// Core frequency in MHz to convert tics to seconds
     CORE_FREQUENCY = 400,
     /// Timer divisor to prevent unsigned int overflow of total core time
-    TIMER_VALUE_SHIFT = 7
+    TIMER_VALUE_SHIFT = 7,
+    /// Guided scheduling: core reserves (remaining tasks) / (TASK_CHUNK_DIVISOR * cores) tasks at once
+    TASK_CHUNK_DIVISOR = 2,
+    /// Maximal number of tasks reserved by core at once
+    MAX_TASK_CHUNK = 8,
+    /// Pyramid computed by cores: maximal width and height of source region scaled by single task.
+    /// Must be dividible by 8
+    SCALE_TILE_SIZE = 512,
+    /// Pyramid computed by cores: number of produced pixels which cost as much as one scanned window
+    SCALE_PIXELS_PER_COST = 16,
+    /// Stage pipeline: number of classifier stages run by front cores (more if the rest does not fit core memory)
+    PIPELINE_FRONT_STAGES = 3,
+    /// Stage pipeline: one of this number of cores runs later classifier stages (at least one core does)
+    PIPELINE_CORES_PER_BACK_CORE = 8,
+    /// Stage pipeline: windows passed front stages are sent to back cores in blocks of this size.
+    /// Must be even value because block size must be multiple of 8 bytes
+    MAX_SURVIVORS_PER_BLOCK = 62,
+    /// Classifier paging: size of core memory slot at the end of classifier buffer for stage page loaded on demand.
+    /// Resident part of paged classifier occupies the rest of MAX_CLASSIFIER_BYTES. Must be dividible by 8
+    CLASSIFIER_PAGE_BYTES = 3072,
+    /// Maximal number of classifier pages loaded on demand (@see CLASSIFIER_PAGE_BYTES)
+    MAX_CLASSIFIER_PAGES = 8,
+    /// Batch detection on host: number of level rows scanned by single work item (@see ep_detect_batch_host)
+    BATCH_BAND_ROWS = 16,
+    /// Batch detection on host: number of images whose octaves are scanned together (@see ep_detect_batch_host)
+    BATCH_CHUNK_IMAGES = 16
 } EpConstants1;
 
 /**
@@ -43,6 +74,35 @@ typedef enum {
     DET_DEVICE
 } EpDetectionMode;
 
+/**
+ * Device detection options (bit flags)
+ */
+typedef enum {
+    /// Pyramid is uploaded level by level; cores fetch tiles with strided DMA
+    DEVICE_DEFAULT    = 0,
+    /// Host uploads every tile (with its overlap) contiguously in task order;
+    /// cores fetch each tile with single linear DMA at the cost of duplicated overlaps
+    DEVICE_TILE_MAJOR = 1,
+    /// Host uploads only level 0 of pyramid; other levels are computed by cores
+    /// in waves of scaling tasks preceding detection tasks. Not compatible with DEVICE_TILE_MAJOR
+    DEVICE_PYRAMID    = 2,
+    /// Classifier is split between cores: front cores run the first stages on tiles and pass
+    /// windows which survived them to back cores holding the later stages. Needs at least 2 cores
+    DEVICE_STAGE_PIPELINE = 4
+} EpDeviceFlags;
+
+/**
+ * Kind of device task
+ */
+typedef enum {
+    /// Detect objects in tile
+    TASK_DETECT = 0,
+    /// Compute region of pyramid level 1, 2 or 3 (7/8, 6/8 or 5/8 of level 0) by 8x8 blocks of level 0
+    TASK_SCALE_BLOCKS,
+    /// Compute region of pyramid level as twice smaller level four positions before
+    TASK_SCALE_HALF
+} EpTaskKind;
+
 /**
  * Image scan mode
  */
@@ -109,12 +169,48 @@ typedef struct {
     int count;
 } EpRectList;
 
+/**
+ * Range of detection scales (object size divided by classifier window size; level 0 of pyramid has scale 1).
+ *   Pyramid levels with scale outside the range are not scanned (@see ep_detect_batch_host, ep_detect_batch_device).
+ */
+typedef struct {
+    /// Smallest and largest scale to detect
+    float min_scale, max_scale;
+} EpScaleRange;
+
+/**
+ * Data derived from classifier which every detection needs (@see ep_classifier_bind()).
+ *   It is computed once when classifier is created, so detections sharing classifier do not walk its nodes again.
+ */
+typedef struct {
+    /// Classifier data and size the binding is computed for; binding of other data is ignored
+    char const *data;
+    int size;
+    /// Result of ep_classifier_check()
+    int check;
+    /// Non-zero for compact encoding (@see ep_classifier_compact())
+    int compact;
+    /// Ratio of decision nodes of the whole cascade to decision nodes of its first stage (used by task cost model)
+    float depth_ratio;
+    /// Offset of the first node of back part for stage pipeline (@see DEVICE_STAGE_PIPELINE);
+    /// -1 if classifier cannot be split
+    int pipeline_split;
+    /// Number of pages of classifier larger than MAX_CLASSIFIER_BYTES (zero for smaller one);
+    /// -1 if classifier cannot be paged
+    int pages;
+    /// Offsets of the first node of every page; page_splits[pages] is offset of the final node
+    int page_splits[MAX_CLASSIFIER_PAGES + 1];
+} EpClassifierBinding;
+
 /**
  * Classifier is just binary buffer
  */
 typedef struct {
     char *data;
     int size;
+    /// Derived data computed by functions creating classifier. Classifier filled by other means
+    /// gets it from ep_classifier_bind(), otherwise it is derived again on every detection
+    EpClassifierBinding binding;
 } EpCascadeClassifier; 
 
 /**
@@ -128,7 +224,9 @@ typedef enum {
     /// End of classifier stage. Contains rule to reject object or go to the next stage
     NODE_STAGE = 1734440019,
     /// Last node of the classifier, meaning successful detection. May only go after the NODE_STAGE node
-    NODE_FINAL = 1819175238
+    NODE_FINAL = 1819175238,
+    /// Header of classifier in compact encoding (@see EpCompactHeader). Takes place of NODE_META
+    NODE_COMPACT = 1953525059
 } EpNodeType;
 
 /**
@@ -184,6 +282,48 @@ typedef struct {
     int id;
 } __attribute__((packed)) EpNodeFinal;
 
+/**
+ * Header of classifier in compact encoding. It is followed by tables:
+ *   stages (EpCompactStage), features (int, as in EpNodeDecision), decisions (EpCompactDecision)
+ *   and deduplicated subsets (int[8], as in EpNodeDecision). Every table starts at 8 bytes boundary.
+ * The first three fields are the same as in EpNodeMeta.
+ */
+typedef struct {
+    /// id == NODE_COMPACT for EpCompactHeader structure
+    int id;
+    /// Native width and height of detected objects in pixels.
+    int window_width, window_height;
+    /// Number of stages
+    int stages_count;
+    /// Offsets of features, decisions and subsets tables from the beginning of classifier
+    int features_offset, decisions_offset, subsets_offset;
+    int unused;
+} __attribute__((packed)) EpCompactHeader;
+
+/**
+ * Stage of classifier in compact encoding. Stage decisions follow decisions of the previous stage
+ */
+typedef struct {
+    /// If sum of stage decisions is less than this threshold then no detection is assumed
+    int threshold;
+    /// Number of decisions in stage
+    short decisions_count;
+    short unused;
+} __attribute__((packed)) EpCompactStage;
+
+/**
+ * Decision of classifier in compact encoding
+ */
+typedef struct {
+    /// Index in features table
+    short feature_index;
+    /// Index in subsets table
+    short subset_index;
+    /// Score for object if feature value is in subset. It is exact (as in EpNodeDecision),
+    /// so compact classifier gives the same results as the original one
+    int score;
+} __attribute__((packed)) EpCompactDecision;
+
 /**
  * Structure of timer
  */
@@ -192,14 +332,53 @@ typedef struct {
     unsigned int value;
     /// ID of current core
     unsigned int core_id;
+    /// Number of shared mutex acquisitions made by core during the frame
+    unsigned int lock_count;
+    /// Number of tasks processed by core during the frame (survivor blocks for back core of stage pipeline)
+    unsigned int task_count;
+    /// Number of times core had to wait for other cores (task dependencies or survivors queue)
+    unsigned int stall_count;
+    /// Non-zero if core ran later classifier stages (@see DEVICE_STAGE_PIPELINE)
+    unsigned int back_core;
+    /// Trace clock values when core started and finished processing (@see EpTaskTrace)
+    unsigned int start, stop;
+    /// Identifier of frame (@see EpCoreConfig). Core writes it after the rest of record is in shared memory,
+    /// so host reads timer only when it is written completely
+    int frame_id;
+    unsigned int unused;
 } __attribute__((packed)) EpTimerBuf;
 
+/**
+ * Timing of task processed by core. Times are cycles of core trace clock started when core starts processing tasks.
+ *   Record is valid for current frame only if frame_id matches frame identifier written by host into core config,
+ *   frame_id is written after the other fields.
+ */
+typedef struct {
+    /// ID of core which processed task
+    unsigned int core_id;
+    /// Identifier of frame which record belongs to (@see EpCoreConfig)
+    int frame_id;
+    /// Start of task item fetch
+    unsigned int start;
+    /// Task item is fetched and tasks it depends on are finished
+    unsigned int ready;
+    /// Tile is copied to core memory (DMA-in; same as ready for pyramid tasks)
+    unsigned int loaded;
+    /// Detection (or scaling) is finished
+    unsigned int processed;
+    /// Task item with detections is written back
+    unsigned int stop;
+    unsigned int unused;
+} __attribute__((packed)) EpTaskTrace;
+
 /**
  * Structure of task
  */
 typedef struct {
-    /// Offset of tile
+    /// Offset of tile source data in shared images buffer
     int offset;
+    /// Position of top-left tile corner in image (x | y << 16)
+    int origin;
     /// Tile width
     int width;
     /// Tile height
@@ -208,16 +387,62 @@ typedef struct {
     int area;
     /// Tile step
     int step;
+    /// Step of tile source data in shared images buffer
+    /// (image step, or tile step for tile-major layout)
+    int src_step;
     /// Scan mode of pixels (even pixels, odd pixels, or all pixels)
     int scan_mode;
     /// Count of objects
     int items_count;
     /// Index of processing image
     int image_index;
+    /// Estimated processing cost (scanned windows weighted by expected cascade depth)
+    int cost;
+    /// Kind of task (@see EpTaskKind)
+    int kind;
+    /// Task may be started only when this number of tasks is finished (all tasks of previous waves)
+    int dependency;
+    /// Number of windows which passed the first classifier stage (written back for every detection task)
+    int passed_windows;
     /// Detection result
     int objects[MAX_DETECTIONS_PER_TILE];
 } __attribute__((packed)) EpTaskItem;
 
+/**
+ * Detection which did not fit into task item (@see EpTaskItem)
+ */
+typedef struct {
+    /// Index of task the detection belongs to
+    int task_index;
+    /// Detection position relative to the tile (packed as in EpTaskItem)
+    int position;
+} __attribute__((packed)) EpResultItem;
+
+/**
+ * Block of detections which did not fit into task items. Core fills the block with detections of
+ * any of its tasks and writes it to shared results ring only when it is full, or when core finishes.
+ */
+typedef struct {
+    /// Count of detections in the block
+    int items_count;
+    int unused;
+    /// Detections
+    EpResultItem items[MAX_RESULTS_PER_BLOCK];
+} __attribute__((packed)) EpResultBlock;
+
+/**
+ * Block of windows which passed classifier stages of front core (@see DEVICE_STAGE_PIPELINE).
+ * Such blocks are passed to back cores through shared survivors queue.
+ */
+typedef struct {
+    /// Index of task (tile) the windows belong to
+    int task_index;
+    /// Count of windows in the block
+    int items_count;
+    /// Windows positions relative to the tile (x | y << 16) in scan order
+    int objects[MAX_SURVIVORS_PER_BLOCK];
+} __attribute__((packed)) EpSurvivorBlock;
+
 /**
  * List of tasks
  */
@@ -230,26 +455,75 @@ typedef struct {
     int count;
 } EpTaskList;
 
+/**
+ * Configuration of core written by host into core memory before cores are started
+ */
+typedef struct {
+    /// Offset of shared memory region of core group from the beginning of shared memory (@see EpDeviceGroup)
+    int dram_offset;
+    /// Identifier of current frame; marks task traces written by core during the frame (@see EpTaskTrace)
+    int frame_id;
+} __attribute__((packed)) EpCoreConfig;
+
 typedef enum {
     /// Maximal allowed memory occupied by tile -- 2 banks of Epiphany memory in this case
-    MAX_TILE_BYTES = BANK_SIZE * 2 - sizeof(EpTaskItem) - sizeof(EpTimerBuf) - 1024,
+    MAX_TILE_BYTES = BANK_SIZE * 2 - sizeof(EpCoreConfig) - sizeof(EpTaskItem) - sizeof(EpTimerBuf) - sizeof(EpResultBlock) - sizeof(EpSurvivorBlock) - 1024,
     /// Maximal allowed images count in scale pyramid
     MAX_IMGS_COUNT = 30,
     /// Maximal allowed memory occupied by pyramid
-    MAX_IMGS_BUF   = 16480000,
+    MAX_IMGS_BUF   = 16381440,
     /// Maximal cores count
     MAX_CORES_NUM  = 16,
     /// Maximal tasks count
-    MAX_TASK_BUF   = 2048
+    MAX_TASK_BUF   = 2048,
+    /// Capacity of shared results ring (in blocks). Host drains it while cores are working,
+    /// and core waits for a free slot if the ring is full, so no detection is lost
+    MAX_RESULT_BLOCKS = 64,
+    /// Capacity of shared survivors queue between front and back cores (in blocks)
+    MAX_SURVIVOR_BLOCKS = 64,
+    /// Size of shared memory available for regions of all core groups (@see EpDeviceGroup)
+    SHARED_DRAM_SIZE = 16777216
 } EpConstants2;
 
+/**
+ * Per-level statistics collected on previous frame and used by task cost model
+ */
+typedef struct {
+    /// Ratio of windows passed the first classifier stage to windows scanned on each pyramid level
+    float survival[MAX_IMGS_COUNT];
+    /// Number of levels with valid statistics (zero if there is no previous frame)
+    int count;
+} EpLevelStats;
+
+/**
+ * Group of cores which runs detection independently of other groups, e.g. one group per video stream.
+ *   Every group has its own region of shared memory laid out as EpDRAMBuf; region may be smaller than EpDRAMBuf
+ *   only at the expense of images buffer (imgs_buf is the last field of EpDRAMBuf).
+ */
 typedef struct {
+    /// Position of the first core of group on chip
+    int row, col;
+    /// Size of group in cores
+    int rows, cols;
+    /// Offset of shared memory region of group from the beginning of shared memory
+    int dram_offset;
+    /// Size of shared memory region of group in bytes
+    int dram_size;
+} EpDeviceGroup;
+
+typedef struct {
+    /// Core configuration (written by host)
+    EpCoreConfig config;
     /// Timer service info
     EpTimerBuf timer;
     /// Data structure for exchanging control data
     EpTaskItem task_item;
+    /// Detections which did not fit into task item are collected here before sending to results ring
+    EpResultBlock result_block;
+    /// Windows passed front classifier stages are collected here (front core), or received here (back core)
+    EpSurvivorBlock survivor_block;
     /// Begin of tile buffer
-    unsigned char buf_tile[BANK_SIZE - sizeof(EpTaskItem) - sizeof(EpTimerBuf)]; // First part of image data
+    unsigned char buf_tile[BANK_SIZE - sizeof(EpCoreConfig) - sizeof(EpTaskItem) - sizeof(EpTimerBuf) - sizeof(EpResultBlock) - sizeof(EpSurvivorBlock)]; // First part of image data
 } __attribute__((packed)) EpCoreBank1;
 
 typedef struct {
@@ -289,6 +563,79 @@ typedef struct {
     int prev_offset;
 } EpImgList;
 
+/**
+ * Source of pyramid level uploaded to shared memory. Levels of several images are uploaded
+ *   in one run by batch detection (@see ep_detect_batch_device), so level index in images list
+ *   is not level index in pyramid of its image.
+ */
+typedef struct {
+    /// Index of image in batch
+    int image;
+    /// Index of level in pyramid of the image (defines scale of detections)
+    int level;
+    /// Number of pixels of the image thrown away from left and top side by blocks reduction
+    int offset_x, offset_y;
+} EpLevelSource;
+
+/**
+ * Parameters of frame which define its task list and images properties (@see EpFrameCache)
+ */
+typedef struct {
+    /// Size of source image and step of level 0 in shared memory
+    int width, height, step;
+    /// Native size of classifier window
+    int window_width, window_height;
+    int scan_mode, device_flags, num_cores;
+    /// Offset of shared memory region of core group
+    int dram_offset;
+    /// Non-zero if task costs were estimated with statistics of previous frame
+    int with_stats;
+} EpFrameKey;
+
+/**
+ * Task list and images properties kept between frames of a fixed-resolution stream.
+ *   While frame parameters stay the same they are neither rebuilt nor uploaded again;
+ *   only detection counters of tasks which had detections are reset in shared memory.
+ *   Task order is taken from the frame which filled the cache.
+ */
+typedef struct {
+    EpFrameKey key;
+    /// Identifier of cached data; it is stored in control_info.cache_id while data is in shared memory.
+    /// Zero if cache is empty
+    int id;
+    /// Cached images properties
+    EpImgList imgs;
+    /// Cached task list (in upload order)
+    EpTaskList tasks;
+    /// Estimated finish gaps of cached task list (for time log)
+    double gap_pyramid_order, gap_cost_order;
+} EpFrameCache;
+
+/**
+ * Working set of detection kept between calls. Buffers of pyramid levels are allocated on the first call
+ *   and reused while image size stays the same, so repeated detection does not allocate them again.
+ */
+typedef struct {
+    /// Buffers of the first pyramid octave: level 0 reduced 2:1 (level 0 itself is borrowed from caller),
+    /// and levels scaled by 7/8, 6/8 and 5/8
+    EpImage levels[4];
+    /// Device detection: properties of uploaded pyramid levels; list keeps its buffer between calls
+    /// unless it is taken over by frame cache
+    EpImgList imgs;
+} EpWorkspace;
+
+/**
+ * Receiver of detections harvested while cores are still working (@see ep_detect_multi_scale_device),
+ *   or found on pyramid levels scanned so far (@see ep_detect_multi_scale_host).
+ */
+typedef struct {
+    /// Called from detecting thread every time new detections are added to objects list.
+    /// @param first_new: index of the first detection added since the previous call
+    void (*function)(EpRectList const *objects, int first_new, void *user_data);
+    /// Passed to function
+    void *user_data;
+} EpResultsStream;
+
 /**
  * Control memory structure.
  */
@@ -303,7 +650,28 @@ typedef struct {
     int start_cores;
     /// current index in timers queue
     int timer_index;
-    int unused;
+    /// number of working cores (used to size task chunks)
+    int num_cores;
+    /// write cursor of results ring (number of blocks ever reserved by cores)
+    int results_written;
+    /// number of cores running later classifier stages (@see DEVICE_STAGE_PIPELINE); zero if every core runs whole classifier
+    int back_cores;
+    /// number of cores which already took the back role
+    int back_started;
+    /// number of back cores which finished (survivors queue is drained)
+    int back_finished;
+    /// write cursor of survivors queue (number of blocks ever reserved by front cores)
+    int survivors_written;
+    /// read cursor of survivors queue (number of blocks ever claimed by back cores)
+    int survivors_taken;
+    /// size of classifier (resident part of paged classifier) in buf_classifier
+    int classifier_bytes;
+    /// size of classifier part in buf_classifier_back
+    int classifier_back_bytes;
+    /// number of classifier pages in buf_classifier_pages loaded on demand; zero if classifier is not paged
+    int classifier_pages;
+    /// identifier of frame cache which task list and images properties are in shared memory (@see EpFrameCache)
+    int cache_id;
 } __attribute__((packed)) EpControlInfo;
 
 typedef struct {
@@ -311,14 +679,36 @@ typedef struct {
     EpControlInfo control_info;
     /// Images properties
     EpImageProp   imgs_prop[MAX_IMGS_COUNT];
-    /// Classifier buffer
+    /// Classifier buffer (first stages of classifier for stage pipeline)
     char          buf_classifier[MAX_CLASSIFIER_BYTES];
-    /// Images buffer
-    unsigned char imgs_buf[MAX_IMGS_BUF];
+    /// Later stages of classifier for back cores of stage pipeline
+    char          buf_classifier_back[MAX_CLASSIFIER_BYTES];
+    /// Pages of classifier stages which do not fit core memory together with its resident part.
+    /// Every page is sequence of nodes terminated by NODE_FINAL
+    char          buf_classifier_pages[MAX_CLASSIFIER_PAGES][CLASSIFIER_PAGE_BYTES];
     /// Tasks list
     EpTaskItem    tasks[MAX_TASK_BUF];
+    /// Results ring for detections which did not fit into task items
+    EpResultBlock results[MAX_RESULT_BLOCKS];
+    /// State of results ring slots. For block number n stored in slot n % MAX_RESULT_BLOCKS:
+    ///   n -- slot is free for core, n + 1 -- block is ready for host,
+    ///   n + MAX_RESULT_BLOCKS -- block is drained by host and slot is free for the next block
+    int           results_sequence[MAX_RESULT_BLOCKS];
+    /// Survivors queue from front to back cores of stage pipeline
+    EpSurvivorBlock survivors[MAX_SURVIVOR_BLOCKS];
+    /// State of survivors queue slots. For block number n stored in slot n % MAX_SURVIVOR_BLOCKS:
+    ///   n -- slot is free for front core, n + 1 -- block is ready for back core,
+    ///   n + MAX_SURVIVOR_BLOCKS -- block is consumed and slot is free for the next block
+    int           survivors_sequence[MAX_SURVIVOR_BLOCKS];
+    /// Runs of finished tasks (first task | count << 16) indexed by value of control_info.task_finished before
+    ///   the run was reported. Host zeroes it before start and harvests results of runs while cores are working
+    int           finished_runs[MAX_TASK_BUF];
+    /// Timing of tasks of the frame (indexed as tasks)
+    EpTaskTrace   traces[MAX_TASK_BUF];
     /// Timers list
     EpTimerBuf    timers[MAX_CORES_NUM];
+    /// Images buffer. It goes last, so region of core group may be smaller than EpDRAMBuf (@see EpDeviceGroup)
+    unsigned char imgs_buf[MAX_IMGS_BUF];
 } __attribute__((packed)) EpDRAMBuf;
 
 #endif /* EP_DATA_TYPES_H */
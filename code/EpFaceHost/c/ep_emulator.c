@@ -22,35 +22,86 @@
 
 #ifdef DEVICE_EMULATION
 
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
 #include <opencv/cv.h>
 
 #include "ep_emulator.h"
+#include "ep_trace.h"
 
-EpCoreMemory core_memory;
-#define BANK1 (core_memory.bank1)
-#define BANK2 (core_memory.bank2)
-#define BANK3 (core_memory.bank3)
+/*
+ * Every emulated core runs in its own thread (@see e_start_group()),
+ * so pointer to core memory and everything else private to core is thread-local.
+ * Memory of chip is one per process like the real chip, so ep_device_open() allows only one open device.
+ */
+EpCoreMemory chip_memory[EMULATED_ROWS * EMULATED_COLS];
+static __thread EpCoreMemory *core_memory;
+#define BANK1 (&core_memory->bank1)
+#define BANK2 (&core_memory->bank2)
+#define BANK3 (&core_memory->bank3)
 
 EpDRAMMemory dram_memory;
 
+__thread EpEmulatorStats emulator_stats;
+
+/// Statistics of current core; added to statistics of its group when core finishes
+static __thread EpEmulatorStats core_stats;
+
+/// Cost model of device (@see emulator_model_set())
+static EpEmulatorModel emulator_model;
+static int emulator_model_enabled = 0;
+
+/// Statistics of current core when timer was started (used by cost model)
+static __thread EpEmulatorStats timer_stats;
+
+/// ID of current core
+static __thread unsigned int core_id = 2084;
+
+/// Group of current core
+static __thread e_epiphany_t *core_group;
+
+/// Groups of chip cores; set by e_start_group() before core threads are created
+static e_epiphany_t *chip_groups[EMULATED_ROWS * EMULATED_COLS];
+
 /**
- * @return pointer to shared memory buffer
+ * @return pointer to shared memory buffer of core group
  */
-static EpDRAMBuf *get_sram_origin() {
-    return (EpDRAMBuf*)&dram_memory;
+static EpDRAMBuf volatile *get_sram_origin() {
+    return (EpDRAMBuf*)((unsigned char *)&dram_memory + ((EpCoreBank1 *)BANK1)->config.dram_offset);
 }
 
 /**
- * global time counter
+ * Estimate cycles of operations counted in statistics with cost model.
+ * @return estimated cycles
  */
-int64 emulated_timer;
+static double model_cycles(EpEmulatorStats const *const stats) {
+    return stats->dma_descriptors  * emulator_model.dma_descriptor_cycles +
+           stats->dma_bytes        / emulator_model.dma_bytes_per_cycle +
+           stats->mutex_ops        * emulator_model.mutex_op_cycles +
+           stats->node_evaluations * emulator_model.node_cycles;
+}
+
+/**
+ * Time counter of current core
+ */
+static __thread struct timespec emulated_timer;
 
 /**
  * Start timer.
+ * Thread CPU time is measured, so emulated cores do not count time when host runs other cores.
+ * If cost model is enabled then operations counted by the timer stop are estimated instead.
  * @return start value of timer
  */
 static unsigned int start_timer() {
-    emulated_timer = cvGetTickCount();
+    if(emulator_model_enabled)
+        timer_stats = core_stats;
+    else
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &emulated_timer);
     return ~0;
 }
 
@@ -59,10 +110,44 @@ static unsigned int start_timer() {
  * @return stop value of timer
  */
 static unsigned int stop_timer() {
-    double const time = (cvGetTickCount() - emulated_timer) / cvGetTickFrequency();
+    if(emulator_model_enabled)
+        return ~((unsigned int)0) - cvRound(model_cycles(&core_stats) - model_cycles(&timer_stats));
+
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    double const time = (now.tv_sec - emulated_timer.tv_sec) * 1000000.0 + (now.tv_nsec - emulated_timer.tv_nsec) / 1000.0;
     return ~((unsigned int)0) - cvRound(time * CORE_FREQUENCY);
 }
 
+/**
+ * Start of trace clock of current core (@see EpTaskTrace)
+ */
+static __thread struct timespec trace_clock_origin;
+static __thread EpEmulatorStats trace_clock_stats;
+
+/**
+ * Start clock of task traces. Like timer it counts thread CPU time, or cycles estimated by cost model.
+ */
+static void start_trace_clock(void) {
+    if(emulator_model_enabled)
+        trace_clock_stats = core_stats;
+    else
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &trace_clock_origin);
+}
+
+/**
+ * @return cycles elapsed since start_trace_clock().
+ */
+static unsigned int get_trace_clock(void) {
+    if(emulator_model_enabled)
+        return cvRound(model_cycles(&core_stats) - model_cycles(&trace_clock_stats));
+
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    double const time = (now.tv_sec - trace_clock_origin.tv_sec) * 1000000.0 + (now.tv_nsec - trace_clock_origin.tv_nsec) / 1000.0;
+    return cvRound(time * CORE_FREQUENCY);
+}
+
 /**
  * Emulate DMA data transfer.
  * calls memcpy(dst, src, size)
@@ -73,9 +158,46 @@ static void dma_transfer (
     unsigned int         const size,
     int                  const wait
 ) {
+    ++core_stats.dma_descriptors;
+    core_stats.dma_bytes += size;
     memcpy( (void *)dst, (void const *)src, size );
 }
 
+/**
+ * Emulate 2D DMA data transfer issued with single descriptor.
+ * calls memcpy(dst, src, width) for each line
+ */
+static void dma_transfer_2d (
+    void       volatile *const dst,
+    void const volatile *const src,
+    unsigned int         const width,
+    unsigned int         const height,
+    unsigned int         const dst_step,
+    unsigned int         const src_step
+) {
+    ++core_stats.dma_descriptors;
+    ++core_stats.dma_strided;
+    core_stats.dma_bytes += width * height;
+    for(unsigned int line = 0; line < height; ++line)
+        memcpy( (unsigned char *)dst + line * dst_step, (unsigned char const *)src + line * src_step, width );
+}
+
+/**
+ * Pause inside busy-wait loop on shared variable.
+ * Gives host CPU to other emulated cores, which may be more than host CPUs.
+ */
+static void spin_pause(void) {
+    ++core_stats.spin_waits;
+    sched_yield();
+}
+
+/**
+ * Count evaluation of classifier node for cost model.
+ */
+static void count_node_evaluation(void) {
+    ++core_stats.node_evaluations;
+}
+
 /**
  * Increment shared variable
  * @param val pointer on variable for increment
@@ -83,10 +205,47 @@ static void dma_transfer (
  * @return unmodified (*val) value
  */
 static int atomic_increment(int volatile *const val, int const max_val) {
-
+    ++core_stats.mutex_ops;
+    pthread_mutex_lock(&core_group->mutex);
     int const cur_val = *val;
     if(cur_val < max_val)
         *val = cur_val + 1;
+    pthread_mutex_unlock(&core_group->mutex);
+
+    return cur_val;
+}
+
+/**
+ * Add value to shared variable
+ * @param val pointer on variable for increment
+ * @param add value to be added
+ * @param max_val max value of variable
+ * @return unmodified (*val) value
+ */
+static int atomic_add(int volatile *const val, int const add, int const max_val) {
+    ++core_stats.mutex_ops;
+    pthread_mutex_lock(&core_group->mutex);
+    int const cur_val = *val;
+    if(cur_val < max_val)
+        *val = cur_val + add < max_val ? cur_val + add : max_val;
+    pthread_mutex_unlock(&core_group->mutex);
+
+    return cur_val;
+}
+
+/**
+ * Decrement shared variable
+ * @param val pointer on variable for decrement
+ * @param min_val min value of variable
+ * @return unmodified (*val) value
+ */
+static int atomic_decrement(int volatile * const val, int const min_val) {
+    ++core_stats.mutex_ops;
+    pthread_mutex_lock(&core_group->mutex);
+    int const cur_val = *val;
+    if(cur_val > min_val)
+        *val = cur_val - 1;
+    pthread_mutex_unlock(&core_group->mutex);
 
     return cur_val;
 }
@@ -95,30 +254,190 @@ static int atomic_increment(int volatile *const val, int const max_val) {
 //Including actual core code
 #include "../../EpFaceCore_commonlib/src/device_routines.h"
 
-int e_open(char const *const eServIP, unsigned short const eServPort) {
-    return 0;
+void emulator_stats_reset(void) {
+    memset(&emulator_stats, 0, sizeof(emulator_stats));
 }
 
-int e_close() {
-    return 0;
+EpEmulatorModel emulator_model_create_default(void) {
+    //Rough figures for 400 MHz Epiphany-III: external memory latency is several hundreds of cycles,
+    //eLink gives about 200 MB/s to a core, mutex lives on the first core and guards variable in external memory
+    EpEmulatorModel const model = {
+        300.0, //dma_descriptor_cycles
+        0.5,   //dma_bytes_per_cycle
+        600.0, //mutex_op_cycles
+        30.0   //node_cycles
+    };
+    return model;
 }
 
-size_t e_read(void volatile const *const from_addr, void volatile *const buf, size_t const count) {
-    memcpy( (void *)buf, (void *)from_addr, count );
-    return count;
+void emulator_model_set(EpEmulatorModel const *model) {
+    emulator_model_enabled = model != NULL;
+    if(model)
+        emulator_model = *model;
 }
 
-size_t e_write(void volatile *const to_addr, const void volatile *const buf, size_t const count) {
-    memcpy( (void *)to_addr, (void *)buf, count );
+/**
+ * Add statistics of core or group to statistics of group or host thread.
+ */
+static void add_stats(EpEmulatorStats *const dst, EpEmulatorStats const *const src) {
+    dst->dma_descriptors  += src->dma_descriptors;
+    dst->dma_strided      += src->dma_strided;
+    dst->dma_bytes        += src->dma_bytes;
+    dst->spin_waits       += src->spin_waits;
+    dst->mutex_ops        += src->mutex_ops;
+    dst->node_evaluations += src->node_evaluations;
+    dst->model_cycles     += src->model_cycles;
+    if(src->model_max_core_cycles > dst->model_max_core_cycles)
+        dst->model_max_core_cycles = src->model_max_core_cycles;
+}
+
+/**
+ * Thread of emulated core. Like main() of device code, core takes part in detection
+ *   only if host requested it in control_info.start_cores.
+ * @param arg index of core on chip
+ */
+static void *emulated_core_main(void *const arg) {
+    int const index = (int)(size_t)arg;
+    core_memory = chip_memory + index;
+    core_group  = chip_groups[index];
+    core_id = e_coreid_origin() + ((index / EMULATED_COLS) << 6) + index % EMULATED_COLS;
+    memset(&core_stats, 0, sizeof(core_stats));
+    ((EpCoreBank1 *)BANK1)->timer.core_id = core_id;
+
+    if(atomic_decrement(&get_sram_origin()->control_info.start_cores, 0) > 0) {
+        double const trace_begin = ep_trace_begin();
+        device_process_tasks();
+        if(ep_trace_enabled()) {
+            char name[32];
+            sprintf(name, "core %d,%d", index / EMULATED_COLS, index % EMULATED_COLS);
+            ep_trace_thread_name(TRACE_EMULATOR, index, name);
+            ep_trace_span("process tasks", TRACE_EMULATOR, index, trace_begin, ep_trace_begin() - trace_begin, NULL);
+        }
+    }
+
+    if(emulator_model_enabled)
+        core_stats.model_cycles = core_stats.model_max_core_cycles = cvRound(model_cycles(&core_stats));
+
+    pthread_mutex_lock(&core_group->mutex);
+    add_stats(&core_group->stats, &core_stats);
+    pthread_mutex_unlock(&core_group->mutex);
+
+    return NULL;
+}
+
+int emulator_wait_cores(e_epiphany_t *dev) {
+    int const count = dev->threads_count;
+    for(int i = 0; i < dev->threads_count; ++i)
+        pthread_join(dev->threads[i], NULL);
+    dev->threads_count = 0;
+
+    add_stats(&emulator_stats, &dev->stats);
+    memset(&dev->stats, 0, sizeof(dev->stats));
     return count;
 }
 
+void emulator_host_pause(void) {
+    struct timespec const pause = {0, 100000};
+    nanosleep(&pause, NULL);
+}
+
+int e_init(char *hdf) {
+    return E_OK;
+}
+
+int e_reset_system(void) {
+    return E_OK;
+}
+
+int e_get_platform_info(e_platform_t *platform) {
+    platform->rows = EMULATED_ROWS;
+    platform->cols = EMULATED_COLS;
+    return E_OK;
+}
+
+int e_alloc(e_mem_t *mbuf, off_t base, size_t size) {
+    mbuf->objtype = E_EXT_MEM;
+    mbuf->base = base;
+    mbuf->size = size;
+    return base + size <= sizeof(dram_memory) ? E_OK : E_ERR;
+}
+
+int e_free(e_mem_t *mbuf) {
+    return E_OK;
+}
+
+int e_open(e_epiphany_t *dev, unsigned row, unsigned col, unsigned rows, unsigned cols) {
+    if(row + rows > EMULATED_ROWS || col + cols > EMULATED_COLS)
+        return E_ERR;
+    memset(dev, 0, sizeof(*dev));
+    dev->objtype = E_EPI_GROUP;
+    dev->row  = row;
+    dev->col  = col;
+    dev->rows = rows;
+    dev->cols = cols;
+    pthread_mutex_init(&dev->mutex, NULL);
+    return E_OK;
+}
+
+int e_close(e_epiphany_t *dev) {
+    emulator_wait_cores(dev);
+    pthread_mutex_destroy(&dev->mutex);
+    return E_OK;
+}
+
+int e_reset_group(e_epiphany_t *dev) {
+    return E_OK;
+}
+
+int e_load_group(char *executable, e_epiphany_t *dev, unsigned row, unsigned col, unsigned rows, unsigned cols, e_bool_t start) {
+    return E_OK;
+}
+
+int e_start_group(e_epiphany_t *dev) {
+    emulator_wait_cores(dev);
+    for(unsigned row = 0; row < dev->rows; ++row)
+        for(unsigned col = 0; col < dev->cols && dev->threads_count < MAX_CORES_NUM; ++col) {
+            size_t const index = (dev->row + row) * EMULATED_COLS + dev->col + col;
+            chip_groups[index] = dev;
+            if(pthread_create(dev->threads + dev->threads_count, NULL, emulated_core_main, (void *)index))
+                return E_ERR;
+            ++dev->threads_count;
+        }
+    return E_OK;
+}
+
+int e_finalize(void) {
+    return E_OK;
+}
+
+/**
+ * @return pointer to emulated memory at address addr of core (row, col) of group,
+ *   or at offset addr of shared memory buffer
+ */
+static unsigned char *emulated_address(void *const dev, unsigned const row, unsigned const col, off_t const addr) {
+    if(*(e_objtype_t const *)dev == E_EPI_GROUP) {
+        e_epiphany_t const *const group = (e_epiphany_t const *)dev;
+        return (unsigned char *)( chip_memory + (group->row + row) * EMULATED_COLS + group->col + col ) + addr - CORE_BANK1_ADDRESS;
+    }
+    return (unsigned char *)&dram_memory + ((e_mem_t const *)dev)->base + addr;
+}
+
+ssize_t e_read(void *dev, unsigned row, unsigned col, off_t from_addr, void *buf, size_t size) {
+    memcpy( buf, emulated_address(dev, row, col, from_addr), size );
+    return size;
+}
+
+ssize_t e_write(void *dev, unsigned row, unsigned col, off_t to_addr, const void *buf, size_t size) {
+    memcpy( emulated_address(dev, row, col, to_addr), buf, size );
+    return size;
+}
+
 unsigned int e_coreid_origin(void) {
     return 2084;
 }
 
 unsigned int e_get_coreid() {
-    return 2084;
+    return core_id;
 }
 
 #endif//DEVICE_EMULATION
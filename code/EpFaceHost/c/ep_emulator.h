@@ -8,6 +8,10 @@
 #ifndef EP_EMULATOR_H
 #define EP_EMULATOR_H
 
+#include <stddef.h>
+#include <sys/types.h>
+#include <pthread.h>
+
 #include "ep_data_types.h"
 
 typedef struct {
@@ -18,14 +22,102 @@ typedef struct {
 
 typedef struct {
     EpDRAMBuf common_memory;
+    /// Regions of core groups may extend up to SHARED_DRAM_SIZE
+    unsigned char unused[SHARED_DRAM_SIZE - sizeof(EpDRAMBuf)];
 } __attribute__((packed)) EpDRAMMemory;
 
-/// Emulated core memory
-extern EpCoreMemory core_memory;
+/// Size of emulated chip
+#define EMULATED_ROWS 4
+#define EMULATED_COLS 4
+
+/**
+ * Statistics collected by emulator
+ */
+typedef struct {
+    /// Number of DMA descriptors issued by cores
+    unsigned long long dma_descriptors;
+    /// Number of them which are 2D (strided) descriptors
+    unsigned long long dma_strided;
+    /// Number of bytes transferred by DMA
+    unsigned long long dma_bytes;
+    /// Number of polls of shared variables made by cores waiting for other cores
+    unsigned long long spin_waits;
+    /// Number of operations on shared variables under global mutex
+    unsigned long long mutex_ops;
+    /// Number of classifier nodes (LBP decisions) evaluated
+    unsigned long long node_evaluations;
+    /// Sum of cycles of cores estimated by cost model (@see emulator_model_set())
+    unsigned long long model_cycles;
+    /// Maximal cycles of single core estimated by cost model
+    unsigned long long model_max_core_cycles;
+} EpEmulatorStats;
+
+/**
+ * Cost model of device used by emulator to estimate cycles of cores instead of measuring host time.
+ *   Core cycles are sum of costs of counted operations (@see EpEmulatorStats); waits for other cores
+ *   are not modelled since they depend on host threads scheduling.
+ */
+typedef struct {
+    /// Cycles to set up DMA descriptor and wait for the first data of transfer
+    double dma_descriptor_cycles;
+    /// Bytes transferred by DMA per cycle
+    double dma_bytes_per_cycle;
+    /// Cycles to lock global mutex, access shared variable and unlock mutex
+    double mutex_op_cycles;
+    /// Cycles to evaluate one classifier node
+    double node_cycles;
+} EpEmulatorModel;
+
+/// Emulated memory of chip cores (every emulated core runs in its own thread)
+extern EpCoreMemory chip_memory[EMULATED_ROWS * EMULATED_COLS];
 
 /// Emulated shared memory
 extern EpDRAMMemory dram_memory;
 
+/// Emulator statistics of cores waited for by current host thread (@see emulator_wait_cores())
+extern __thread EpEmulatorStats emulator_stats;
+
+/**
+ * Minimal subset of eSDK host library types (e-hal.h) used by host code
+ */
+typedef enum {
+    E_FALSE = 0,
+    E_TRUE  = 1
+} e_bool_t;
+
+#define E_OK   0
+#define E_ERR -1
+
+typedef enum {
+    E_EPI_GROUP = 3,
+    E_EXT_MEM   = 4
+} e_objtype_t;
+
+typedef struct {
+    int rows, cols;
+} e_platform_t;
+
+typedef struct {
+    /// E_EPI_GROUP
+    e_objtype_t objtype;
+    unsigned row, col, rows, cols;
+    /// Threads of emulated cores started by e_start_group()
+    pthread_t threads[MAX_CORES_NUM];
+    int threads_count;
+    /// Emulated mutex of group (device code locks mutex on the first core of group)
+    pthread_mutex_t mutex;
+    /// Statistics of cores of group since the last e_start_group()
+    EpEmulatorStats stats;
+} e_epiphany_t;
+
+typedef struct {
+    /// E_EXT_MEM
+    e_objtype_t objtype;
+    /// Offset of allocated buffer in emulated shared memory
+    off_t base;
+    size_t size;
+} e_mem_t;
+
 
 #ifdef __cplusplus
 extern "C" {
@@ -34,31 +126,119 @@ extern "C" {
 void device_dump_buffers(char const *const file_name);
 
 /**
- * @return 0
+ * Reset emulator statistics
+ */
+void emulator_stats_reset(void);
+
+/**
+ * @return cost model with latencies and bandwidth of Epiphany-III chip reading external memory over eLink.
  */
-int e_open(char const *const eServIP, unsigned short const eServPort);
+EpEmulatorModel emulator_model_create_default(void);
 
 /**
- * @return 0
+ * Enable or disable cost model. When model is enabled cores timers (EpTimerBuf) and
+ *   statistics report cycles estimated by model; otherwise cores timers measure host thread time.
+ *   Should not be called while emulated cores run.
+ * @param model: cost model; NULL disables model (default).
  */
-int e_close();
+void emulator_model_set(EpEmulatorModel const *model);
 
 /**
- * Calls memcpy(buf, from_addr, count);
+ * Wait for threads of emulated cores of group started by e_start_group() to finish.
+ * Statistics of cores are added to emulator_stats of calling thread.
+ * @return number of threads waited for
  */
-size_t e_read(void volatile const *const from_addr, void volatile *const buf, size_t const count);
+int emulator_wait_cores(e_epiphany_t *dev);
 
 /**
- * Calls memcpy(to_addr, buf, count);
+ * Pause host thread which polls shared memory while emulated cores work, so it does not take CPU from them.
  */
-size_t e_write(void volatile *const to_addr, const void volatile *const buf, size_t const count);
+void emulator_host_pause(void);
+
+/**
+ * @return E_OK
+ */
+int e_init(char *hdf);
+
+/**
+ * @return E_OK
+ */
+int e_reset_system(void);
+
+/**
+ * Fills platform info with 4x4 cores chip.
+ * @return E_OK
+ */
+int e_get_platform_info(e_platform_t *platform);
+
+/**
+ * Allocate buffer in emulated shared memory (SHARED_DRAM_SIZE bytes from BUF_OFFSET).
+ * @return E_OK; E_ERR if buffer is out of emulated shared memory
+ */
+int e_alloc(e_mem_t *mbuf, off_t base, size_t size);
+
+/**
+ * @return E_OK
+ */
+int e_free(e_mem_t *mbuf);
+
+/**
+ * Open group of cores; group must be inside EMULATED_ROWS x EMULATED_COLS chip.
+ * @return E_OK; E_ERR if group is out of chip
+ */
+int e_open(e_epiphany_t *dev, unsigned row, unsigned col, unsigned rows, unsigned cols);
+
+/**
+ * Wait for cores of group and close it.
+ * @return E_OK
+ */
+int e_close(e_epiphany_t *dev);
+
+/**
+ * Does nothing: emulated cores finish when they run out of tasks.
+ * @return E_OK
+ */
+int e_reset_group(e_epiphany_t *dev);
+
+/**
+ * Does nothing: core code is linked into host application.
+ * @return E_OK
+ */
+int e_load_group(char *executable, e_epiphany_t *dev, unsigned row, unsigned col, unsigned rows, unsigned cols, e_bool_t start);
+
+/**
+ * Start thread for every core of the group. Cores requested in control_info.start_cores of group
+ *   shared memory region (@see EpCoreConfig) run device_process_tasks(), the others finish immediately.
+ *   Use emulator_wait_cores() to join them.
+ * @return E_OK; E_ERR if thread cannot be created
+ */
+int e_start_group(e_epiphany_t *dev);
+
+/**
+ * @return E_OK
+ */
+int e_finalize(void);
+
+/**
+ * Read from emulated shared memory buffer (dev points to e_mem_t),
+ *   or from memory of core of group (dev points to e_epiphany_t; from_addr is core address).
+ * Calls memcpy(buf, base + from_addr, size);
+ */
+ssize_t e_read(void *dev, unsigned row, unsigned col, off_t from_addr, void *buf, size_t size);
+
+/**
+ * Write to emulated shared memory buffer (dev points to e_mem_t),
+ *   or to memory of core of group (dev points to e_epiphany_t; to_addr is core address).
+ * Calls memcpy(base + to_addr, buf, size);
+ */
+ssize_t e_write(void *dev, unsigned row, unsigned col, off_t to_addr, const void *buf, size_t size);
 
 /**
  * @return 2084
  */
 unsigned int e_coreid_origin(void);
 /**
- * @return 2084
+ * @return ID of emulated core calling the function; 2084 for host thread
  */
 unsigned int e_get_coreid();
 
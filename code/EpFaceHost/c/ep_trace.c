@@ -0,0 +1,141 @@
+/* <title of the code in this file>
+   Copyright (C) 2012 Adapteva, Inc.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program, see the file COPYING.  If not, see
+   <http://www.gnu.org/licenses/>. */
+
+#include <stdio.h>
+#include <opencv/cv.h>
+
+#include <omp.h>
+
+#include "ep_trace.h"
+
+/// Trace file; NULL while trace is not recorded
+static FILE *trace_file = NULL;
+/// Tick count of trace start
+static int64 trace_start_ticks = 0;
+/// Number of events written (events are separated by commas)
+static int trace_events = 0;
+/// Number of host threads which added spans
+static int trace_threads = 0;
+/// Trace thread of current host thread (0 if it added no spans yet)
+static __thread int host_thread = 0;
+
+/**
+ * Write event to trace file. Must be called inside critical section "trace".
+ * @param event: JSON object of event
+ */
+static void write_event(char const *const event) {
+    fprintf(trace_file, "%s\n%s", trace_events ? "," : "", event);
+    ++trace_events;
+}
+
+EpErrorCode ep_trace_start(char const *const file_name) {
+    ep_trace_stop();
+
+    FILE *const f = fopen(file_name, "wt");
+    if(!f)
+        return ERR_FILE;
+
+    char event[128];
+    #pragma omp critical(trace)
+    {
+        trace_file = f;
+        trace_start_ticks = cvGetTickCount();
+        trace_events = 0;
+        trace_threads = 0;
+        //Array format: trace stays readable even if application exits before it is finished
+        fprintf(trace_file, "[");
+
+        static char const *const process_names[] = {"host", "device", "emulator"};
+        for(int i = 0; i < 3; ++i) {
+            sprintf(event, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"%s\"}}",
+                TRACE_HOST + i, process_names[i]);
+            write_event(event);
+        }
+    }
+
+    return ERR_SUCCESS;
+}
+
+void ep_trace_stop(void) {
+    #pragma omp critical(trace)
+    if(trace_file) {
+        fprintf(trace_file, "\n]\n");
+        fclose(trace_file);
+        trace_file = NULL;
+    }
+}
+
+int ep_trace_enabled(void) {
+    return trace_file != NULL;
+}
+
+double ep_trace_begin(void) {
+    if(!trace_file)
+        return 0.0;
+    return (cvGetTickCount() - trace_start_ticks) / cvGetTickFrequency();
+}
+
+void ep_trace_end(char const *const name, double const begin) {
+    if(!trace_file)
+        return;
+
+    double const end = ep_trace_begin();
+
+    if(!host_thread) {
+        #pragma omp critical(trace)
+        host_thread = ++trace_threads;
+
+        char thread_name[32];
+        sprintf(thread_name, "thread %d", host_thread);
+        ep_trace_thread_name(TRACE_HOST, host_thread, thread_name);
+    }
+
+    ep_trace_span(name, TRACE_HOST, host_thread, begin, end - begin, NULL);
+}
+
+void ep_trace_span (
+    char const *const name,
+    EpTraceProcess const process,
+    int const thread,
+    double const begin,
+    double const duration,
+    char const *const args
+) {
+    if(!trace_file)
+        return;
+
+    char event[512];
+    snprintf(event, sizeof(event), "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3lf,\"dur\":%.3lf%s%s}",
+        name, process, thread, begin, duration, args ? ",\"args\":" : "", args ? args : "");
+
+    #pragma omp critical(trace)
+    if(trace_file)
+        write_event(event);
+}
+
+void ep_trace_thread_name(EpTraceProcess const process, int const thread, char const *const name) {
+    if(!trace_file)
+        return;
+
+    char event[256];
+    snprintf(event, sizeof(event), "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+        process, thread, name);
+
+    #pragma omp critical(trace)
+    if(trace_file)
+        write_event(event);
+}
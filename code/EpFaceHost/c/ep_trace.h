@@ -0,0 +1,96 @@
+/* <title of the code in this file>
+   Copyright (C) 2012 Adapteva, Inc.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program, see the file COPYING.  If not, see
+   <http://www.gnu.org/licenses/>. */
+
+/**
+ * Recording of detection timeline into Chrome trace event file (opened by chrome://tracing or Perfetto).
+ *   Spans of host threads, of device tasks (@see EpTaskTrace) and of emulated cores are written as
+ *   complete events. While trace is not started every routine returns immediately without reading clocks.
+ *   Trace is one per process: its file and counters are global, written only inside critical section "trace",
+ *   and are never read by detection, so detections of different threads and devices may share it.
+ */
+
+#ifndef EP_TRACE_H
+#define EP_TRACE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "ep_data_types.h"
+
+/**
+ * Processes of trace timeline
+ */
+typedef enum {
+    /// Host threads
+    TRACE_HOST = 1,
+    /// Tasks of device cores, aligned to host time of cores start
+    TRACE_DEVICE,
+    /// Threads of emulated cores (host time)
+    TRACE_EMULATOR
+} EpTraceProcess;
+
+/**
+ * Start recording of trace. Events of previous trace are finished first.
+ * @param file_name: name of trace file (e.g. trace.json)
+ * @return ERR_SUCCESS; ERR_FILE if file cannot be created
+ */
+EpErrorCode ep_trace_start(char const *file_name);
+
+/**
+ * Finish trace file. Does nothing if trace is not recorded.
+ */
+void ep_trace_stop(void);
+
+/**
+ * @return non-zero if trace is recorded
+ */
+int ep_trace_enabled(void);
+
+/**
+ * @return time in microseconds since trace start; 0 if trace is not recorded
+ */
+double ep_trace_begin(void);
+
+/**
+ * Add span of current host thread which lasts from begin till now.
+ * @param name : name of span
+ * @param begin: start time returned by ep_trace_begin()
+ */
+void ep_trace_end(char const *name, double begin);
+
+/**
+ * Add span to timeline.
+ * @param name    : name of span
+ * @param process : process the span belongs to (@see EpTraceProcess)
+ * @param thread  : thread of the process (e.g. core)
+ * @param begin   : start time in microseconds since trace start
+ * @param duration: duration in microseconds
+ * @param args    : JSON object with span arguments (may be NULL)
+ */
+void ep_trace_span(char const *name, EpTraceProcess process, int thread, double begin, double duration, char const *args);
+
+/**
+ * Name thread of trace process (e.g. "core 2,3").
+ */
+void ep_trace_thread_name(EpTraceProcess process, int thread, char const *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif//EP_TRACE_H
@@ -16,8 +16,14 @@
    <http://www.gnu.org/licenses/>. */
 
 #include <omp.h>
+#include <pthread.h>
+
+#include <cmath>
+#include <algorithm>
+#include <deque>
 
 #include "ep_cascade_detector.hpp"
+#include "../c/ep_trace.h"
 
 #ifdef __OPENCV_OBJDETECT_HPP__
     #include "cascadedetect.hpp"
@@ -47,6 +53,123 @@ namespace ep
         { ; }
     };
 
+    /**
+     * Cell of grid of rectangles centres. Every scale level (@see get_grid_level) has its own grid
+     *   with cells larger than rectangles of the level.
+     */
+    struct GridCell {
+        int level, x, y;
+        inline GridCell(int const level, int const x, int const y):
+            level(level), x(x), y(y)
+        { ; }
+        inline bool operator==(GridCell const &cell) const {
+            return level == cell.level && x == cell.x && y == cell.y;
+        }
+        inline unsigned int hash(void) const {
+            return static_cast<unsigned int>(level) * 73856093u ^ static_cast<unsigned int>(x) * 19349663u ^
+                   static_cast<unsigned int>(y) * 83492791u;
+        }
+    };
+
+    /**
+     * Rectangle in grid of centres; entries of the same hash bucket are linked into list
+     */
+    struct GridEntry {
+        GridCell cell;
+        int index;
+        /// Next entry of bucket (-1 for the last one)
+        int next;
+        inline GridEntry(GridCell const &cell, int const index, int const next):
+            cell(cell), index(index), next(next)
+        { ; }
+    };
+
+    /**
+     * Candidate for the best group: rectangle and its total amount of intersections.
+     *   Ordered so that the largest amount (and the smallest index among equal amounts) is on top of the heap.
+     */
+    struct GroupCandidate {
+        float amount;
+        int index;
+        inline GroupCandidate(float const amount, int const index):
+            amount(amount), index(index)
+        { ; }
+        inline bool operator<(GroupCandidate const &candidate) const {
+            return amount < candidate.amount || (amount == candidate.amount && index > candidate.index);
+        }
+    };
+
+    /**
+     * Detections being grouped: intersections of rectangles found so far, grid of their centres,
+     *   which is used to find candidates for intersection instead of checking all pairs, and heap of
+     *   candidates for the best group. State is built incrementally while detections are streamed,
+     *   so only selection of groups is left when detection finishes.
+     *   Memory is kept by clear(), so grouping of the next frame does not allocate it again.
+     */
+    struct RectsGroups {
+        /// Number of rectangles added; lists after them are kept for their memory only
+        int count;
+        std::vector<IntersectionsList> intersections;
+        /// Length of the longest list of intersections so far. Every list is reserved to it when it is reused,
+        /// because rectangle of a list index differs between frames (order of detections is not fixed)
+        int max_intersections;
+        /// Hash table of grid cells: the first entry of every bucket (-1 for empty bucket)
+        std::vector<int> buckets;
+        std::vector<GridEntry> entries;
+        /// Heap of candidates for the best group
+        std::vector<GroupCandidate> candidates;
+        /// Rectangles near the one being added (temporary)
+        std::vector<int> near;
+
+        inline RectsGroups(void):
+            count(0), intersections(), max_intersections(0), buckets(64, -1), entries(), candidates(), near()
+        { ; }
+
+        /// Remove all rectangles
+        inline void clear(void) {
+            count = 0;
+            std::fill(buckets.begin(), buckets.end(), -1);
+            entries.clear();
+            candidates.clear();
+        }
+
+        /// Add rectangle to grid of centres; hash table grows twice when it becomes half-full
+        inline void add_to_grid(GridCell const &cell, int const index) {
+            if( (entries.size() + 1) * 2 > buckets.size() ) {
+                buckets.assign(buckets.size() * 2, -1);
+                for(int i(0); i < static_cast<int>( entries.size() ); ++i) {
+                    int &head( buckets[ entries[i].cell.hash() & (buckets.size() - 1) ] );
+                    entries[i].next = head;
+                    head = i;
+                }
+            }
+            int &head( buckets[ cell.hash() & (buckets.size() - 1) ] );
+            entries.push_back( GridEntry(cell, index, head) );
+            head = static_cast<int>( entries.size() ) - 1;
+        }
+
+        /// Append rectangles of grid cell to near list
+        inline void add_near(GridCell const &cell) {
+            for(int i( buckets[ cell.hash() & (buckets.size() - 1) ] ); i >= 0; i = entries[i].next)
+                if(entries[i].cell == cell)
+                    near.push_back(entries[i].index);
+        }
+
+        /// Add candidate to heap
+        inline void push_candidate(float const amount, int const index) {
+            candidates.push_back( GroupCandidate(amount, index) );
+            std::push_heap( candidates.begin(), candidates.end() );
+        }
+
+        /// Remove candidate from top of heap
+        inline GroupCandidate pop_candidate(void) {
+            std::pop_heap( candidates.begin(), candidates.end() );
+            GroupCandidate const candidate( candidates.back() );
+            candidates.pop_back();
+            return candidate;
+        }
+    };
+
     /**
      * Remove rectangle from list of lists of intersection
      */
@@ -100,16 +223,121 @@ namespace ep
         return cv::Rect(xi1, yi1, xi2 - xi1, yi2 - yi1);
     }
 
+    /**
+     * Check if rectangle lies inside any of the first regions
+     * @param rect   : rectangle in image coordinates
+     * @param regions: regions of image
+     * @param count  : number of regions to check
+     */
+    inline bool inside_regions(EpRect const &rect, std::vector<cv::Rect> const &regions, int const count) {
+        for(int i(0); i < count; ++i)
+            if( rect.x >= regions[i].x && rect.x + rect.width  <= regions[i].x + regions[i].width &&
+                rect.y >= regions[i].y && rect.y + rect.height <= regions[i].y + regions[i].height )
+                return true;
+        return false;
+    }
+
+    /**
+     * Scale level of size in grid of centres: 2^(level - 1) <= size < 2^level.
+     */
+    inline int get_grid_level(double const size) {
+        int level;
+        std::frexp(size, &level);
+        return level;
+    }
+
+    /**
+     * Add intersections of new rectangles with all previous ones.
+     *   If two rectangles intersect by 0.5 or more then their widths (and heights) differ at most twice,
+     *   and each of their intersection sides is at least half of the larger rectangle side, so centres are
+     *   closer than half of the smaller side. Candidates are taken only from grid cells within this distance
+     *   on scale levels of this size range; lists get the same order as if all pairs of rectangles were checked.
+     * @param ep_rectangles: source detections
+     * @param groups       : intersections of rectangles; their count is the index of the first new rectangle
+     */
+    void add_intersections(EpRectList const &ep_rectangles, RectsGroups &groups) {
+        std::vector<IntersectionsList> &intersections(groups.intersections);
+        int const first_new(groups.count);
+        groups.count = ep_rectangles.count;
+        if(static_cast<int>( intersections.size() ) < groups.count)
+            intersections.resize(groups.count);
+
+        std::vector<int> &candidates(groups.near);
+        for(int i2(first_new); i2 < ep_rectangles.count; ++i2) {
+            intersections[i2].total_amount = 1.0f; //List may be left from previous frame
+            intersections[i2].intersections.clear();
+            intersections[i2].intersections.reserve(groups.max_intersections);
+
+            EpRect const &r2( ep_rectangles.data[i2] );
+            if( !(r2.width > 0.0f && r2.height > 0.0f) ) {
+                groups.push_candidate(intersections[i2].total_amount, i2);
+                continue; //Empty rectangle intersects nothing
+            }
+
+            double const size( std::max(r2.width, r2.height) );
+            int const level( get_grid_level(size) );
+            double const cx( r2.x + r2.width * 0.5 ), cy( r2.y + r2.height * 0.5 );
+
+            //Margin keeps rounding of intersection amount on the safe side
+            double const margin(1.001);
+            double const distance_x( r2.width * 0.5 * margin ), distance_y( r2.height * 0.5 * margin );
+            candidates.clear();
+            for(int level1( get_grid_level(size * 0.5 / margin) ); level1 <= get_grid_level(size * 2.0 * margin); ++level1) {
+                double const cell( std::ldexp(1.0, level1) );
+                int const x1( static_cast<int>( std::floor( (cx - distance_x) / cell ) ) ),
+                          x2( static_cast<int>( std::floor( (cx + distance_x) / cell ) ) ),
+                          y1( static_cast<int>( std::floor( (cy - distance_y) / cell ) ) ),
+                          y2( static_cast<int>( std::floor( (cy + distance_y) / cell ) ) );
+                for(int x(x1); x <= x2; ++x)
+                    for(int y(y1); y <= y2; ++y)
+                        groups.add_near( GridCell(level1, x, y) );
+            }
+            std::sort( candidates.begin(), candidates.end() );
+
+            for(int i(0); i < static_cast<int>( candidates.size() ); ++i) {
+                int const i1( candidates[i] );
+                float const amount( intersection_amount( ep_rectangles.data[i1], r2 ) );
+                if(amount < 0.5f)
+                    continue;
+
+                intersections[i1].total_amount += amount;
+                intersections[i1].intersections.push_back( RectsIntersection(i2, amount) );
+                groups.push_candidate(intersections[i1].total_amount, i1);
+
+                intersections[i2].total_amount += amount;
+                intersections[i2].intersections.push_back( RectsIntersection(i1, amount) );
+
+                groups.max_intersections = std::max( groups.max_intersections, static_cast<int>(
+                    std::max( intersections[i1].intersections.size(), intersections[i2].intersections.size() ) ) );
+            }
+            groups.push_candidate(intersections[i2].total_amount, i2);
+
+            double const cell( std::ldexp(1.0, level) );
+            groups.add_to_grid( GridCell( level, static_cast<int>( std::floor(cx / cell) ), static_cast<int>( std::floor(cy / cell) ) ), i2 );
+        }
+    }
+
+    /**
+     * Receiver of device detections (@see EpResultsStream): intersections are found while cores are working.
+     * @param user_data: pointer to RectsGroups
+     */
+    void stream_intersections(EpRectList const *objects, int, void *user_data) {
+        add_intersections(*objects, *static_cast<RectsGroups *>(user_data));
+    }
+
     /**
      * Group rectangles
      * @param ep_rectangles: source detections
      * @param rectangles: resulting grouped detections
      * @param min_neighbors: if zero then source rectangles will be just copied to result. Otherwise grouping is performed. Groups containing less than min_neighbors are discarded
+     * @param groups: intersections of the first rectangles found while they were streamed (@see stream_intersections);
+     *                empty if rectangles were not streamed. Intersections are consumed by grouping
      */
     void group_rectangles (
         EpRectList const &ep_rectangles,
         std::vector<cv::Rect> &rectangles,
-        int const min_neighbors
+        int const min_neighbors,
+        RectsGroups &groups
     ) {
         rectangles.clear();
 
@@ -122,34 +350,26 @@ namespace ep
             return;
         }
 
-        std::vector<IntersectionsList> intersections(ep_rectangles.count);
-
-        for(int i1 = 0; i1 < ep_rectangles.count - 1; ++i1) {
-            for(int i2(i1 + 1); i2 < ep_rectangles.count; ++i2) {
-                float const amount( intersection_amount( ep_rectangles.data[i1], ep_rectangles.data[i2] ) );
-                if(amount < 0.5f)
-                    continue;
-
-                intersections[i1].total_amount += amount;
-                intersections[i1].intersections.push_back( RectsIntersection(i2, amount) );
-
-                intersections[i2].total_amount += amount;
-                intersections[i2].intersections.push_back( RectsIntersection(i1, amount) );
-            }
-        }
+        add_intersections(ep_rectangles, groups);
+        std::vector<IntersectionsList> &intersections(groups.intersections);
 
+        //Heap has an entry for every amount rectangle had while intersections were added; the latest one is not less
+        //than current amount. Amounts only decrease while groups are removed, so entries are refreshed on top of heap
         while(true) {
-            float best_amount(0.0f);
             int best_index(-1);
 
-            for(int i(0); i < ep_rectangles.count; ++i) {
-                if(static_cast<int>( intersections[i].intersections.size() ) + 1 < min_neighbors)
-                    continue;
+            while( best_index < 0 && !groups.candidates.empty() ) {
+                GroupCandidate const candidate( groups.pop_candidate() );
 
-                if(intersections[i].total_amount > best_amount) {
-                    best_amount = intersections[i].total_amount;
-                    best_index = i;
-                }
+                IntersectionsList const &list( intersections[candidate.index] );
+                if(static_cast<int>( list.intersections.size() ) + 1 < min_neighbors || list.total_amount <= 0.0f)
+                    continue; //Rectangle is removed or will never have enough neighbors
+
+                if(list.total_amount < candidate.amount)
+                    groups.push_candidate(list.total_amount, candidate.index);
+                else if(list.total_amount == candidate.amount)
+                    best_index = candidate.index;
+                //Otherwise entry was pushed before later intersections were added
             }
 
             if(best_index < 0)
@@ -185,11 +405,81 @@ namespace ep
         }
     }
 
+    void group_rectangles(EpRectList const &ep_rectangles, std::vector<cv::Rect> &rectangles, int const min_neighbors) {
+        RectsGroups groups;
+        group_rectangles(ep_rectangles, rectangles, min_neighbors, groups);
+    }
+
+    /**
+     * Run detection routine chosen by detection_mode and group detections (@see detect_multi_scale).
+     * @param ep_image  : image to process; consumed by detection if there is no workspace
+     * @param ep_objects: receives raw detections (list must be empty; its memory is reused)
+     * @param groups    : grouping state (must be empty; its memory is reused)
+     * @param workspace : working set kept between calls (may be NULL)
+     */
+    EpErrorCode detect_and_group (
+        EpImage                     &ep_image,
+        CascadeClassifier     const &classifier,
+        EpRectList                  &ep_objects,
+        RectsGroups                 &groups,
+        std::vector<cv::Rect>       &objects,
+        int                   const  min_neighbors,
+        EpScanMode            const  scan_mode,
+        EpDetectionMode       const  detection_mode,
+        int                   const  num_cores,
+        std::string           const &log_file,
+        EpLevelStats                *level_stats,
+        int                   const  device_flags,
+        EpDevice                    *device,
+        EpDeviceGroup         const *device_group,
+        EpFrameCache                *frame_cache,
+        EpWorkspace                 *workspace
+    ) {
+        EpErrorCode result(ERR_ARGUMENT);
+
+        //Detections are grouped partially while cores are working, or while next levels are scanned on host
+        EpResultsStream const results_stream = { stream_intersections, &groups };
+
+        if(detection_mode == DET_HOST)
+            result = ep_detect_multi_scale_host(&ep_image, classifier.get_data(), &ep_objects, scan_mode,
+                                                min_neighbors > 0 ? &results_stream : NULL, workspace);
+
+        if(detection_mode == DET_DEVICE)
+            result = ep_detect_multi_scale_device (
+                &ep_image,
+                 classifier.get_data(),
+                &ep_objects,
+                 scan_mode,
+                 num_cores,
+                 device_flags,
+                log_file.length() ? log_file.c_str() : NULL,
+                 level_stats,
+                 frame_cache,
+                 device,
+                 device_group,
+                 min_neighbors > 0 ? &results_stream : NULL,
+                 workspace
+            );
+
+        double const trace_begin( ep_trace_begin() );
+        group_rectangles(ep_objects, objects, min_neighbors, groups);
+        ep_trace_end("group rectangles", trace_begin);
+
+        return result;
+    }
+
     /**
      * Wrapper around corresponding C routine (@see ep_detect_multi_scale).
      * In addition this routine makes objects grouping.
      * @param min_neighbors: minimal number of detections in detection group.
      *                       if this value is zero then grouping is disabled.
+     * @param level_stats  : per-level statistics kept between frames of a stream
+     *                       to order device tasks by cost (may be NULL).
+     * @param device_flags : combination of EpDeviceFlags (device detection only).
+     * @param device       : chip opened by ep_device_open() (device detection only).
+     * @param device_group : group of cores to run device detection on (@see ep_device_groups_create);
+     *                       NULL to use the whole chip.
+     * @param frame_cache  : task list of previous frame of a stream reused by device detection (may be NULL).
      */
     EpErrorCode detect_multi_scale (
         cv::Mat               const &image,
@@ -199,36 +489,505 @@ namespace ep
         EpScanMode            const  scan_mode,
         EpDetectionMode       const  detection_mode,
         int                          num_cores,
-        std::string           const &log_file
+        std::string           const &log_file,
+        EpLevelStats                *level_stats,
+        int                   const  device_flags,
+        EpDevice                    *device,
+        EpDeviceGroup         const *device_group,
+        EpFrameCache                *frame_cache
     ) {
-        EpImage ep_image_orig = { image.data, image.cols, image.rows, static_cast<int>(image.step) };
-        //ToDo: ideally aligned copy should be created directly in shared memory
-        EpImage ep_image_aligned = ep_image_clone(&ep_image_orig);
+        //Image is borrowed read-only: level 0 is scanned in place, without copy
+        EpImage ep_image = { image.data, image.cols, image.rows, static_cast<int>(image.step) };
+        EpWorkspace workspace( ep_workspace_create_empty() );
 
         EpRectList ep_objects( ep_rect_list_create_empty() );
+        RectsGroups groups;
+
+        EpErrorCode const result( detect_and_group (
+            ep_image, classifier, ep_objects, groups, objects, min_neighbors, scan_mode, detection_mode,
+            num_cores, log_file, level_stats, device_flags, device, device_group, frame_cache, &workspace
+        ) );
+
+        ep_rect_list_release(&ep_objects);
+
+        ep_workspace_release(&workspace);
+
+        return result;
+    }
+
+    ////////////////////////////////////////////////////////
+
+    /**
+     * Shared state of asynchronous detection. It is referenced by future handles (including the one of queued frame)
+     *   and deleted with the last reference.
+     */
+    struct DetectionFuture::State {
+        pthread_mutex_t mutex;
+        /// Signalled when detection is finished
+        pthread_cond_t finished_cond;
+        int references;
+        bool finished;
+        EpErrorCode result;
+        std::vector<cv::Rect> objects;
+
+        inline State(void):
+            references(1), finished(false), result(ERR_SUCCESS), objects()
+        {
+            pthread_mutex_init(&mutex, NULL);
+            pthread_cond_init(&finished_cond, NULL);
+        }
+
+        inline ~State(void) {
+            pthread_cond_destroy(&finished_cond);
+            pthread_mutex_destroy(&mutex);
+        }
+
+        inline void acquire(void) {
+            pthread_mutex_lock(&mutex);
+            ++references;
+            pthread_mutex_unlock(&mutex);
+        }
+
+        inline void release(void) {
+            pthread_mutex_lock(&mutex);
+            bool const last( --references == 0 );
+            pthread_mutex_unlock(&mutex);
+            if(last)
+                delete this;
+        }
+
+        /// Store result and wake up waiting threads; objects are not changed afterwards
+        inline void finish(EpErrorCode const result, std::vector<cv::Rect> const &objects) {
+            pthread_mutex_lock(&mutex);
+            this->result = result;
+            this->objects = objects;
+            finished = true;
+            pthread_cond_broadcast(&finished_cond);
+            pthread_mutex_unlock(&mutex);
+        }
+    };
+
+    DetectionFuture::DetectionFuture(void):
+        state(NULL)
+    { ; }
+
+    DetectionFuture::DetectionFuture(State *const state):
+        state(state)
+    { ; }
+
+    DetectionFuture::DetectionFuture(DetectionFuture const &future):
+        state(future.state)
+    {
+        if(state)
+            state->acquire();
+    }
+
+    DetectionFuture::~DetectionFuture(void) {
+        if(state)
+            state->release();
+    }
+
+    DetectionFuture &DetectionFuture::operator=(DetectionFuture const &future) {
+        if(future.state)
+            future.state->acquire();
+        if(state)
+            state->release();
+        state = future.state;
+        return *this;
+    }
+
+    bool DetectionFuture::valid(void) const {
+        return state != NULL;
+    }
+
+    bool DetectionFuture::ready(void) const {
+        if(!state)
+            return false;
+
+        pthread_mutex_lock(&state->mutex);
+        bool const finished(state->finished);
+        pthread_mutex_unlock(&state->mutex);
+        return finished;
+    }
+
+    void DetectionFuture::wait(void) const {
+        if(!state)
+            return;
+
+        pthread_mutex_lock(&state->mutex);
+        while(!state->finished)
+            pthread_cond_wait(&state->finished_cond, &state->mutex);
+        pthread_mutex_unlock(&state->mutex);
+    }
+
+    EpErrorCode DetectionFuture::get(std::vector<cv::Rect> &objects) const {
+        if(!state)
+            return ERR_ARGUMENT;
+
+        wait();
+        objects = state->objects;
+        return state->result;
+    }
+
+    /**
+     * Frame queued for asynchronous detection
+     */
+    struct QueuedFrame {
+        cv::Mat image;
+        DetectionCallback callback;
+        void *user_data;
+        std::string log_file;
+        /// Handle sharing result with future returned to caller
+        DetectionFuture future;
+    };
+
+    /**
+     * Memory kept by detector between frames
+     */
+    struct Detector::WorkingSet {
+        EpWorkspace workspace;
+        EpRectList objects;
+        RectsGroups groups;
+        EpLevelStats level_stats;
+        EpFrameCache frame_cache;
+        /// Batch detection: borrowed images, their raw detections and working sets of one chunk of images
+        /// (host detection only, @see ep_detect_batch_host)
+        std::vector<EpImage> batch_images;
+        std::vector<EpRectList> batch_objects;
+        std::vector<EpWorkspace> batch_workspaces;
+        /// Regions of detection in regions, clipped and merged, and areas covered by their source regions
+        std::vector<cv::Rect> regions;
+        std::vector<int> region_areas;
+
+        /// Working set is used by one detection at a time, synchronous or asynchronous
+        pthread_mutex_t detect_mutex;
+        /// Protects queue of asynchronous detection
+        pthread_mutex_t queue_mutex;
+        /// Signalled when frame is queued or detector is destroyed
+        pthread_cond_t frame_queued;
+        /// Signalled when asynchronous detection of frame is finished
+        pthread_cond_t frame_finished;
+        /// Frames waiting for worker thread
+        std::deque<QueuedFrame> queue;
+        /// Number of queued frames and the frame being detected by worker thread
+        int in_flight;
+        bool worker_started, stopping;
+        pthread_t worker;
+
+        inline WorkingSet(void):
+            workspace( ep_workspace_create_empty() ), objects( ep_rect_list_create_empty() ), groups(),
+            level_stats( ep_level_stats_create_empty() ), frame_cache( ep_frame_cache_create_empty() ),
+            queue(), in_flight(0), worker_started(false), stopping(false)
+        {
+            pthread_mutex_init(&detect_mutex, NULL);
+            pthread_mutex_init(&queue_mutex, NULL);
+            pthread_cond_init(&frame_queued, NULL);
+            pthread_cond_init(&frame_finished, NULL);
+        }
+
+        inline ~WorkingSet(void) {
+            pthread_cond_destroy(&frame_finished);
+            pthread_cond_destroy(&frame_queued);
+            pthread_mutex_destroy(&queue_mutex);
+            pthread_mutex_destroy(&detect_mutex);
+            for(size_t i(0); i < batch_workspaces.size(); ++i)
+                ep_workspace_release(&batch_workspaces[i]);
+            for(size_t i(0); i < batch_objects.size(); ++i)
+                ep_rect_list_release(&batch_objects[i]);
+            ep_frame_cache_release(&frame_cache);
+            ep_rect_list_release(&objects);
+            ep_workspace_release(&workspace);
+        }
+    };
+
+    Detector::Detector (
+        CascadeClassifier const &classifier,
+        int               const  min_neighbors,
+        EpScanMode        const  scan_mode,
+        EpDetectionMode   const  detection_mode,
+        int               const  num_cores,
+        int               const  device_flags,
+        EpDevice                *device,
+        EpDeviceGroup     const *device_group,
+        int               const  queue_depth
+    ):
+        classifier(classifier), min_neighbors(min_neighbors), scan_mode(scan_mode), detection_mode(detection_mode),
+        num_cores(num_cores), device_flags(device_flags), device(device), device_group(device_group),
+        queue_depth( std::max(queue_depth, 1) ), working_set( new WorkingSet() )
+    { ; }
+
+    Detector::~Detector(void) {
+        //Worker finishes frames already queued before it exits
+        pthread_mutex_lock(&working_set->queue_mutex);
+        working_set->stopping = true;
+        pthread_cond_broadcast(&working_set->frame_queued);
+        pthread_mutex_unlock(&working_set->queue_mutex);
+
+        if(working_set->worker_started)
+            pthread_join(working_set->worker, NULL);
+
+        delete working_set;
+    }
+
+    EpErrorCode Detector::detect(cv::Mat const &image, std::vector<cv::Rect> &objects, std::string const &log_file) {
+        pthread_mutex_lock(&working_set->detect_mutex);
+        EpErrorCode const result( detect_frame(image, objects, log_file) );
+        pthread_mutex_unlock(&working_set->detect_mutex);
+        return result;
+    }
+
+    EpErrorCode Detector::detect_frame(cv::Mat const &image, std::vector<cv::Rect> &objects, std::string const &log_file) {
+        //Image is borrowed read-only: level 0 is scanned in place, without copy
+        EpImage ep_image = { image.data, image.cols, image.rows, static_cast<int>(image.step) };
+
+        working_set->objects.count = 0;
+        working_set->groups.clear();
+
+        return detect_and_group (
+            ep_image, classifier, working_set->objects, working_set->groups, objects, min_neighbors, scan_mode,
+            detection_mode, num_cores, log_file, &working_set->level_stats, device_flags, device, device_group,
+            &working_set->frame_cache, &working_set->workspace
+        );
+    }
+
+    EpErrorCode Detector::detect_batch (
+        std::vector<cv::Mat>               const &images,
+        std::vector< std::vector<cv::Rect> >     &results,
+        std::string                        const &log_file
+    ) {
+        int const count( static_cast<int>( images.size() ) );
+        results.resize(count);
+        if(!count)
+            return ERR_SUCCESS;
+
+        pthread_mutex_lock(&working_set->detect_mutex);
+
+        //Images are borrowed read-only
+        std::vector<EpImage> &ep_images(working_set->batch_images);
+        ep_images.resize(count);
+        for(int i(0); i < count; ++i) {
+            EpImage const ep_image = { images[i].data, images[i].cols, images[i].rows, static_cast<int>(images[i].step) };
+            ep_images[i] = ep_image;
+        }
+
+        EpErrorCode const result( detect_batch_images(count, NULL, log_file) );
+
+        double const trace_begin( ep_trace_begin() );
+        for(int i(0); i < count; ++i) {
+            working_set->groups.clear();
+            group_rectangles(working_set->batch_objects[i], results[i], min_neighbors, working_set->groups);
+        }
+        ep_trace_end("group rectangles", trace_begin);
+
+        pthread_mutex_unlock(&working_set->detect_mutex);
+
+        return result;
+    }
+
+    EpErrorCode Detector::detect_in_regions (
+        cv::Mat               const &image,
+        std::vector<cv::Rect> const &rois,
+        std::vector<cv::Rect>       &objects,
+        EpScaleRange          const *scale_range,
+        std::string           const &log_file
+    ) {
+        pthread_mutex_lock(&working_set->detect_mutex);
+
+        //Windows crossing border of overlapping regions are scanned once, in their bounding rectangle. Regions whose
+        //bounding rectangle is much larger than area they cover (e.g. regions overlapping by corners) are not merged,
+        //as scanning of the rest of bounding rectangle costs more than scanning of their overlap twice
+        double const max_bounding_ratio(1.5);
+        std::vector<cv::Rect> &regions(working_set->regions);
+        std::vector<int> &areas(working_set->region_areas);
+        regions.clear();
+        areas.clear();
+        for(size_t i(0); i < rois.size(); ++i) {
+            cv::Rect const region( rois[i] & cv::Rect(0, 0, image.cols, image.rows) );
+            if( region.area() > 0 ) {
+                regions.push_back(region);
+                areas.push_back( region.area() );
+            }
+        }
+        for(bool merged(true); merged; ) {
+            merged = false;
+            for(size_t i(0); i < regions.size(); ++i)
+                for(size_t j(i + 1); j < regions.size(); ++j) {
+                    int const overlap( (regions[i] & regions[j]).area() );
+                    if(!overlap)
+                        continue;
+
+                    //Lower estimate of covered area: overlap of merged regions is at most overlap of their bounds
+                    int const covered( std::max( std::max(areas[i], areas[j]), areas[i] + areas[j] - overlap ) );
+                    cv::Rect const bounding( regions[i] | regions[j] );
+                    if(bounding.area() > max_bounding_ratio * covered)
+                        continue;
+
+                    regions[i] = bounding;
+                    areas[i] = covered;
+                    regions.erase(regions.begin() + j);
+                    areas.erase(areas.begin() + j);
+                    merged = true;
+                    --j;
+                }
+        }
+
+        //Regions are borrowed read-only: every one is level 0 of its own pyramid
+        int const count( static_cast<int>( regions.size() ) );
+        std::vector<EpImage> &ep_images(working_set->batch_images);
+        ep_images.resize(count);
+        for(int i(0); i < count; ++i) {
+            EpImage const ep_image = {
+                const_cast<unsigned char *>( image.ptr(regions[i].y) ) + regions[i].x,
+                regions[i].width, regions[i].height, static_cast<int>(image.step)
+            };
+            ep_images[i] = ep_image;
+        }
+
+        EpErrorCode const result( count ? detect_batch_images(count, scale_range, log_file) : ERR_SUCCESS );
+
+        //Detections of all regions are grouped together in image coordinates. Window lying inside an earlier region
+        //(overlapping region which was not merged) was scanned there too, so its detection is a duplicate
+        EpRectList &ep_objects(working_set->objects);
+        ep_objects.count = 0;
+        for(int i(0); i < count; ++i) {
+            EpRectList const &region_objects(working_set->batch_objects[i]);
+            for(int j(0); j < region_objects.count; ++j) {
+                EpRect const &region_rect(region_objects.data[j]);
+                EpRect const rect = {
+                    region_rect.x + regions[i].x, region_rect.y + regions[i].y, region_rect.width, region_rect.height
+                };
+                if( !inside_regions(rect, regions, i) )
+                    ep_rect_list_add(&ep_objects, rect.x, rect.y, rect.width, rect.height);
+            }
+        }
+
+        double const trace_begin( ep_trace_begin() );
+        working_set->groups.clear();
+        group_rectangles(ep_objects, objects, min_neighbors, working_set->groups);
+        ep_trace_end("group rectangles", trace_begin);
+
+        pthread_mutex_unlock(&working_set->detect_mutex);
+
+        return result;
+    }
+
+    EpErrorCode Detector::detect_batch_images(int const count, EpScaleRange const *const scale_range, std::string const &log_file) {
+        std::vector<EpImage> &ep_images(working_set->batch_images);
+        std::vector<EpRectList> &ep_objects(working_set->batch_objects);
+        std::vector<EpWorkspace> &workspaces(working_set->batch_workspaces);
+
+        while(static_cast<int>( ep_objects.size() ) < count)
+            ep_objects.push_back( ep_rect_list_create_empty() );
+        for(int i(0); i < count; ++i)
+            ep_objects[i].count = 0;
 
         EpErrorCode result(ERR_ARGUMENT);
 
-        if(detection_mode == DET_HOST)
-            result = ep_detect_multi_scale_host(&ep_image_aligned, classifier.get_data(), &ep_objects, scan_mode);
+        if(detection_mode == DET_HOST) {
+            //Octaves of all images of chunk are kept at once, so every image of chunk needs own working set
+            while(static_cast<int>( workspaces.size() ) < std::min(count, static_cast<int>(BATCH_CHUNK_IMAGES)))
+                workspaces.push_back( ep_workspace_create_empty() );
+            result = ep_detect_batch_host (
+                &ep_images[0], count, classifier.get_data(), &ep_objects[0], scan_mode, scale_range, &workspaces[0]
+            );
+        }
 
         if(detection_mode == DET_DEVICE)
-            result = ep_detect_multi_scale_device (
-                &ep_image_aligned,
-                 classifier.get_data(),
-                &ep_objects,
-                 scan_mode,
-                 num_cores,
-                log_file.length() ? log_file.c_str() : NULL
+            result = ep_detect_batch_device (
+                &ep_images[0], count, classifier.get_data(), &ep_objects[0], scan_mode, num_cores, device_flags,
+                log_file.length() ? log_file.c_str() : NULL, device, device_group, scale_range, &working_set->workspace
             );
 
-        group_rectangles(ep_objects, objects, min_neighbors);
+        return result;
+    }
 
-        ep_rect_list_release(&ep_objects);
+    void Detector::reset(void) {
+        pthread_mutex_lock(&working_set->detect_mutex);
+        working_set->level_stats = ep_level_stats_create_empty();
+        ep_frame_cache_release(&working_set->frame_cache);
+        pthread_mutex_unlock(&working_set->detect_mutex);
+    }
 
-        ep_image_release(&ep_image_aligned);
+    DetectionFuture Detector::detect_async (
+        cv::Mat           const &image,
+        DetectionCallback        callback,
+        void                    *user_data,
+        std::string       const &log_file
+    ) {
+        QueuedFrame const frame = { image, callback, user_data, log_file, DetectionFuture( new DetectionFuture::State() ) };
 
-        return result;
+        pthread_mutex_lock(&working_set->queue_mutex);
+
+        //Back-pressure: producer waits for the oldest frame while queue is full
+        while(working_set->in_flight >= queue_depth)
+            pthread_cond_wait(&working_set->frame_finished, &working_set->queue_mutex);
+
+        if(!working_set->worker_started) {
+            if( pthread_create(&working_set->worker, NULL, worker_main, this) ) {
+                pthread_mutex_unlock(&working_set->queue_mutex);
+                frame.future.state->finish( ERR_OTHER, std::vector<cv::Rect>() );
+                return frame.future;
+            }
+            working_set->worker_started = true;
+        }
+
+        working_set->queue.push_back(frame);
+        ++working_set->in_flight;
+        pthread_cond_signal(&working_set->frame_queued);
+
+        pthread_mutex_unlock(&working_set->queue_mutex);
+
+        return frame.future;
+    }
+
+    int Detector::in_flight(void) const {
+        pthread_mutex_lock(&working_set->queue_mutex);
+        int const count(working_set->in_flight);
+        pthread_mutex_unlock(&working_set->queue_mutex);
+        return count;
+    }
+
+    void Detector::flush(void) {
+        pthread_mutex_lock(&working_set->queue_mutex);
+        while(working_set->in_flight)
+            pthread_cond_wait(&working_set->frame_finished, &working_set->queue_mutex);
+        pthread_mutex_unlock(&working_set->queue_mutex);
+    }
+
+    void *Detector::worker_main(void *const detector_ptr) {
+        Detector &detector( *static_cast<Detector *>(detector_ptr) );
+        WorkingSet &working_set( *detector.working_set );
+        std::vector<cv::Rect> objects;
+
+        pthread_mutex_lock(&working_set.queue_mutex);
+        while(true) {
+            while(working_set.queue.empty() && !working_set.stopping)
+                pthread_cond_wait(&working_set.frame_queued, &working_set.queue_mutex);
+            if(working_set.queue.empty())
+                break; //Detector is being destroyed and all frames are finished
+
+            QueuedFrame const frame( working_set.queue.front() );
+            working_set.queue.pop_front();
+            pthread_mutex_unlock(&working_set.queue_mutex);
+
+            //Producer may queue next frames meanwhile
+            double const trace_begin( ep_trace_begin() );
+            pthread_mutex_lock(&working_set.detect_mutex);
+            EpErrorCode const result( detector.detect_frame(frame.image, objects, frame.log_file) );
+            pthread_mutex_unlock(&working_set.detect_mutex);
+            ep_trace_end("detect queued frame", trace_begin);
+
+            if(frame.callback)
+                frame.callback(result, objects, frame.user_data);
+            frame.future.state->finish(result, objects);
+
+            pthread_mutex_lock(&working_set.queue_mutex);
+            --working_set.in_flight;
+            pthread_cond_broadcast(&working_set.frame_finished);
+        }
+        pthread_mutex_unlock(&working_set.queue_mutex);
+
+        return NULL;
     }
 
 #ifdef __OPENCV_OBJDETECT_HPP__
@@ -278,7 +1037,9 @@ namespace ep
         }
         classifier_size += sizeof(EpNodeFinal); //One final node
 
-        EpCascadeClassifier const result = {static_cast<char *>( malloc(classifier_size) ), classifier_size};
+        EpCascadeClassifier result( ep_classifier_create_empty() );
+        result.data = static_cast<char *>( malloc(classifier_size) );
+        result.size = classifier_size;
 
         {
             EpNodeMeta &node_meta( *reinterpret_cast<EpNodeMeta *>(result.data) );
@@ -341,75 +1102,153 @@ namespace ep
         EpNodeFinal &node_final( *reinterpret_cast<EpNodeFinal *>(cur_node) );
         node_final.id = NODE_FINAL;
 
+        ep_classifier_bind(&result);
         return result;
     }
 #endif
 
     ////////////////////////////////////////////////////////
 
+    /**
+     * Classifier data shared by copies of ep::CascadeClassifier; deleted with the last reference
+     */
+    struct CascadeClassifier::Shared {
+        pthread_mutex_t mutex;
+        int references;
+        /// Bound classifier (@see ep_classifier_bind), never changed while shared
+        EpCascadeClassifier ep_classifier;
+
+        inline Shared(EpCascadeClassifier const &ep_classifier):
+            references(1), ep_classifier(ep_classifier)
+        {
+            pthread_mutex_init(&mutex, NULL);
+        }
+
+        inline ~Shared(void) {
+            ep_classifier_release(&ep_classifier);
+            pthread_mutex_destroy(&mutex);
+        }
+
+        inline void acquire(void) {
+            pthread_mutex_lock(&mutex);
+            ++references;
+            pthread_mutex_unlock(&mutex);
+        }
+
+        inline void release(void) {
+            pthread_mutex_lock(&mutex);
+            bool const last( --references == 0 );
+            pthread_mutex_unlock(&mutex);
+            if(last)
+                delete this;
+        }
+    };
+
+    /// Data of every empty classifier
+    static EpCascadeClassifier const empty_classifier( ep_classifier_create_empty() );
+
     CascadeClassifier::CascadeClassifier(void):
-    ep_cascade_classifier( ep_classifier_create_empty() )
+        shared(NULL)
     { ; }
 
     CascadeClassifier::CascadeClassifier(std::string const &file_name):
-        ep_cascade_classifier( ep_classifier_load(file_name.c_str(), NULL) )
-    { ; }
+        shared(NULL)
+    {
+        load(file_name);
+    }
 
 #ifdef __OPENCV_OBJDETECT_HPP__
     CascadeClassifier::CascadeClassifier(cv::CascadeClassifier const &cv_classifier):
-        ep_cascade_classifier( convert_cascade(cv_classifier) )
-    { ; }
+        shared(NULL)
+    {
+        assign( convert_cascade(cv_classifier) );
+    }
 
     CascadeClassifier &CascadeClassifier::operator=(cv::CascadeClassifier const &cv_classifier)
     {
-        ep_classifier_release(&ep_cascade_classifier);
-        ep_cascade_classifier = convert_cascade(cv_classifier);
+        assign( convert_cascade(cv_classifier) );
         return *this;
     }
 #endif
 
     CascadeClassifier::CascadeClassifier(CascadeClassifier const &classifier):
-        ep_cascade_classifier( ep_classifier_clone(&classifier.ep_cascade_classifier) )
-    { ; }
+        shared(classifier.shared)
+    {
+        if(shared)
+            shared->acquire();
+    }
 
     CascadeClassifier::~CascadeClassifier(void) {
         release();
     }
 
     CascadeClassifier &CascadeClassifier::operator=(CascadeClassifier const &classifier) {
-        if(classifier.ep_cascade_classifier.data == ep_cascade_classifier.data)
-            return *this;
+        if(classifier.shared)
+            classifier.shared->acquire();
+        release();
+        shared = classifier.shared;
+
+        return *this;
+    }
 
-        ep_classifier_release(&ep_cascade_classifier);
-        ep_cascade_classifier = ep_classifier_clone(&classifier.ep_cascade_classifier);
+#if __cplusplus >= 201103L
+    CascadeClassifier::CascadeClassifier(CascadeClassifier &&classifier):
+        shared(classifier.shared)
+    {
+        classifier.shared = NULL;
+    }
+
+    CascadeClassifier &CascadeClassifier::operator=(CascadeClassifier &&classifier) {
+        if(&classifier != this) {
+            release();
+            shared = classifier.shared;
+            classifier.shared = NULL;
+        }
 
         return *this;
     }
+#endif
 
     bool CascadeClassifier::empty(void) const {
-        return ep_classifier_is_empty(&ep_cascade_classifier) != 0;
+        return ep_classifier_is_empty( get_data() ) != 0;
     }
 
     void CascadeClassifier::release(void) {
-        ep_classifier_release(&ep_cascade_classifier);
+        if(shared)
+            shared->release();
+        shared = NULL;
     }
 
-    EpErrorCode CascadeClassifier::load(std::string const &file_name) {
+    void CascadeClassifier::assign(EpCascadeClassifier const &ep_classifier) {
         release();
+        if( !ep_classifier_is_empty(&ep_classifier) )
+            shared = new Shared(ep_classifier);
+    }
+
+    EpErrorCode CascadeClassifier::load(std::string const &file_name) {
         EpErrorCode result;
-        ep_cascade_classifier = ep_classifier_load(file_name.c_str(), &result);
+        assign( ep_classifier_load(file_name.c_str(), &result) );
         return result;
     }
 
     EpErrorCode CascadeClassifier::save(std::string const &file_name) const {
-        return ep_classifier_save( &ep_cascade_classifier, file_name.c_str() );
+        return ep_classifier_save( get_data(), file_name.c_str() );
+    }
+
+    EpErrorCode CascadeClassifier::compact(void) {
+        EpErrorCode result;
+        EpCascadeClassifier const compacted( ep_classifier_compact(get_data(), &result) );
+        //Copies sharing data keep the original encoding
+        if(result == ERR_SUCCESS)
+            assign(compacted);
+        return result;
     }
 
     EpCascadeClassifier const *CascadeClassifier::get_data(void) const {
-        return &ep_cascade_classifier;
+        return shared ? &shared->ep_classifier : &empty_classifier;
     }
 
     int CascadeClassifier::get_size(void) const {
-        return ep_cascade_classifier.size;
+        return get_data()->size;
     }
 }
@@ -37,7 +37,9 @@ namespace ep {
 /**
  * This is classifier usable by detect_multi_scale function.
  * Can be converted from cv::CascadeClassifier.
- * Wrapper around EpCascadeClassifier
+ * Wrapper around EpCascadeClassifier. Classifier data is immutable and shared by copies of classifier
+ *   together with data derived from it (@see EpClassifierBinding): copying only takes a reference,
+ *   while load(), compact() and assignments replace data of this classifier without changing its copies.
  */
 class CascadeClassifier {
 public:
@@ -51,19 +53,26 @@ public:
     CascadeClassifier &operator=(cv::CascadeClassifier const &cv_classifier);
 #endif
 
-    /// Copy constructor
+    /// Copy constructor: data is shared with classifier
     CascadeClassifier(CascadeClassifier const &classifier);
 
     /// Destructor
     ~CascadeClassifier(void);
 
-    /// Assignment operator
+    /// Assignment operator: data is shared with classifier
     CascadeClassifier &operator=(CascadeClassifier const &classifier);
 
+#if __cplusplus >= 201103L
+    /// Move constructor: classifier becomes empty
+    CascadeClassifier(CascadeClassifier &&classifier);
+    /// Move assignment operator: classifier becomes empty
+    CascadeClassifier &operator=(CascadeClassifier &&classifier);
+#endif
+
     /// Determine whether classifier is empty
     bool empty(void) const;
 
-    /// Release classifier data
+    /// Release classifier data (data is freed when the last classifier sharing it releases it)
     void release(void);
 
     /// Load classifier contents from file
@@ -72,6 +81,9 @@ public:
     /// Save classifier contents to binary file
     EpErrorCode save(std::string const &file_name) const;
 
+    /// Convert classifier to compact encoding (@see ep_classifier_compact). Classifier is unchanged on error
+    EpErrorCode compact(void);
+
     /// Get classifier data usable by C function ep_detect_multi_scale()
     EpCascadeClassifier const *get_data(void) const;
     
@@ -79,7 +91,13 @@ public:
     int get_size(void) const;
 
 private:
-    EpCascadeClassifier ep_cascade_classifier;
+    struct Shared;
+
+    /// Replace data of this classifier with ep_classifier (takes ownership of its buffer)
+    void assign(EpCascadeClassifier const &ep_classifier);
+
+    /// Shared data; NULL for empty classifier
+    Shared *shared;
 };
 
 /**
@@ -87,6 +105,13 @@ private:
  * In addition this routine does objects grouping.
  * @param min_neighbors: minimal number of detections in detection group.
  *                       if this value is zero then grouping is disabled.
+ * @param level_stats  : per-level statistics kept between frames of a stream
+ *                       to order device tasks by cost (may be NULL).
+ * @param device_flags : combination of EpDeviceFlags (device detection only).
+ * @param device       : chip opened by ep_device_open() (device detection only).
+ * @param device_group : group of cores to run device detection on (@see ep_device_groups_create);
+ *                       NULL to use the whole chip.
+ * @param frame_cache  : task list of previous frame of a stream reused by device detection (may be NULL).
  */
 EpErrorCode detect_multi_scale (
     cv::Mat               const &image,
@@ -96,9 +121,168 @@ EpErrorCode detect_multi_scale (
     EpScanMode            const  scan_mode      = SCAN_EVEN,
     EpDetectionMode       const  detection_mode = DET_HOST,
     int                          num_cores      = 16,
-    std::string           const &log_file       = std::string()
+    std::string           const &log_file       = std::string(),
+    EpLevelStats                *level_stats    = NULL,
+    int                   const  device_flags   = DEVICE_DEFAULT,
+    EpDevice                    *device         = NULL,
+    EpDeviceGroup         const *device_group   = NULL,
+    EpFrameCache                *frame_cache    = NULL
 );
 
+/**
+ * Group raw detections (e.g. found by C routines) the same way detect_multi_scale() does.
+ * @param ep_rectangles: raw detections.
+ * @param rectangles   : receives grouped detections.
+ * @param min_neighbors: minimal number of detections in detection group.
+ *                       if this value is zero then grouping is disabled.
+ */
+void group_rectangles(EpRectList const &ep_rectangles, std::vector<cv::Rect> &rectangles, int const min_neighbors);
+
+/**
+ * Called by Detector when asynchronous detection of a frame finishes (@see Detector::detect_async).
+ *   It is called from detector's worker thread, so it must not submit frames to the same detector.
+ * @param result   : result of detection;
+ * @param objects  : grouped detections of the frame;
+ * @param user_data: value passed to Detector::detect_async().
+ */
+typedef void (*DetectionCallback)(EpErrorCode result, std::vector<cv::Rect> const &objects, void *user_data);
+
+/**
+ * Result of asynchronous detection of a frame (@see Detector::detect_async).
+ *   Handles are copyable and share the result; they may outlive detector.
+ */
+class DetectionFuture {
+public:
+    /// Create handle not referring to any detection
+    DetectionFuture(void);
+    /// Copy constructor
+    DetectionFuture(DetectionFuture const &future);
+    /// Destructor
+    ~DetectionFuture(void);
+    /// Assignment operator
+    DetectionFuture &operator=(DetectionFuture const &future);
+
+    /// Determine whether handle refers to a detection
+    bool valid(void) const;
+    /// Determine whether detection is finished; does not block
+    bool ready(void) const;
+    /// Wait until detection is finished
+    void wait(void) const;
+    /// Wait until detection is finished and get its detections
+    EpErrorCode get(std::vector<cv::Rect> &objects) const;
+
+private:
+    friend class Detector;
+    struct State;
+
+    explicit DetectionFuture(State *state);
+
+    State *state;
+};
+
+/**
+ * Detector of objects in frames of a stream. It keeps everything which can be reused between frames:
+ *   pyramid buffers, detections list, grouping state, per-level statistics and task list of device detection.
+ *   Repeated detection on frames of the same size does not allocate memory once lists have grown
+ *   to the number of detections and device task list is cached (allocations of eHAL are not counted). Detector keeps a copy of classifier sharing its data, so detectors of many streams
+ *   use one classifier buffer; device group is bound by reference and must outlive detector.
+ *   Device detectors on disjoint core groups run at the same time; detectors sharing cores (e.g. several
+ *   detectors on the whole chip) are serialised, so their frames are detected one after another.
+ *   Host detection uses OpenMP thread pool, which is kept by OpenMP runtime between calls.
+ *   Frames may be detected synchronously or queued to worker thread (@see detect_async), which is started
+ *   on the first queued frame; calls of both kinds may be mixed and are served one at a time.
+ */
+class Detector {
+public:
+    /// Bind detector to classifier; parameters have the same meaning as in detect_multi_scale().
+    /// queue_depth is the maximal number of frames in flight of asynchronous detection (@see detect_async)
+    Detector (
+        CascadeClassifier const &classifier,
+        int               const  min_neighbors  = 3,
+        EpScanMode        const  scan_mode      = SCAN_EVEN,
+        EpDetectionMode   const  detection_mode = DET_HOST,
+        int               const  num_cores      = 16,
+        int               const  device_flags   = DEVICE_DEFAULT,
+        EpDevice                *device         = NULL,
+        EpDeviceGroup     const *device_group   = NULL,
+        int               const  queue_depth    = 2
+    );
+
+    /// Destructor
+    ~Detector(void);
+
+    /// Detect objects in the next frame (@see detect_multi_scale). Image is only read
+    EpErrorCode detect(cv::Mat const &image, std::vector<cv::Rect> &objects, std::string const &log_file = std::string());
+
+    /// Detect objects in many images at once (@see ep_detect_batch_host, ep_detect_batch_device).
+    /// results get detections of every image. Images are only read
+    EpErrorCode detect_batch (
+        std::vector<cv::Mat>               const &images,
+        std::vector< std::vector<cv::Rect> >     &results,
+        std::string                        const &log_file = std::string()
+    );
+
+    /// Detect objects only inside regions of the frame, e.g. around objects followed by a tracker.
+    /// Regions are clipped to image, and overlapping ones are merged into their bounding rectangle unless it is
+    /// much larger than area of the regions; then they are scanned alone, and duplicate detections are dropped.
+    /// Pyramid is built for every region alone, so only windows lying inside a region are scanned
+    /// and cost follows regions area. Regions are detected as one batch (@see detect_batch), and their
+    /// detections are grouped together in image coordinates. scale_range limits scales of detections
+    /// (@see EpScaleRange; may be NULL for all scales). Image is only read
+    EpErrorCode detect_in_regions (
+        cv::Mat               const &image,
+        std::vector<cv::Rect> const &rois,
+        std::vector<cv::Rect>       &objects,
+        EpScaleRange          const *scale_range = NULL,
+        std::string           const &log_file    = std::string()
+    );
+
+    /// Forget statistics and task list of previous frames (e.g. when another stream starts)
+    void reset(void);
+
+    /// Queue the next frame for detection on detector's worker thread and return at once.
+    /// Frames are detected one after another in submission order; if queue_depth frames are already
+    /// in flight, call blocks until the oldest of them is finished. Image data is not copied,
+    /// so it must not be modified until detection is finished (pass image.clone() to reuse the buffer).
+    /// callback (may be NULL) is called with detections before returned future becomes ready
+    DetectionFuture detect_async (
+        cv::Mat           const &image,
+        DetectionCallback        callback  = NULL,
+        void                    *user_data = NULL,
+        std::string       const &log_file  = std::string()
+    );
+    /// Number of frames queued or being detected asynchronously
+    int in_flight(void) const;
+    /// Wait until all frames queued for asynchronous detection are finished
+    void flush(void);
+
+private:
+    /// Detector is not copyable
+    Detector(Detector const &);
+    Detector &operator=(Detector const &);
+
+    struct WorkingSet;
+
+    /// Detect objects in the next frame; must be called with WorkingSet::detect_mutex locked
+    EpErrorCode detect_frame(cv::Mat const &image, std::vector<cv::Rect> &objects, std::string const &log_file);
+    /// Detect objects in borrowed images of batch (WorkingSet::batch_images) into WorkingSet::batch_objects;
+    /// must be called with WorkingSet::detect_mutex locked
+    EpErrorCode detect_batch_images(int const count, EpScaleRange const *scale_range, std::string const &log_file);
+    /// Worker thread of asynchronous detection: takes frames from queue until detector is destroyed
+    static void *worker_main(void *detector);
+
+    CascadeClassifier const classifier;
+    int const min_neighbors;
+    EpScanMode const scan_mode;
+    EpDetectionMode const detection_mode;
+    int const num_cores;
+    int const device_flags;
+    EpDevice *const device;
+    EpDeviceGroup const *const device_group;
+    int const queue_depth;
+    WorkingSet *const working_set;
+};
+
 }
 
 #endif
@@ -32,6 +32,7 @@
 #include <opencv2/imgproc/imgproc.hpp>
 
 #include "cpp/ep_cascade_detector.hpp"
+#include "c/ep_trace.h"
 
 int main(int argc, char **argv) {
 
@@ -42,18 +43,46 @@ int main(int argc, char **argv) {
         "{ o | output | | Output filename }"
         "{ h | host | 0 | Run detection on host }"
         "{ n | numcores | 16 | Number of working cores }"
-        "{ l | log | | Name of log-file }"
+        "{ l | log | | Name of log-file (timeline trace.json is written next to it) }"
+        "{ t | tiles | 0 | Upload tiles contiguously (tile-major layout) for device detection }"
+        "{ p | pyramid | 0 | Compute pyramid levels on cores for device detection }"
+        "{ s | pipeline | 0 | Split classifier stages between front and back cores for device detection }"
+        "{ k | compact | 0 | Convert cascade to compact encoding }"
+        "{ w | save | | Save cascade to binary file (e.g. after conversion) }"
+#ifdef DEVICE_EMULATION
+        "{ m | model | 0 | Estimate cores times with emulator cost model instead of measuring host time }"
+#endif //DEVICE_EMULATION
     );
 
     cv::CommandLineParser cmd(argc, argv, keys);
     std::string const fn_image( cmd.get<std::string>("input") ),
                       fn_classifier( cmd.get<std::string>("classifier") ),
-                      fn_log( cmd.get<std::string>("log") );
+                      fn_log( cmd.get<std::string>("log") ),
+                      fn_save_classifier( cmd.get<std::string>("save") );
     std::string fn_output( cmd.get<std::string>("output") );
     int const detections_group( cmd.get<int>("grouping") );
     int const num_cores( cmd.get<int>("numcores") );
     bool const host_only(cmd.get<int>("host") != 0);
+    int const device_flags( (cmd.get<int>("tiles")   != 0 ? DEVICE_TILE_MAJOR : DEVICE_DEFAULT) |
+                            (cmd.get<int>("pyramid") != 0 ? DEVICE_PYRAMID    : DEVICE_DEFAULT) |
+                            (cmd.get<int>("pipeline") != 0 ? DEVICE_STAGE_PIPELINE : DEVICE_DEFAULT) );
+
+#ifdef DEVICE_EMULATION
+    if( cmd.get<int>("model") != 0 ) {
+        EpEmulatorModel const model( emulator_model_create_default() );
+        emulator_model_set(&model);
+    }
+#endif //DEVICE_EMULATION
 
+    //Timeline of detection for chrome://tracing or Perfetto
+    if( !fn_log.empty() ) {
+        std::string const fn_trace( fn_log.substr(0, fn_log.find_last_of('/') + 1) + "trace.json" );
+        if( ep_trace_start( fn_trace.c_str() ) != ERR_SUCCESS )
+            std::cout << "Error creating trace file " << fn_trace << std::endl;
+    }
+
+    //Chip is opened once for all device detections
+    EpDevice device;
     if( !host_only ) {
         /*      
         std::string const server_ip( "127.0.0.1" );
@@ -66,6 +95,13 @@ int main(int argc, char **argv) {
         }
         std::cout << " Done." << std::endl; 
 		*/
+
+        std::cout << "Opening chip..." << std::flush;
+        if( ep_device_open(&device) != ERR_SUCCESS ) {
+            std::cout << " Can't initialise eHAL." << std::endl;
+            return -1;
+        }
+        std::cout << " Done." << std::endl;
     }
 
     std::cout << "Loading image " << fn_image << "..." << std::flush;
@@ -107,7 +143,7 @@ int main(int argc, char **argv) {
         classifier_ep.load(fn_classifier);
     }
 #else
-    ep::CascadeClassifier const classifier_ep(fn_classifier);
+    ep::CascadeClassifier classifier_ep(fn_classifier);
 #endif
 
     if( classifier_ep.empty() ) {
@@ -116,6 +152,20 @@ int main(int argc, char **argv) {
     }
 
     std::cout << " Done. Classifier size is " << classifier_ep.get_size() << " bytes." << std::endl;
+
+    if( cmd.get<int>("compact") != 0 ) {
+        std::cout << "Converting cascade to compact encoding..." << std::flush;
+        if( classifier_ep.compact() != ERR_SUCCESS ) {
+            std::cout << " Error converting cascade." << std::endl;
+            return -1;
+        }
+        std::cout << " Done. Classifier size is " << classifier_ep.get_size() << " bytes." << std::endl;
+    }
+
+    if( !fn_save_classifier.empty() && classifier_ep.save(fn_save_classifier) != ERR_SUCCESS ) {
+        std::cout << "Error saving cascade to " << fn_save_classifier << std::endl;
+        return -1;
+    }
     //classifier.save("lbpcascade_frontalface.dat");
 
     if(f_video) {
@@ -136,23 +186,29 @@ int main(int argc, char **argv) {
 
     cv::Mat canvas;
 
+    //Detector keeps pyramid buffers, statistics of previous frame (used to balance device load on the next one)
+    //and device task list (reused while frame size stays the same)
+    ep::Detector detector (
+        classifier_ep,
+        detections_group,
+        SCAN_EVEN,
+        host_only ? DET_HOST : DET_DEVICE,
+        num_cores,
+        device_flags,
+        host_only ? NULL : &device
+    );
+
     while(true) {
         std::vector<cv::Rect> objects_ep, objects_cv;
 
         {
-            std::cout << "Detecting objects via ep::detect_multi_scale..." << std::endl;
+            std::cout << "Detecting objects via ep::Detector..." << std::endl;
             int64 const timeStart( cv::getTickCount() );
+            double const trace_begin( ep_trace_begin() );
 
-            ep::detect_multi_scale (
-                image,
-                classifier_ep,
-                objects_ep,
-                detections_group,
-                SCAN_EVEN,
-                host_only ? DET_HOST : DET_DEVICE,
-                num_cores,
-                fn_log
-            );
+            detector.detect(image, objects_ep, fn_log);
+
+            ep_trace_end("detect frame", trace_begin);
 
             int64 const timeStop( cv::getTickCount() );
             std::cout << "Done in " << (timeStop - timeStart) / cv::getTickFrequency() << " sec." << std::endl;
@@ -202,6 +258,8 @@ int main(int argc, char **argv) {
 
     std::cout << " Done." << std::endl;
 
+    ep_trace_stop();
+
     if( !host_only ) {
 		/*
 		std::cout << "Disconnecting from e-server..." << std::flush;
@@ -211,6 +269,8 @@ int main(int argc, char **argv) {
         }
         std::cout << " Done." << std::endl;
 		*/
+
+        ep_device_close(&device);
     }
 
     return 0;
@@ -0,0 +1,290 @@
+/* <title of the code in this file>
+   Copyright (C) 2012 Adapteva, Inc.
+   
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program, see the file COPYING.  If not, see
+   <http://www.gnu.org/licenses/>. */
+/**
+ * Benchmark of detections grouping (@see ep::group_rectangles).
+ *   Grouping through grid of rectangle centres is compared with the previous algorithm, which checked
+ *   every pair of rectangles and rescanned all rectangles to pick each group (kept below as reference).
+ *   Synthetic crowds are generated from fixed seed: LAYOUTS_COUNT small layouts with random min_neighbors
+ *   check equivalence, then crowds of 10000, 20000 and 40000 rectangles are timed with both algorithms.
+ *
+ * Usage: bench_group_rectangles
+ * Exit code is zero if both algorithms give identical groups on every layout.
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "../cpp/ep_cascade_detector.hpp"
+
+enum {
+    /// Number of random layouts checked for equivalence
+    LAYOUTS_COUNT = 60,
+    /// Number of detected objects in crowds of timed runs (40 columns of objects)
+    CROWD_OBJECTS = 1600
+};
+
+/**
+ * Previous grouping algorithm: all pairs of rectangles are checked, and every group is picked by full scan.
+ */
+namespace reference
+{
+    /**
+     * Index of the rectangle and amount of its intersection with current rectangle
+     */
+    struct RectsIntersection {
+        int index;
+        float amount;
+        inline RectsIntersection(int const index, float const amount):
+            index(index), amount(amount)
+        { ; }
+    };
+
+    /**
+     * List of intersections with current rectangle
+     */
+    struct IntersectionsList {
+        float total_amount;
+        std::vector<RectsIntersection> intersections;
+        inline IntersectionsList(void):
+            total_amount(1.0f), intersections() //Item intersects with itself, hence 1.0f here
+        { ; }
+    };
+
+    /**
+     * Remove rectangle from list of lists of intersection
+     */
+    void remove_item(std::vector<IntersectionsList> &intersections, int const remove_index) {
+        IntersectionsList &item( intersections[remove_index] );
+
+        for(int i(0); i < static_cast<int>( item.intersections.size() ); ++i) {
+            IntersectionsList &opposite_list( intersections[item.intersections[i].index] );
+
+            for(int j(0); j < static_cast<int>( opposite_list.intersections.size() ); ++j) {
+                if(opposite_list.intersections[j].index != remove_index)
+                    continue;
+
+                opposite_list.total_amount -= opposite_list.intersections[j].amount;
+                opposite_list.intersections[j] = opposite_list.intersections.back();
+                opposite_list.intersections.pop_back();
+
+                break;
+            }
+        }
+
+        item.total_amount = 0.0f; //Zero value means that rectangle is removed
+        item.intersections.clear();
+    }
+
+    /**
+     * Length of intersection of two segments [a1, a2] and [b1, b2]
+     */
+    inline float intersection_len(float const a1, float const a2, float const b1, float const b2) {
+        return std::max(std::min(a2, b2) - std::max(a1, b1), 0.0f);
+    }
+
+    /**
+     * Amount of intersection of two rectangles
+     * @return value from 0.0f to 1.0f which is equal to ratio between rectangles intersection area and rectangles union area
+     */
+    inline float intersection_amount(EpRect const &r1, EpRect const &r2) {
+        float amount( intersection_len(r1.x, r1.x + r1.width, r2.x, r2.x + r2.width) );
+        if(!amount) return 0.0f;
+        amount *= intersection_len(r1.y, r1.y + r1.height, r2.y, r2.y + r2.height);
+        if(!amount) return 0.0f;
+        return amount / (r1.width * r1.height + r2.width * r2.height - amount);
+    }
+
+    /**
+     * Round given floating points coordinates to rectangle with integer coordinates
+     */
+    inline cv::Rect round_rect(float const x, float const y, float const width, float const height) {
+        int const xi1( cvRound(x        ) ), yi1( cvRound(y         ) ),
+                  xi2( cvRound(x + width) ), yi2( cvRound(y + height) );
+        return cv::Rect(xi1, yi1, xi2 - xi1, yi2 - yi1);
+    }
+
+    /**
+     * Group rectangles
+     * @param ep_rectangles: source detections
+     * @param rectangles: resulting grouped detections
+     * @param min_neighbors: if zero then source rectangles will be just copied to result. Otherwise grouping is performed. Groups containing less than min_neighbors are discarded
+     */
+    void group_rectangles (
+        EpRectList const &ep_rectangles,
+        std::vector<cv::Rect> &rectangles,
+        int const min_neighbors
+    ) {
+        rectangles.clear();
+
+        if(min_neighbors < 1) {
+            for(int i(0); i < ep_rectangles.count; ++i)
+                rectangles.push_back( round_rect (
+                    ep_rectangles.data[i].x    , ep_rectangles.data[i].y     ,
+                    ep_rectangles.data[i].width, ep_rectangles.data[i].height
+                ) );
+            return;
+        }
+
+        std::vector<IntersectionsList> intersections(ep_rectangles.count);
+
+        for(int i1 = 0; i1 < ep_rectangles.count - 1; ++i1) {
+            for(int i2(i1 + 1); i2 < ep_rectangles.count; ++i2) {
+                float const amount( intersection_amount( ep_rectangles.data[i1], ep_rectangles.data[i2] ) );
+                if(amount < 0.5f)
+                    continue;
+
+                intersections[i1].total_amount += amount;
+                intersections[i1].intersections.push_back( RectsIntersection(i2, amount) );
+
+                intersections[i2].total_amount += amount;
+                intersections[i2].intersections.push_back( RectsIntersection(i1, amount) );
+            }
+        }
+
+        while(true) {
+            float best_amount(0.0f);
+            int best_index(-1);
+
+            for(int i(0); i < ep_rectangles.count; ++i) {
+                if(static_cast<int>( intersections[i].intersections.size() ) + 1 < min_neighbors)
+                    continue;
+
+                if(intersections[i].total_amount > best_amount) {
+                    best_amount = intersections[i].total_amount;
+                    best_index = i;
+                }
+            }
+
+            if(best_index < 0)
+                break;
+
+            IntersectionsList &best_list( intersections[best_index] );
+
+            EpRect &rectangle( ep_rectangles.data[best_index] );
+
+            float sum_x(rectangle.x), sum_y(rectangle.y),
+                  sum_width(rectangle.width), sum_height(rectangle.height);
+
+            float const sum_k(best_list.total_amount);
+
+            while( best_list.intersections.size() ) {
+                float const k(best_list.intersections.front().amount);
+                int const index(best_list.intersections.front().index);
+
+                EpRect const &rectangle( ep_rectangles.data[index] );
+                sum_x += rectangle.x * k; sum_y += rectangle.y * k;
+                sum_width += rectangle.width * k; sum_height += rectangle.height * k;
+
+                remove_item(intersections, index);
+            }
+
+            best_list.total_amount = 0.0f;
+            best_list.intersections.clear();
+
+            rectangles.push_back( round_rect (
+                sum_x     / sum_k, sum_y      / sum_k,
+                sum_width / sum_k, sum_height / sum_k
+            ) );
+        }
+    }
+}
+
+/**
+ * @return monotonic time in seconds
+ */
+static double now(void) {
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+/**
+ * Add detections of crowd: objects are placed on grid with 60 pixels step, and every detection is shifted
+ *   by few pixels and scaled by one of pyramid scales, like detections of neighbouring windows and levels.
+ * @param rectangles: receives detections
+ * @param count     : number of detections
+ * @param objects   : number of objects in crowd
+ */
+static void add_crowd(EpRectList &rectangles, int const count, int const objects) {
+    for(int i(0); i < count; ++i) {
+        int const object( rand() % objects );
+        float const size( 24.0f * powf(1.19f, static_cast<float>(rand() % 12)) * (1.0f + (rand() % 5) * 0.02f) );
+        float const x( (object % 40) * 60 + rand() % 9 - 4 + (rand() % 3) * 0.25f ),
+                    y( (object / 40) * 60 + rand() % 9 - 4 );
+        ep_rect_list_add(&rectangles, x, y, size, size * (rand() % 7 ? 1.0f : 1.1f));
+    }
+}
+
+static bool same_groups(std::vector<cv::Rect> const &a, std::vector<cv::Rect> const &b) {
+    if( a.size() != b.size() )
+        return false;
+    for(size_t i(0); i < a.size(); ++i)
+        if(a[i].x != b[i].x || a[i].y != b[i].y || a[i].width != b[i].width || a[i].height != b[i].height)
+            return false;
+    return true;
+}
+
+int main(void) {
+    int mismatches(0);
+
+    //Groups must be identical, in the same order
+    srand(5);
+    for(int layout(0); layout < LAYOUTS_COUNT; ++layout) {
+        EpRectList rectangles( ep_rect_list_create_empty() );
+        int const count( 100 + rand() % 2000 ), objects( 1 + rand() % 400 ), min_neighbors( 1 + rand() % 4 );
+        add_crowd(rectangles, count, objects);
+
+        std::vector<cv::Rect> groups, expected;
+        ep::group_rectangles(rectangles, groups, min_neighbors);
+        reference::group_rectangles(rectangles, expected, min_neighbors);
+        if( !same_groups(groups, expected) )
+            ++mismatches;
+
+        ep_rect_list_release(&rectangles);
+    }
+    std::cout << LAYOUTS_COUNT << " layouts, " << mismatches << " mismatches" << std::endl;
+
+    int const sizes[] = {10000, 20000, 40000};
+    for(int i(0); i < 3; ++i) {
+        EpRectList rectangles( ep_rect_list_create_empty() );
+        add_crowd(rectangles, sizes[i], CROWD_OBJECTS);
+
+        std::vector<cv::Rect> groups, expected;
+        double const time_start( now() );
+        ep::group_rectangles(rectangles, groups, 3);
+        double const time_grid( now() );
+        reference::group_rectangles(rectangles, expected, 3);
+        double const time_reference( now() );
+
+        bool const same( same_groups(groups, expected) );
+        if(!same)
+            ++mismatches;
+        std::cout << std::fixed << std::setprecision(3) << sizes[i] << " rectangles, " << groups.size() << " groups: "
+                  << time_reference - time_grid << " s -> " << time_grid - time_start << " s"
+                  << (same ? "" : ", groups differ") << std::endl;
+
+        ep_rect_list_release(&rectangles);
+    }
+
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,154 @@
+/* <title of the code in this file>
+   Copyright (C) 2012 Adapteva, Inc.
+   
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program, see the file COPYING.  If not, see
+   <http://www.gnu.org/licenses/>. */
+/**
+ * Test of memory allocations of repeated detection by ep::Detector.
+ *   Frames of the same size are detected one after another; after WARMUP_FRAMES frames (lists have grown,
+ *   device task list is cached) detection must not allocate memory. Allocations are counted by wrapping
+ *   malloc, realloc and calloc (program is linked with -Wl,--wrap=malloc,--wrap=realloc,--wrap=calloc)
+ *   and by replacing operator new. Allocations of OpenMP runtime and eHAL libraries are not counted.
+ *
+ * Usage: detector_allocations <image> [classifier] [host|device]
+ * Exit code is zero if frames after warm-up do not allocate memory.
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <vector>
+
+#ifdef DEVICE_EMULATION
+    #include "../c/ep_emulator.h"
+#endif //DEVICE_EMULATION
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include "../cpp/ep_cascade_detector.hpp"
+
+enum {
+    /// Frames which may allocate memory
+    WARMUP_FRAMES = 3,
+    /// Frames detected in total
+    FRAMES_COUNT = 8
+};
+
+#if __cplusplus >= 201103L
+    #define EP_NOTHROW noexcept
+#else
+    #define EP_NOTHROW throw()
+#endif
+
+/// Non-zero while allocations are counted
+static int counting = 0;
+/// Number of allocations counted
+static long allocations = 0;
+
+static void count_allocation(void) {
+    if(counting)
+        __sync_fetch_and_add(&allocations, 1);
+}
+
+extern "C" {
+    void *__real_malloc(size_t size);
+    void *__real_realloc(void *ptr, size_t size);
+    void *__real_calloc(size_t count, size_t size);
+
+    void *__wrap_malloc(size_t size) {
+        count_allocation();
+        return __real_malloc(size);
+    }
+
+    void *__wrap_realloc(void *ptr, size_t size) {
+        count_allocation();
+        return __real_realloc(ptr, size);
+    }
+
+    void *__wrap_calloc(size_t count, size_t size) {
+        count_allocation();
+        return __real_calloc(count, size);
+    }
+}
+
+void *operator new(std::size_t size) {
+    count_allocation();
+    void *const ptr( __real_malloc(size ? size : 1) );
+    if(!ptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete(void *ptr) EP_NOTHROW {
+    free(ptr);
+}
+
+int main(int argc, char **argv) {
+    if(argc < 2) {
+        std::cout << "Usage: detector_allocations <image> [classifier] [host|device]" << std::endl;
+        return 2;
+    }
+    std::string const fn_classifier( argc > 2 ? argv[2] : "lbpcascade_frontalface.dat" ),
+                      mode( argc > 3 ? argv[3] : "host" );
+
+    cv::Mat const image( cv::imread(argv[1], CV_LOAD_IMAGE_GRAYSCALE) );
+    if( image.empty() ) {
+        std::cout << "Can't load image " << argv[1] << std::endl;
+        return 2;
+    }
+
+    ep::CascadeClassifier const classifier(fn_classifier);
+    if( classifier.empty() ) {
+        std::cout << "Can't load classifier " << fn_classifier << std::endl;
+        return 2;
+    }
+
+    EpDetectionMode const detection_mode( mode == "device" ? DET_DEVICE : DET_HOST );
+    EpDevice device;
+    if(detection_mode == DET_DEVICE && ep_device_open(&device) != ERR_SUCCESS) {
+        std::cout << "Can't open chip" << std::endl;
+        return 2;
+    }
+
+    long steady_allocations(0);
+    {
+        ep::Detector detector (
+            classifier, 3, SCAN_EVEN, detection_mode, MAX_CORES_NUM, DEVICE_DEFAULT,
+            detection_mode == DET_DEVICE ? &device : NULL
+        );
+        std::vector<cv::Rect> objects;
+
+        for(int frame = 0; frame < FRAMES_COUNT; ++frame) {
+            allocations = 0;
+            counting = 1;
+            EpErrorCode const result( detector.detect(image, objects) );
+            counting = 0;
+
+            std::cout << "Frame " << frame << ": result " << result << ", " << objects.size() << " objects, "
+                      << allocations << " allocations" << std::endl;
+            if(result != ERR_SUCCESS)
+                return 1;
+            if(frame >= WARMUP_FRAMES)
+                steady_allocations += allocations;
+        }
+    }
+
+    if(detection_mode == DET_DEVICE)
+        ep_device_close(&device);
+
+    std::cout << "detector_allocations (" << mode << "): " << steady_allocations
+              << " allocations after warm-up" << std::endl;
+    return steady_allocations ? 1 : 0;
+}
@@ -0,0 +1,139 @@
+/* <title of the code in this file>
+   Copyright (C) 2012 Adapteva, Inc.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program, see the file COPYING.  If not, see
+   <http://www.gnu.org/licenses/>. */
+/**
+ * Check of stage pipeline on crowded frames (@see DEVICE_STAGE_PIPELINE).
+ *   Every detection of back cores goes through the shared results ring, so on crowded frames the ring
+ *   wraps during one frame. Raw detections (no grouping) of stage pipeline must be equal
+ *   to raw detections of replicated classifier (every core runs whole cascade).
+ *   Frames are the image itself and mosaic of MOSAIC_SIZE x MOSAIC_SIZE copies of the image reduced to fit its size.
+ *
+ * Usage: pipeline_results <image> [classifier]
+ * Exit code is zero if detections are equal.
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#ifdef DEVICE_EMULATION
+    #include "../c/ep_emulator.h"
+#endif //DEVICE_EMULATION
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include "../cpp/ep_cascade_detector.hpp"
+
+enum {
+    /// Rows and columns of image copies in crowded frame
+    MOSAIC_SIZE = 3
+};
+
+static bool rect_less(cv::Rect const &a, cv::Rect const &b) {
+    if(a.x != b.x) return a.x < b.x;
+    if(a.y != b.y) return a.y < b.y;
+    if(a.width != b.width) return a.width < b.width;
+    return a.height < b.height;
+}
+
+static bool rect_equal(cv::Rect const &a, cv::Rect const &b) {
+    return a.x == b.x && a.y == b.y && a.width == b.width && a.height == b.height;
+}
+
+/**
+ * Compare detections regardless of their order.
+ */
+static bool same_objects(std::vector<cv::Rect> a, std::vector<cv::Rect> b) {
+    std::sort(a.begin(), a.end(), rect_less);
+    std::sort(b.begin(), b.end(), rect_less);
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), rect_equal);
+}
+
+/**
+ * Build frame of the image size holding MOSAIC_SIZE x MOSAIC_SIZE copies of the image (nearest pixel reduction).
+ */
+static cv::Mat create_mosaic(cv::Mat const &image) {
+    cv::Mat mosaic(image.rows, image.cols, image.type());
+    int const tile_width( image.cols / MOSAIC_SIZE ), tile_height( image.rows / MOSAIC_SIZE );
+    for(int y = 0; y < mosaic.rows; ++y) {
+        unsigned char const *const src( image.ptr(y % tile_height * MOSAIC_SIZE) );
+        unsigned char *const dst( mosaic.ptr(y) );
+        for(int x = 0; x < mosaic.cols; ++x)
+            dst[x] = src[x % tile_width * MOSAIC_SIZE];
+    }
+    return mosaic;
+}
+
+/**
+ * Detect raw objects on the frame with given device flags.
+ */
+static EpErrorCode detect_raw(cv::Mat const &frame, ep::CascadeClassifier const &classifier, int const device_flags,
+                              EpDevice *const device, std::vector<cv::Rect> &objects) {
+    return ep::detect_multi_scale (
+        frame, classifier, objects, 0, SCAN_EVEN, DET_DEVICE, MAX_CORES_NUM, std::string(), NULL, device_flags, device
+    );
+}
+
+int main(int argc, char **argv) {
+    if(argc < 2) {
+        std::cout << "Usage: pipeline_results <image> [classifier]" << std::endl;
+        return 2;
+    }
+    std::string const fn_classifier( argc > 2 ? argv[2] : "lbpcascade_frontalface.dat" );
+
+    cv::Mat const image( cv::imread(argv[1], CV_LOAD_IMAGE_GRAYSCALE) );
+    if( image.empty() ) {
+        std::cout << "Can't load image " << argv[1] << std::endl;
+        return 2;
+    }
+
+    ep::CascadeClassifier const classifier(fn_classifier);
+    if( classifier.empty() ) {
+        std::cout << "Can't load classifier " << fn_classifier << std::endl;
+        return 2;
+    }
+
+    EpDevice device;
+    if(ep_device_open(&device) != ERR_SUCCESS) {
+        std::cout << "Can't open chip" << std::endl;
+        return 2;
+    }
+
+    std::vector<cv::Mat> frames;
+    frames.push_back(image);
+    frames.push_back( create_mosaic(image) );
+
+    int mismatches( 0 );
+    for(size_t i = 0; i < frames.size(); ++i) {
+        std::vector<cv::Rect> replicated, pipeline;
+        EpErrorCode const replicated_result( detect_raw(frames[i], classifier, DEVICE_DEFAULT, &device, replicated) ),
+                          pipeline_result( detect_raw(frames[i], classifier, DEVICE_STAGE_PIPELINE, &device, pipeline) );
+
+        bool const same( replicated_result == ERR_SUCCESS && pipeline_result == ERR_SUCCESS && same_objects(replicated, pipeline) );
+        if(!same)
+            ++mismatches;
+
+        std::cout << "frame " << i << ": replicated " << replicated.size() << " raw detections (error " << replicated_result
+                  << "), pipeline " << pipeline.size() << " (error " << pipeline_result << ")"
+                  << (same ? "" : " -- MISMATCH") << std::endl;
+    }
+
+    ep_device_close(&device);
+
+    std::cout << "pipeline_results: " << frames.size() << " frames, " << mismatches << " mismatches" << std::endl;
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,197 @@
+/* <title of the code in this file>
+   Copyright (C) 2012 Adapteva, Inc.
+   
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program, see the file COPYING.  If not, see
+   <http://www.gnu.org/licenses/>. */
+/**
+ * Stress test of concurrent detection.
+ *   THREADS_COUNT host threads detect the same frames, each with its own ep::Detector, and every result
+ *   (error code and detections) must be equal to the result of single-threaded detection. Device detection runs either on the whole chip
+ *   (threads wait for cores of each other) or on groups of 2x2 cores (groups run at the same time).
+ *
+ * Usage: stress_threads <image> [classifier] [host|device|groups]
+ * Exit code is zero if all detections are equal.
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include <pthread.h>
+
+#ifdef DEVICE_EMULATION
+    #include "../c/ep_emulator.h"
+#endif //DEVICE_EMULATION
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include "../cpp/ep_cascade_detector.hpp"
+
+enum {
+    /// Number of detecting threads
+    THREADS_COUNT = 8,
+    /// Number of passes of every thread over frames
+    PASSES_COUNT = 2,
+    /// Rows and columns of cores in group for "groups" mode
+    GROUP_SIZE = 2
+};
+
+/**
+ * Frames and reference detections shared by threads (read-only while threads run)
+ */
+struct Test {
+    ep::CascadeClassifier const *classifier;
+    EpDetectionMode detection_mode;
+    EpDevice *device;
+    EpDeviceGroup groups[MAX_CORES_NUM];
+    int groups_count;
+    std::vector<cv::Mat> frames;
+    std::vector< std::vector<cv::Rect> > expected;
+    std::vector<EpErrorCode> expected_results;
+    int mismatches;
+};
+
+/**
+ * Thread of stress test
+ */
+struct Worker {
+    Test *test;
+    int index;
+};
+
+static bool rect_less(cv::Rect const &a, cv::Rect const &b) {
+    if(a.x != b.x) return a.x < b.x;
+    if(a.y != b.y) return a.y < b.y;
+    if(a.width != b.width) return a.width < b.width;
+    return a.height < b.height;
+}
+
+static bool rect_equal(cv::Rect const &a, cv::Rect const &b) {
+    return a.x == b.x && a.y == b.y && a.width == b.width && a.height == b.height;
+}
+
+/**
+ * Compare detections regardless of their order.
+ */
+static bool same_objects(std::vector<cv::Rect> a, std::vector<cv::Rect> b) {
+    std::sort(a.begin(), a.end(), rect_less);
+    std::sort(b.begin(), b.end(), rect_less);
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), rect_equal);
+}
+
+static int detection_cores(Test const &test) {
+    return test.groups_count ? GROUP_SIZE * GROUP_SIZE : MAX_CORES_NUM;
+}
+
+/**
+ * Detect all frames PASSES_COUNT times, starting from different frame in every thread.
+ */
+static void *worker_main(void *worker_ptr) {
+    Worker const &worker( *static_cast<Worker *>(worker_ptr) );
+    Test &test( *worker.test );
+    EpDeviceGroup const *const group( test.groups_count ? &test.groups[worker.index % test.groups_count] : NULL );
+
+    ep::Detector detector (
+        *test.classifier, 3, SCAN_EVEN, test.detection_mode, detection_cores(test), DEVICE_DEFAULT, test.device, group
+    );
+
+    int const count( static_cast<int>( test.frames.size() ) );
+    for(int pass = 0; pass < PASSES_COUNT; ++pass)
+        for(int i = 0; i < count; ++i) {
+            int const frame( (worker.index + i) % count );
+            std::vector<cv::Rect> objects;
+            if( detector.detect(test.frames[frame], objects) != test.expected_results[frame] ||
+                !same_objects(objects, test.expected[frame]) )
+                __sync_fetch_and_add(&test.mismatches, 1);
+        }
+
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    if(argc < 2) {
+        std::cout << "Usage: stress_threads <image> [classifier] [host|device|groups]" << std::endl;
+        return 2;
+    }
+    std::string const fn_classifier( argc > 2 ? argv[2] : "lbpcascade_frontalface.dat" ),
+                      mode( argc > 3 ? argv[3] : "device" );
+
+    cv::Mat const image( cv::imread(argv[1], CV_LOAD_IMAGE_GRAYSCALE) );
+    if( image.empty() ) {
+        std::cout << "Can't load image " << argv[1] << std::endl;
+        return 2;
+    }
+
+    ep::CascadeClassifier const classifier(fn_classifier);
+    if( classifier.empty() ) {
+        std::cout << "Can't load classifier " << fn_classifier << std::endl;
+        return 2;
+    }
+
+    Test test;
+    test.classifier = &classifier;
+    test.detection_mode = mode == "host" ? DET_HOST : DET_DEVICE;
+    test.groups_count = mode == "groups" ? ep_device_groups_create(GROUP_SIZE, GROUP_SIZE, test.groups) : 0;
+    test.mismatches = 0;
+
+    EpDevice device;
+    test.device = NULL;
+    if(test.detection_mode == DET_DEVICE) {
+        if(ep_device_open(&device) != ERR_SUCCESS) {
+            std::cout << "Can't open chip" << std::endl;
+            return 2;
+        }
+        test.device = &device;
+    }
+
+    //Whole image, its quarters and center (regions of image have step larger than width), and too small frame
+    int const w( image.cols / 2 ), h( image.rows / 2 );
+    test.frames.push_back(image);
+    test.frames.push_back( image( cv::Rect(0, 0, w, h) ) );
+    test.frames.push_back( image( cv::Rect(w, 0, image.cols - w, h) ) );
+    test.frames.push_back( image( cv::Rect(0, h, w, image.rows - h) ) );
+    test.frames.push_back( image( cv::Rect(w, h, image.cols - w, image.rows - h) ) );
+    test.frames.push_back( image( cv::Rect(w / 2, h / 2, w, h) ) );
+    test.frames.push_back( image( cv::Rect(0, 0, 10, 10) ) );
+
+    //Reference detections of single thread (whole image may not fit shared memory of group: then all fail alike)
+    {
+        ep::Detector detector (
+            classifier, 3, SCAN_EVEN, test.detection_mode, detection_cores(test), DEVICE_DEFAULT, test.device,
+            test.groups_count ? &test.groups[0] : NULL
+        );
+        test.expected.resize( test.frames.size() );
+        test.expected_results.resize( test.frames.size() );
+        for(size_t i = 0; i < test.frames.size(); ++i)
+            test.expected_results[i] = detector.detect(test.frames[i], test.expected[i]);
+    }
+
+    pthread_t threads[THREADS_COUNT];
+    Worker workers[THREADS_COUNT];
+    for(int i = 0; i < THREADS_COUNT; ++i) {
+        workers[i].test = &test;
+        workers[i].index = i;
+        pthread_create(&threads[i], NULL, worker_main, &workers[i]);
+    }
+    for(int i = 0; i < THREADS_COUNT; ++i)
+        pthread_join(threads[i], NULL);
+
+    if(test.device)
+        ep_device_close(test.device);
+
+    std::cout << "stress_threads (" << mode << "): " << THREADS_COUNT << " threads, " << test.frames.size()
+              << " frames, " << test.mismatches << " mismatches" << std::endl;
+    return test.mismatches ? 1 : 0;
+}
@@ -1,8 +1,28 @@
-g++ -I/opt/adapteva/esdk/tools/host/include -I/usr/local/include -O3 -g0 -Wall -c -fmessage-length=0 -fopenmp -MMD -MP EpFaceHost/cpp/ep_cascade_detector.cpp -o release/cpp/ep_cascade_detector.o
-gcc -I/opt/adapteva/esdk/tools/host/include -I/usr/local/include -O3 -g0 -Wall -c -fmessage-length=0 -fopenmp -MMD -MP -std=c99 EpFaceHost/c/ep_cascade_detector.c -o release/c/ep_cascade_detector.o
-gcc -I/opt/adapteva/esdk/tools/host/include -I/usr/local/include -O3 -g0 -Wall -c -fmessage-length=0 -fopenmp -MMD -MP -std=c99 EpFaceHost/c/ep_emulator.c -o release/c/ep_emulator.o
-g++ -I/opt/adapteva/esdk/tools/host/include -I/usr/local/include -O3 -g0 -Wall -c -fmessage-length=0 -fopenmp -MMD -MP EpFaceHost/main.cpp -o release/main.o
-g++ -L/opt/adapteva/esdk/tools/host/lib -z origin -fopenmp release/cpp/ep_cascade_detector.o release/c/ep_cascade_detector.o release/c/ep_emulator.o release/main.o -o release/EpFaceHost -lopencv_core -lopencv_highgui -lopencv_imgproc -lopencv_objdetect -lpthread -lm -le-hal -lrt -le-loader
+# "./build.sh emulator" builds host application with core code emulated on host (no Epiphany board required)
+if [ "$1" = "emulator" ]; then
+    EMULATION="-DDEVICE_EMULATION"
+    ELIBS=""
+else
+    EMULATION=""
+    ELIBS="-le-hal -lrt -le-loader"
+fi
 
-e-gcc EpFaceCore_commonlib/src/device_cascade_detector.c -O3 -ffast-math -Wall -std=c99 -T/opt/adapteva/esdk/bsps/current/internal.ldf -le-lib -o release/epiphany.elf
+g++ -I/opt/adapteva/esdk/tools/host/include -I/usr/local/include -O3 -g0 -Wall $EMULATION -c -fmessage-length=0 -fopenmp -MMD -MP EpFaceHost/cpp/ep_cascade_detector.cpp -o release/cpp/ep_cascade_detector.o
+gcc -I/opt/adapteva/esdk/tools/host/include -I/usr/local/include -O3 -g0 -Wall $EMULATION -c -fmessage-length=0 -fopenmp -MMD -MP -std=c99 EpFaceHost/c/ep_cascade_detector.c -o release/c/ep_cascade_detector.o
+gcc -I/opt/adapteva/esdk/tools/host/include -I/usr/local/include -O3 -g0 -Wall $EMULATION -c -fmessage-length=0 -fopenmp -MMD -MP -std=c99 EpFaceHost/c/ep_emulator.c -o release/c/ep_emulator.o
+gcc -I/opt/adapteva/esdk/tools/host/include -I/usr/local/include -O3 -g0 -Wall $EMULATION -c -fmessage-length=0 -fopenmp -MMD -MP -std=c99 EpFaceHost/c/ep_trace.c -o release/c/ep_trace.o
+g++ -I/opt/adapteva/esdk/tools/host/include -I/usr/local/include -O3 -g0 -Wall $EMULATION -c -fmessage-length=0 -fopenmp -MMD -MP EpFaceHost/main.cpp -o release/main.o
+g++ -L/opt/adapteva/esdk/tools/host/lib -z origin -fopenmp release/cpp/ep_cascade_detector.o release/c/ep_cascade_detector.o release/c/ep_emulator.o release/c/ep_trace.o release/main.o -o release/EpFaceHost -lopencv_core -lopencv_highgui -lopencv_imgproc -lopencv_objdetect -lpthread -lm $ELIBS
+
+# Test programs; run them from release directory, e.g. "tests/stress_threads g20.jpg lbpcascade_frontalface.dat groups"
+mkdir -p release/tests
+OBJECTS="release/cpp/ep_cascade_detector.o release/c/ep_cascade_detector.o release/c/ep_emulator.o release/c/ep_trace.o"
+g++ -I/opt/adapteva/esdk/tools/host/include -I/usr/local/include -L/opt/adapteva/esdk/tools/host/lib -O3 -g0 -Wall $EMULATION -fmessage-length=0 -fopenmp EpFaceHost/tests/stress_threads.cpp $OBJECTS -o release/tests/stress_threads -lopencv_core -lopencv_highgui -lpthread -lm $ELIBS
+g++ -I/opt/adapteva/esdk/tools/host/include -I/usr/local/include -L/opt/adapteva/esdk/tools/host/lib -O3 -g0 -Wall $EMULATION -fmessage-length=0 -fopenmp EpFaceHost/tests/detector_allocations.cpp $OBJECTS -o release/tests/detector_allocations -Wl,--wrap=malloc,--wrap=realloc,--wrap=calloc -lopencv_core -lopencv_highgui -lpthread -lm $ELIBS
+g++ -I/opt/adapteva/esdk/tools/host/include -I/usr/local/include -L/opt/adapteva/esdk/tools/host/lib -O3 -g0 -Wall $EMULATION -fmessage-length=0 -fopenmp EpFaceHost/tests/bench_group_rectangles.cpp $OBJECTS -o release/tests/bench_group_rectangles -lopencv_core -lopencv_highgui -lopencv_imgproc -lopencv_objdetect -lpthread -lm $ELIBS
+g++ -I/opt/adapteva/esdk/tools/host/include -I/usr/local/include -L/opt/adapteva/esdk/tools/host/lib -O3 -g0 -Wall $EMULATION -fmessage-length=0 -fopenmp EpFaceHost/tests/pipeline_results.cpp $OBJECTS -o release/tests/pipeline_results -lopencv_core -lopencv_highgui -lpthread -lm $ELIBS
+
+if [ -z "$EMULATION" ]; then
+    e-gcc EpFaceCore_commonlib/src/device_cascade_detector.c -O3 -ffast-math -Wall -std=c99 -T/opt/adapteva/esdk/bsps/current/internal.ldf -le-lib -o release/epiphany.elf
+fi
 